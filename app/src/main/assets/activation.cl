@@ -28,4 +28,68 @@ __kernel void activate_sigmoid(
     for(int index = get_global_id(0); index < n; index += get_global_size(0)) {
         out[index] = 1.0 / (1.0 + exp(-in[index]));
     }
-}
\ No newline at end of file
+}
+
+//epilogue of gemm-based layers: data[(o * channels + c) * inner + i] = activate(data + bias[c])
+__kernel void bias_activate(
+    const int n,
+    __global real *data,
+    const int channels,
+    const int inner,
+    const int has_bias,
+    __global const real *bias,
+    const int activation,
+    const real negative_slope
+) {
+    for(int index = get_global_id(0); index < n; index += get_global_size(0)) {
+        real value = data[index];
+        if(has_bias)
+            value += bias[(index / inner) % channels];
+        data[index] = activate(value, activation, negative_slope);
+    }
+}
+
+//epilogue of a gemm-based layer followed by a 2x2 max-pooling with stride 2, writes the pooled output only
+__kernel void bias_activate_maxpool2x2(
+    const int n,
+    __global const real *input,
+    const int channels,
+    const int input_h,
+    const int input_w,
+    __global real *output,
+    const int output_h,
+    const int output_w,
+    const int is_dm_layout,
+    const int has_bias,
+    __global const real *bias,
+    const int activation,
+    const real negative_slope
+) {
+    for(int index = get_global_id(0); index < n; index += get_global_size(0)) {
+        int b, c, ph, pw;
+        int base, step_w, step_h;
+        if(is_dm_layout) {
+            c = index % channels;
+            pw = (index / channels) % output_w;
+            ph = (index / channels / output_w) % output_h;
+            b = index / channels / output_w / output_h;
+            base = ((b * input_h + ph * 2) * input_w + pw * 2) * channels + c;
+            step_w = channels;
+            step_h = input_w * channels;
+        } else {
+            pw = index % output_w;
+            ph = (index / output_w) % output_h;
+            c = (index / output_w / output_h) % channels;
+            b = index / output_w / output_h / channels;
+            base = ((b * channels + c) * input_h + ph * 2) * input_w + pw * 2;
+            step_w = 1;
+            step_h = input_w;
+        }
+
+        //bias and activation are monotonic, so they are applied once after the max
+        real value = max(max(input[base], input[base + step_w]), max(input[base + step_h], input[base + step_h + step_w]));
+        if(has_bias)
+            value += bias[c];
+        output[index] = activate(value, activation, negative_slope);
+    }
+}
@@ -42,6 +42,13 @@
     #define VWM 4
 #endif
 
+//per-layer builds (-DSPECIALIZED plus one -D per constant of the kernel) turn geometry arguments into compile-time constants
+#ifdef SPECIALIZED
+    #define GEOMETRY(arg, value) (value)
+#else
+    #define GEOMETRY(arg, value) (arg)
+#endif
+
 #ifdef VWM
     #if VWM == 1
         typedef real realM;
@@ -78,6 +85,28 @@ static inline int getIndexFrom4D(int d1, int d2, int d3, int d4, int i1, int i2,
 	return i1 * (d2 * d3 * d4) + i2 * (d3 * d4) + i3 * d4 + i4;
 }
 
+//activation types, have to match ACTIVATION_* in dm_common.hpp
+#define ACTIVATION_NONE     0
+#define ACTIVATION_RELU     1
+#define ACTIVATION_LEAKY    2
+#define ACTIVATION_SIGMOID  3
+#define ACTIVATION_TANH     4
+
+static inline real activate(real x, const int activation, const real negative_slope) {
+    switch(activation) {
+        case ACTIVATION_RELU:
+            return x > 0 ? x : ZERO;
+        case ACTIVATION_LEAKY:
+            return x > 0 ? x : x * negative_slope;
+        case ACTIVATION_SIGMOID:
+            return ONE / (ONE + exp(-x));
+        case ACTIVATION_TANH:
+            return tanh(x);
+        default:
+            return x;
+    }
+}
+
 #if PRECISION == 16
 __kernel void convertFloatToHalf(
     __global const float *input,
@@ -64,31 +64,55 @@ __kernel void dm_conv_base(
     }
 }
 
+/*
+ * Filters are staged in local memory by chunks of K channels, K * conv_w * conv_h <= LOCAL_WEIGHTS
+ * Generic builds hold 64 channels of a 3x3 filter, specialized builds size it for their filter
+ */
+#ifndef LOCAL_WEIGHTS
+    #define LOCAL_WEIGHTS (64 * 3 * 3)
+#endif
+
 __kernel void dm_conv_local(
     const int offset_idx,
     __global const real *input,
-    const int input_w,
-    const int input_h,
-    const int input_c,
+    const int arg_input_w,
+    const int arg_input_h,
+    const int arg_input_c,
     __global const real *conv_weight,
     __global const real *bias,
-    const int conv_w,
-    const int conv_h,
-    const int conv_n,
-    const int stride_w,
-    const int stride_h,
-    const int pad_w,
-    const int pad_h,
+    const int arg_conv_w,
+    const int arg_conv_h,
+    const int arg_conv_n,
+    const int arg_stride_w,
+    const int arg_stride_h,
+    const int arg_pad_w,
+    const int arg_pad_h,
     __global real *output,
-    const int output_w,
-    const int output_h
+    const int arg_output_w,
+    const int arg_output_h,
+    const int has_bias,
+    const int activation,
+    const real negative_slope
 ) {
+    const int input_w = GEOMETRY(arg_input_w, INPUT_W);
+    const int input_h = GEOMETRY(arg_input_h, INPUT_H);
+    const int input_c = GEOMETRY(arg_input_c, INPUT_C);
+    const int conv_w = GEOMETRY(arg_conv_w, CONV_W);
+    const int conv_h = GEOMETRY(arg_conv_h, CONV_H);
+    const int conv_n = GEOMETRY(arg_conv_n, CONV_N);
+    const int stride_w = GEOMETRY(arg_stride_w, STRIDE_W);
+    const int stride_h = GEOMETRY(arg_stride_h, STRIDE_H);
+    const int pad_w = GEOMETRY(arg_pad_w, PAD_W);
+    const int pad_h = GEOMETRY(arg_pad_h, PAD_H);
+    const int output_w = GEOMETRY(arg_output_w, OUTPUT_W);
+    const int output_h = GEOMETRY(arg_output_h, OUTPUT_H);
+
     const int threadId_x = get_global_id(0) % output_w;
-    const int threadId_y = get_global_id(0) / output_h;
+    const int threadId_y = get_global_id(0) / output_w;
     const int threadId_z = get_global_id(1);
 
-    __local real local_weight[64 * 3 * 3];
-    const int K = (input_c < 64) ? input_c : 64;
+    __local real local_weight[LOCAL_WEIGHTS];
+    const int K = min(input_c, max(1, LOCAL_WEIGHTS / (conv_w * conv_h)));
 
     real result = 0;
 
@@ -128,7 +152,7 @@ __kernel void dm_conv_local(
         	while(remaining > VWM) {
         		realM tmp1 = (need_process == 0) ? 0 : vloadM(*LW);
         		realM tmp2 = (need_process == 0) ? 0 : vloadM(*GI);
-        		result += dot(tmp1, tmp2);
+        		result += dotM(tmp1, tmp2);
 
         		remaining -= VWM;
 	            LW += VWM;
@@ -147,5 +171,389 @@ __kernel void dm_conv_local(
     }
 
     if(threadId_x < output_w && threadId_y < output_h)
-        output[output_offset + (threadId_y * output_w + threadId_x) * conv_n + threadId_z] = result + bias[threadId_z];
-}
\ No newline at end of file
+        output[output_offset + (threadId_y * output_w + threadId_x) * conv_n + threadId_z] =
+            activate(has_bias ? result + bias[threadId_z] : result, activation, negative_slope);
+}
+
+//dm_conv_local followed by a 2x2 max-pooling with stride 2, output_w and output_h are the pooled sizes
+__kernel void dm_conv_local_maxpool2x2(
+    const int offset_idx,
+    __global const real *input,
+    const int arg_input_w,
+    const int arg_input_h,
+    const int arg_input_c,
+    __global const real *conv_weight,
+    __global const real *bias,
+    const int arg_conv_w,
+    const int arg_conv_h,
+    const int arg_conv_n,
+    const int arg_stride_w,
+    const int arg_stride_h,
+    const int arg_pad_w,
+    const int arg_pad_h,
+    __global real *output,
+    const int arg_output_w,
+    const int arg_output_h,
+    const int has_bias,
+    const int activation,
+    const real negative_slope
+) {
+    const int input_w = GEOMETRY(arg_input_w, INPUT_W);
+    const int input_h = GEOMETRY(arg_input_h, INPUT_H);
+    const int input_c = GEOMETRY(arg_input_c, INPUT_C);
+    const int conv_w = GEOMETRY(arg_conv_w, CONV_W);
+    const int conv_h = GEOMETRY(arg_conv_h, CONV_H);
+    const int conv_n = GEOMETRY(arg_conv_n, CONV_N);
+    const int stride_w = GEOMETRY(arg_stride_w, STRIDE_W);
+    const int stride_h = GEOMETRY(arg_stride_h, STRIDE_H);
+    const int pad_w = GEOMETRY(arg_pad_w, PAD_W);
+    const int pad_h = GEOMETRY(arg_pad_h, PAD_H);
+    const int output_w = GEOMETRY(arg_output_w, OUTPUT_W);
+    const int output_h = GEOMETRY(arg_output_h, OUTPUT_H);
+
+    const int threadId_x = get_global_id(0) % output_w;
+    const int threadId_y = get_global_id(0) / output_w;
+    const int threadId_z = get_global_id(1);
+
+    __local real local_weight[LOCAL_WEIGHTS];
+    const int K = min(input_c, max(1, LOCAL_WEIGHTS / (conv_w * conv_h)));
+
+    real result[4] = {0, 0, 0, 0};
+
+    const int input_offset = offset_idx * input_w * input_h * input_c;
+    const int output_offset = offset_idx * output_w * output_h * conv_n;
+
+    const int loop_counts = input_c / K + ((input_c % K) == 0 ? 0 : 1);
+    for(int loop_idx = 0 ; loop_idx < loop_counts ; loop_idx++) {
+        const int part_c_size = (loop_idx < (input_c / K)) ? K : input_c % K;
+        const int size_to_read = part_c_size * conv_w * conv_h;
+
+        __global const real *conv_weight_base = conv_weight + threadId_z * conv_h * conv_w * input_c;
+        //read data into local memory
+        for(int local_idx = get_local_id(0) ; local_idx < size_to_read ; local_idx += get_local_size(0)) {
+            const int c_ = local_idx % part_c_size;
+            const int w_ = (local_idx / part_c_size) % conv_w;
+            const int h_ = local_idx / part_c_size / conv_w;
+            local_weight[local_idx] = conv_weight_base[(h_ * conv_w + w_) * input_c + (loop_idx * K) + c_];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for(int k = 0 ; k < conv_h * conv_w ; k++) {
+            const int y = k / conv_w;
+            const int x = k % conv_w;
+
+            //the 4 convolution outputs covered by this pooled output
+            for(int s = 0 ; s < 4 ; s++) {
+                const int global_input_y = (threadId_y * 2 + (s >> 1)) * stride_h - pad_h + y;
+                const int global_input_x = (threadId_x * 2 + (s & 1)) * stride_w - pad_w + x;
+
+                const int need_process = (0 <= global_input_x && \
+                                            global_input_x < input_w && \
+                                            0 <= global_input_y && \
+                                            global_input_y < input_h) ? 1 : 0;
+                if(need_process == 0)
+                    continue;
+
+                int remaining = part_c_size;
+                __global const real *GI = input + input_offset + (global_input_y * input_w + global_input_x) * input_c + loop_idx * K;
+                __local  real *LW = local_weight + (y * conv_w + x) * part_c_size;
+
+                while(remaining > VWM) {
+                    realM tmp1 = vloadM(*LW);
+                    realM tmp2 = vloadM(*GI);
+                    result[s] += dotM(tmp1, tmp2);
+
+                    remaining -= VWM;
+                    LW += VWM;
+                    GI += VWM;
+                }
+
+                while(remaining > 0) {
+                    result[s] += (*LW) * (*GI);
+                    remaining--;
+                    LW++;
+                    GI++;
+                }
+            }
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if(threadId_x < output_w && threadId_y < output_h) {
+        //bias and activation are monotonic, so they are applied once after the max
+        real value = max(max(result[0], result[1]), max(result[2], result[3]));
+        output[output_offset + (threadId_y * output_w + threadId_x) * conv_n + threadId_z] =
+            activate(has_bias ? value + bias[threadId_z] : value, activation, negative_slope);
+    }
+}
+
+/*
+ * Winograd F(m x m, 3x3), m = tile_size (2 or 4), alpha = m + 2
+ * transforms are computed in float for both precisions
+ */
+__constant float winograd_2x2_bt[16] = {
+    1,  0, -1,  0,
+    0,  1,  1,  0,
+    0, -1,  1,  0,
+    0,  1,  0, -1
+};
+
+__constant float winograd_2x2_at[8] = {
+    1, 1,  1,  0,
+    0, 1, -1, -1
+};
+
+__constant float winograd_4x4_bt[36] = {
+    4,  0, -5,  0, 1, 0,
+    0, -4, -4,  1, 1, 0,
+    0,  4, -4, -1, 1, 0,
+    0, -2, -1,  2, 1, 0,
+    0,  2, -1, -2, 1, 0,
+    0,  4,  0, -5, 0, 1
+};
+
+__constant float winograd_4x4_at[24] = {
+    1, 1,  1, 1,  1, 0,
+    0, 1, -1, 2, -2, 0,
+    0, 1,  1, 4,  4, 0,
+    0, 1, -1, 8, -8, 1
+};
+
+//V = B^T * d * B for one (tile, channel), global: [num_block_tiles, channels]
+__kernel void winograd_input_transform(
+    const int tile_size,
+    __global const real *input,
+    const int input_offset,
+    const int is_dm_layout,
+    const int channels,
+    const int input_h,
+    const int input_w,
+    const int pad_top,
+    const int pad_left,
+    const int tiles_w,
+    const int tile_start,
+    const int num_block_tiles,
+    __global real *transformed //[alpha * alpha][channels][num_block_tiles]
+) {
+    const int p = get_global_id(0);
+    const int c = get_global_id(1);
+    if(p >= num_block_tiles || c >= channels)
+        return;
+
+    const int alpha = tile_size + 2;
+    __constant float *bt = (tile_size == 4) ? winograd_4x4_bt : winograd_2x2_bt;
+
+    const int y0 = ((tile_start + p) / tiles_w) * tile_size - pad_top;
+    const int x0 = ((tile_start + p) % tiles_w) * tile_size - pad_left;
+
+    float d[36];
+    float tmp[36];
+    for(int i = 0 ; i < alpha ; i++) {
+        int y = y0 + i;
+        for(int j = 0 ; j < alpha ; j++) {
+            int x = x0 + j;
+            float value = 0;
+            if(y >= 0 && y < input_h && x >= 0 && x < input_w) {
+                if(is_dm_layout)
+                    value = input[input_offset + (y * input_w + x) * channels + c];
+                else
+                    value = input[input_offset + (c * input_h + y) * input_w + x];
+            }
+            d[i * alpha + j] = value;
+        }
+    }
+
+    for(int i = 0 ; i < alpha ; i++) {
+        for(int j = 0 ; j < alpha ; j++) {
+            float sum = 0;
+            for(int l = 0 ; l < alpha ; l++)
+                sum += bt[i * alpha + l] * d[l * alpha + j];
+            tmp[i * alpha + j] = sum;
+        }
+    }
+
+    for(int i = 0 ; i < alpha ; i++) {
+        for(int j = 0 ; j < alpha ; j++) {
+            float sum = 0;
+            for(int l = 0 ; l < alpha ; l++)
+                sum += tmp[i * alpha + l] * bt[j * alpha + l];
+            transformed[((i * alpha + j) * channels + c) * num_block_tiles + p] = (real)sum;
+        }
+    }
+}
+
+/*
+ * products[xi] = filters[xi] * transformed[xi] for all alpha * alpha coefficients xi
+ * [num_filters x channels] * [channels x num_block_tiles], global: [num_block_tiles, num_filters, alpha * alpha] rounded up to the tile
+ */
+#define WINOGRAD_GEMM_TILE 8 //has to match the local size used by the host
+
+__kernel void winograd_batched_gemm(
+    const int num_filters,
+    const int channels,
+    const int num_block_tiles,
+    __global const real *filters,
+    __global const real *transformed,
+    __global real *products
+) {
+    __local float filters_tile[WINOGRAD_GEMM_TILE][WINOGRAD_GEMM_TILE];
+    __local float inputs_tile[WINOGRAD_GEMM_TILE][WINOGRAD_GEMM_TILE];
+
+    const int p = get_global_id(0);
+    const int f = get_global_id(1);
+    const int xi = get_global_id(2);
+    const int local_p = get_local_id(0);
+    const int local_f = get_local_id(1);
+
+    __global const real *u = filters + xi * num_filters * channels;
+    __global const real *v = transformed + xi * channels * num_block_tiles;
+
+    float sum = 0;
+    for(int c0 = 0 ; c0 < channels ; c0 += WINOGRAD_GEMM_TILE) {
+        int u_c = c0 + local_p;
+        int v_c = c0 + local_f;
+        filters_tile[local_f][local_p] = (f < num_filters && u_c < channels) ? (float)u[f * channels + u_c] : 0.0f;
+        inputs_tile[local_f][local_p] = (p < num_block_tiles && v_c < channels) ? (float)v[v_c * num_block_tiles + p] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for(int k = 0 ; k < WINOGRAD_GEMM_TILE ; k++)
+            sum += filters_tile[local_f][k] * inputs_tile[k][local_p];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if(p < num_block_tiles && f < num_filters)
+        products[(xi * num_filters + f) * num_block_tiles + p] = (real)sum;
+}
+
+//Y = A^T * M * A for one (tile, filter) followed by bias and activation, global: [num_block_tiles, num_filters]
+__kernel void winograd_output_transform(
+    const int tile_size,
+    __global const real *products, //[alpha * alpha][num_filters][num_block_tiles]
+    const int num_filters,
+    const int tiles_w,
+    const int tile_start,
+    const int num_block_tiles,
+    const int is_dm_layout,
+    __global real *output,
+    const int output_offset,
+    const int output_h,
+    const int output_w,
+    const int has_bias,
+    __global const real *bias,
+    const int activation,
+    const real negative_slope
+) {
+    const int p = get_global_id(0);
+    const int f = get_global_id(1);
+    if(p >= num_block_tiles || f >= num_filters)
+        return;
+
+    const int alpha = tile_size + 2;
+    __constant float *at = (tile_size == 4) ? winograd_4x4_at : winograd_2x2_at;
+
+    float m[36];
+    float tmp[24];
+    for(int xi = 0 ; xi < alpha * alpha ; xi++)
+        m[xi] = products[(xi * num_filters + f) * num_block_tiles + p];
+
+    for(int i = 0 ; i < tile_size ; i++) {
+        for(int j = 0 ; j < alpha ; j++) {
+            float sum = 0;
+            for(int l = 0 ; l < alpha ; l++)
+                sum += at[i * alpha + l] * m[l * alpha + j];
+            tmp[i * alpha + j] = sum;
+        }
+    }
+
+    const float b = has_bias ? (float)bias[f] : 0.0f;
+    const int y0 = ((tile_start + p) / tiles_w) * tile_size;
+    const int x0 = ((tile_start + p) % tiles_w) * tile_size;
+    for(int i = 0 ; i < tile_size && y0 + i < output_h ; i++) {
+        for(int j = 0 ; j < tile_size && x0 + j < output_w ; j++) {
+            float sum = b;
+            for(int l = 0 ; l < alpha ; l++)
+                sum += tmp[i * alpha + l] * at[j * alpha + l];
+
+            real result = activate((real)sum, activation, negative_slope);
+            if(is_dm_layout)
+                output[output_offset + ((y0 + i) * output_w + x0 + j) * num_filters + f] = result;
+            else
+                output[output_offset + (f * output_h + y0 + i) * output_w + x0 + j] = result;
+        }
+    }
+}
+
+/*
+ * Direct grouped/depthwise convolution, one output value per work-item
+ * global: [num_filters, output_h * output_w, batches] in DM layout, [output_h * output_w, num_filters, batches] in Caffe layout
+ * filters are [num_filters][filter_h][filter_w][channels / groups] (DM) or [num_filters][channels / groups][filter_h][filter_w] (Caffe)
+ */
+__kernel void grouped_conv(
+    __global const real *input,
+    const int input_h,
+    const int input_w,
+    const int channels,
+    __global const real *filters,
+    const int filter_h,
+    const int filter_w,
+    const int num_filters,
+    const int groups,
+    const int stride_h,
+    const int stride_w,
+    const int pad_top,
+    const int pad_left,
+    const int dilation_h,
+    const int dilation_w,
+    const int is_dm_layout,
+    __global real *output,
+    const int output_h,
+    const int output_w,
+    const int has_bias,
+    __global const real *bias,
+    const int activation,
+    const real negative_slope
+) {
+    const int f = is_dm_layout ? get_global_id(0) : get_global_id(1);
+    const int pixel = is_dm_layout ? get_global_id(1) : get_global_id(0);
+    const int b = get_global_id(2);
+
+    const int output_row = pixel / output_w;
+    const int output_col = pixel % output_w;
+    const int channels_per_group = channels / groups;
+    const int first_channel = (f / (num_filters / groups)) * channels_per_group;
+
+    __global const real *in = input + b * input_h * input_w * channels;
+    __global const real *w = filters + f * filter_h * filter_w * channels_per_group;
+
+    float sum = 0;
+    for(int kernel_row = 0 ; kernel_row < filter_h ; kernel_row++) {
+        int input_row = output_row * stride_h - pad_top + kernel_row * dilation_h;
+        if(input_row < 0 || input_row >= input_h)
+            continue;
+
+        for(int kernel_col = 0 ; kernel_col < filter_w ; kernel_col++) {
+            int input_col = output_col * stride_w - pad_left + kernel_col * dilation_w;
+            if(input_col < 0 || input_col >= input_w)
+                continue;
+
+            for(int c = 0 ; c < channels_per_group ; c++) {
+                if(is_dm_layout)
+                    sum += (float)in[(input_row * input_w + input_col) * channels + first_channel + c] *
+                           (float)w[(kernel_row * filter_w + kernel_col) * channels_per_group + c];
+                else
+                    sum += (float)in[((first_channel + c) * input_h + input_row) * input_w + input_col] *
+                           (float)w[(c * filter_h + kernel_row) * filter_w + kernel_col];
+            }
+        }
+    }
+
+    if(has_bias)
+        sum += (float)bias[f];
+
+    real result = activate((real)sum, activation, negative_slope);
+    if(is_dm_layout)
+        output[b * output_h * output_w * num_filters + pixel * num_filters + f] = result;
+    else
+        output[(b * num_filters + f) * output_h * output_w + pixel] = result;
+}
@@ -1,3 +1,4 @@
+//global: [output neurons, batches], batch get_global_id(1) is frame offset_idx + get_global_id(1) of the input
 kernel void fc_base(
 	const int offset_idx,
     global const real *input_frame,
@@ -5,20 +6,25 @@ kernel void fc_base(
     global const real *layer_W,
     global const real *layer_bias,
     global real *output_frame,
-    const int output_size
+    const int output_size,
+    const int output_stride,
+    const int has_bias,
+    const int activation,
+    const real negative_slope
 ) {
+    const int batch_idx = offset_idx + get_global_id(1);
     for(int n = get_global_id(0); n < output_size ; n += get_global_size(0)) {
         real result = 0.0f;
 
         int idx_remaining = input_size;
 
-        __global real *input_ptr = input_frame + offset_idx * input_size;
+        __global real *input_ptr = input_frame + batch_idx * input_size;
         __global real *filter_ptr = layer_W + n * input_size;
 
         while(idx_remaining >= VWM) {
             realM tmp1 = vloadM(*input_ptr);
             realM tmp2 = vloadM(*filter_ptr);
-            result += dot(tmp1,tmp2);
+            result += dotM(tmp1,tmp2);
 
             input_ptr += VWM;
             filter_ptr += VWM;
@@ -34,6 +40,6 @@ kernel void fc_base(
             idx_remaining -= 1;
         }
 
-        output_frame[offset_idx * output_size + n] = result + layer_bias[n];
+        output_frame[batch_idx * output_stride + n] = activate(has_bias ? result + layer_bias[n] : result, activation, negative_slope);
     }
 }
\ No newline at end of file
@@ -7,7 +7,8 @@ __kernel void caffe_maxpool(
     const int kernel_h, const int kernel_w,
     const int stride_h, const int stride_w,
     const int pad_h, const int pad_w,
-    __global real* top_data) {
+    __global real* top_data,
+    const int activation, const real negative_slope) {
   for (int index = get_global_id(0); index < nthreads;
       index += get_global_size(0)) {
     const int pw = index % pooled_width;
@@ -32,7 +33,7 @@ __kernel void caffe_maxpool(
         }
       }
     }
-    top_data[index] = maxval;
+    top_data[index] = activate(maxval, activation, negative_slope);
   }
 }
 
@@ -73,19 +74,33 @@ __kernel void caffe_avepool(
 
 __kernel void dm_maxpool(
     __global const real *input_frame,
-    const int input_w,
-    const int input_h,
-    const int num_channels,
-    const int filter_w,
-    const int filter_h,
-    const int stride_w,
-    const int stride_h,
-    const int pad_w,
-    const int pad_h,
+    const int arg_input_w,
+    const int arg_input_h,
+    const int arg_num_channels,
+    const int arg_filter_w,
+    const int arg_filter_h,
+    const int arg_stride_w,
+    const int arg_stride_h,
+    const int arg_pad_w,
+    const int arg_pad_h,
     __global real *output_frame,
-    const int output_w,
-    const int output_h,
-    const int batches) {
+    const int arg_output_w,
+    const int arg_output_h,
+    const int batches,
+    const int activation,
+    const real negative_slope) {
+    const int input_w = GEOMETRY(arg_input_w, INPUT_W);
+    const int input_h = GEOMETRY(arg_input_h, INPUT_H);
+    const int num_channels = GEOMETRY(arg_num_channels, NUM_CHANNELS);
+    const int filter_w = GEOMETRY(arg_filter_w, FILTER_W);
+    const int filter_h = GEOMETRY(arg_filter_h, FILTER_H);
+    const int stride_w = GEOMETRY(arg_stride_w, STRIDE_W);
+    const int stride_h = GEOMETRY(arg_stride_h, STRIDE_H);
+    const int pad_w = GEOMETRY(arg_pad_w, PAD_W);
+    const int pad_h = GEOMETRY(arg_pad_h, PAD_H);
+    const int output_w = GEOMETRY(arg_output_w, OUTPUT_W);
+    const int output_h = GEOMETRY(arg_output_h, OUTPUT_H);
+
 
     int thrId_i = get_global_id(0);
     int thrId_j = get_global_id(1);
@@ -110,7 +125,7 @@ __kernel void dm_maxpool(
                         max_value   = (val > max_value) ? val   : max_value;
                     }
                 }
-                output_frame[getIndexFrom3D(output_h, output_w, num_channels, j, i, k)] = max_value;
+                output_frame[getIndexFrom3D(output_h, output_w, num_channels, j, i, k)] = activate(max_value, activation, negative_slope);
             }
         }
     }
@@ -118,19 +133,31 @@ __kernel void dm_maxpool(
 
 __kernel void dm_avepool(
     __global const real *input_frame,
-    const int input_w,
-    const int input_h,
-    const int num_channels,
-    const int filter_w,
-    const int filter_h,
-    const int stride_w,
-    const int stride_h,
-    const int pad_w,
-    const int pad_h,
+    const int arg_input_w,
+    const int arg_input_h,
+    const int arg_num_channels,
+    const int arg_filter_w,
+    const int arg_filter_h,
+    const int arg_stride_w,
+    const int arg_stride_h,
+    const int arg_pad_w,
+    const int arg_pad_h,
     __global real *output_frame,
-    const int output_w,
-    const int output_h,
+    const int arg_output_w,
+    const int arg_output_h,
     const int batches) {
+    const int input_w = GEOMETRY(arg_input_w, INPUT_W);
+    const int input_h = GEOMETRY(arg_input_h, INPUT_H);
+    const int num_channels = GEOMETRY(arg_num_channels, NUM_CHANNELS);
+    const int filter_w = GEOMETRY(arg_filter_w, FILTER_W);
+    const int filter_h = GEOMETRY(arg_filter_h, FILTER_H);
+    const int stride_w = GEOMETRY(arg_stride_w, STRIDE_W);
+    const int stride_h = GEOMETRY(arg_stride_h, STRIDE_H);
+    const int pad_w = GEOMETRY(arg_pad_w, PAD_W);
+    const int pad_h = GEOMETRY(arg_pad_h, PAD_H);
+    const int output_w = GEOMETRY(arg_output_w, OUTPUT_W);
+    const int output_h = GEOMETRY(arg_output_h, OUTPUT_H);
+
 
     int thrId_i = get_global_id(0);
     int thrId_j = get_global_id(1);
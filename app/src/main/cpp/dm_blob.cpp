@@ -44,16 +44,42 @@ namespace deepmon {
         DeepMon::Get().AllocateMemory(this->environment, this, initialized_data);
     }
 
+    DM_Blob::DM_Blob(std::vector<uint32_t> shapes, ENVIRONMENT_TYPE evn,
+                     PRESICION_TYPE precision_type, float *cpu_view, cl_mem gpu_view) {
+        this->cpu_data = cpu_view;
+        this->gpu_data = gpu_view;
+        this->size = 1;
+        for(std::vector<uint32_t >::iterator it = shapes.begin() ; it != shapes.end() ; it++) {
+            this->shapes.push_back(*it);
+            this->size *= *it;
+        }
+        this->environment = evn;
+        this->precision = precision_type;
+        this->mem_size = this->size * ((evn == ENVIRONMENT_GPU && precision_type == PRECISION_16) ? sizeof(cl_half) : sizeof(float));
+        this->owns_memory = false;
+
+        if((evn == ENVIRONMENT_CPU && cpu_view == NULL) || (evn == ENVIRONMENT_GPU && gpu_view == NULL))
+            this->corrupted = true;
+    }
+
     DM_Blob::~DM_Blob() {
-        if(environment == ENVIRONMENT_CPU) {
-            if(this->cpu_data != NULL)
-                delete this->cpu_data;
-            this->cpu_data = NULL;
-        } else {
-            if(this->gpu_data != NULL)
+        set_ready_event(NULL);
+
+        if(!this->owns_memory) {
+            //wrappers never go to the memory pool, their memory belongs to the host
+            if(this->owns_gpu_view && this->gpu_data != NULL)
                 clReleaseMemObject(this->gpu_data);
-            this->gpu_data = NULL;
+            return;
         }
+
+        //buffers go back to the pool of their engine
+        DeepMon::Get().ReleaseMemory(this);
+    }
+
+    void DM_Blob::set_ready_event(cl_event event) {
+        if(this->ready_event != NULL)
+            clReleaseEvent(this->ready_event);
+        this->ready_event = event;
     }
 
     DM_Blob* DM_Blob::ConvertToCpuBlob() {
@@ -23,18 +23,152 @@
 
 #include <dm_execution_engine_cpu.hpp>
 #include <dm_blob.hpp>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <cblas.h>
 
 namespace deepmon {
+    static void release_cpu_buffer(float *buffer) {
+        delete[] buffer;
+    }
+
+    /*
+     * ACTIVATION is a constant here, so the switch of ACTIVATE() folds away and the loops vectorize
+     * CHW: rows [row_begin, row_end) of the (outer x channels) rows, each row holds inner items of one channel
+     */
+    template <int ACTIVATION>
+    static void bias_activation_chw(float *data, uint32_t channels, uint32_t inner, uint32_t row_begin, uint32_t row_end,
+                                    float *biases, float negative_slope) {
+        for(uint32_t r = row_begin ; r < row_end ; r++) {
+            float bias = (biases != NULL) ? biases[r % channels] : 0;
+            float *ptr = data + r * inner;
+            for(uint32_t i = 0 ; i < inner ; i++)
+                ptr[i] = ACTIVATE(ptr[i] + bias, ACTIVATION, negative_slope);
+        }
+    }
+
+    //HWC: rows [row_begin, row_end) of the outer rows, each row holds one item of every channel
+    template <int ACTIVATION>
+    static void bias_activation_hwc(float *data, uint32_t channels, uint32_t row_begin, uint32_t row_end,
+                                    float *biases, float negative_slope) {
+        for(uint32_t r = row_begin ; r < row_end ; r++) {
+            float *ptr = data + r * channels;
+            if(biases != NULL) {
+                for(uint32_t c = 0 ; c < channels ; c++)
+                    ptr[c] = ACTIVATE(ptr[c] + biases[c], ACTIVATION, negative_slope);
+            } else {
+                for(uint32_t c = 0 ; c < channels ; c++)
+                    ptr[c] = ACTIVATE(ptr[c], ACTIVATION, negative_slope);
+            }
+        }
+    }
+
+    template <int ACTIVATION>
+    static void bias_activation(float *data, uint32_t channels, uint32_t inner, uint32_t row_begin, uint32_t row_end,
+                                float *biases, float negative_slope) {
+        if(inner == 1)
+            bias_activation_hwc<ACTIVATION>(data, channels, row_begin, row_end, biases, negative_slope);
+        else
+            bias_activation_chw<ACTIVATION>(data, channels, inner, row_begin, row_end, biases, negative_slope);
+    }
+
+    static int get_default_num_threads() {
+        int num_threads = std::thread::hardware_concurrency();
+        return (num_threads > 0) ? num_threads : 1;
+    }
+
     DM_Execution_Engine_CPU::DM_Execution_Engine_CPU() : DM_Execution_Engine(ENVIRONMENT_CPU) {
+        this->memory_pool = new DM_Memory_Pool<float *>(release_cpu_buffer, DEFAULT_MEMORY_POOL_LIMIT);
+        SetNumThreads(0);
         this->initialized = true;
     }
 
+    DM_Execution_Engine_CPU::~DM_Execution_Engine_CPU() {
+        delete this->memory_pool;
+    }
+
+    void DM_Execution_Engine_CPU::SetNumThreads(int num_threads) {
+        if(num_threads <= 0)
+            num_threads = get_default_num_threads();
+        if(GetNumThreads() == num_threads)
+            return;
+
+        /*
+         * Inferences on other threads (server, streaming stages) may be inside a ParallelFor of the current pool,
+         * they hold their own reference, the old pool is destroyed when the last of them is done
+         */
+        std::shared_ptr<DM_Thread_Pool> new_pool = std::make_shared<DM_Thread_Pool>(num_threads);
+        {
+            std::lock_guard<std::mutex> lock(thread_pool_mutex);
+            this->thread_pool.swap(new_pool);
+        }
+        //openblas thread count is process-wide, gemms get their threads from the pool through ExecuteGemm instead
+        openblas_set_num_threads(1);
+        LOGD("CPU engine uses %d threads", num_threads);
+    }
+
+    std::shared_ptr<DM_Thread_Pool> DM_Execution_Engine_CPU::get_thread_pool() {
+        std::lock_guard<std::mutex> lock(thread_pool_mutex);
+        return this->thread_pool;
+    }
+
+    int DM_Execution_Engine_CPU::GetNumThreads() {
+        std::shared_ptr<DM_Thread_Pool> pool = get_thread_pool();
+        return (pool != NULL) ? pool->GetNumThreads() : 0;
+    }
+
+    void DM_Execution_Engine_CPU::ParallelFor(uint32_t n, uint32_t grain, const std::function<void(uint32_t, uint32_t)> &fn) {
+        std::shared_ptr<DM_Thread_Pool> pool = get_thread_pool();
+        if(pool->GetNumThreads() == 1 || n <= grain || DM_Thread_Pool::IsInsideTask()) {
+            fn(0, n);
+            return;
+        }
+
+        pool->ParallelFor(n, grain, fn);
+    }
+
+    /*
+     * c = a * op(b), a is [m x k] and c is [m x n], row-major
+     * The larger of m and n is split over the pool, every chunk is a single-threaded openblas gemm
+     * Inside a ParallelFor (e.g. one image per chunk) the whole gemm runs on the calling thread
+     */
+    void DM_Execution_Engine_CPU::ExecuteGemm(bool transpose_b, uint32_t m, uint32_t n, uint32_t k,
+                                              float *a, uint32_t lda, float *b, uint32_t ldb, float *c, uint32_t ldc) {
+        CBLAS_TRANSPOSE trans_b = transpose_b ? CblasTrans : CblasNoTrans;
+        if(m >= n) {
+            ParallelFor(m, std::max(GET_PARALLEL_GRAIN(n * k), (uint32_t)GEMM_GRAIN_ROWS),
+                        [=](uint32_t begin, uint32_t end) {
+                cblas_sgemm(CblasRowMajor, CblasNoTrans, trans_b,
+                            end - begin, n, k,
+                            1.0f,
+                            a + begin * lda, lda,
+                            b, ldb,
+                            0, c + begin * ldc, ldc);
+            });
+        } else {
+            //columns [begin, end) of c are rows of b if it is transposed, its columns otherwise
+            ParallelFor(n, std::max(GET_PARALLEL_GRAIN(m * k), (uint32_t)GEMM_GRAIN_ROWS),
+                        [=](uint32_t begin, uint32_t end) {
+                cblas_sgemm(CblasRowMajor, CblasNoTrans, trans_b,
+                            m, end - begin, k,
+                            1.0f,
+                            a, lda,
+                            transpose_b ? b + begin * ldb : b + begin, ldb,
+                            0, c + begin, ldc);
+            });
+        }
+    }
+
     void DM_Execution_Engine_CPU::AllocateMemory(DM_Blob *blob, float *initialized_data) {
         if(blob->get_env() == this->evn) {
             uint32_t size_in_bytes = blob->get_size() * sizeof(float);
             blob->set_mem_size(size_in_bytes);
 
-            float *data = new float[size_in_bytes / sizeof(float)];
+            size_t size_class = DM_Memory_Pool<float *>::GetSizeClass(size_in_bytes);
+            float *data = NULL;
+            if(!this->memory_pool->Acquire(size_class, blob->get_precision(), &data))
+                data = new float[size_class / sizeof(float)];
             if(initialized_data != NULL)
                 memcpy(data, initialized_data, size_in_bytes);
             blob->set_cpu_data(data);
@@ -42,4 +176,120 @@ namespace deepmon {
             blob->set_corrupted(true);
         }
     }
+
+    void DM_Execution_Engine_CPU::ReleaseMemory(DM_Blob *blob) {
+        float *data = blob->get_cpu_data();
+        if(data == NULL)
+            return;
+
+        size_t size_class = DM_Memory_Pool<float *>::GetSizeClass(blob->get_mem_size());
+        this->memory_pool->Release(data, size_class, blob->get_precision());
+        blob->set_cpu_data(NULL);
+    }
+
+    DM_Memory_Pool_Stats DM_Execution_Engine_CPU::GetMemoryPoolStats() {
+        return this->memory_pool->GetStats();
+    }
+
+    void DM_Execution_Engine_CPU::TrimMemoryPool(size_t keep_bytes) {
+        this->memory_pool->Trim(keep_bytes);
+    }
+
+    void DM_Execution_Engine_CPU::SetMemoryPoolLimit(size_t max_bytes_held) {
+        this->memory_pool->SetMaxBytesHeld(max_bytes_held);
+    }
+
+    /*
+     * Epilogue of gemm-based layers, done in one pass over the output:
+     * data[(o * channels + c) * inner + i] = activate(data[...] + biases[c])
+     * inner == 1 is the HWC case, a chunk item is then a whole row of channels instead of one channel
+     */
+    void DM_Execution_Engine_CPU::ExecuteBiasActivation(float *data, uint32_t outer, uint32_t channels, uint32_t inner,
+                                                        float *biases, int activation_type, float activation_threshold) {
+        if(activation_type == ACTIVATION_NONE && biases == NULL)
+            return;
+        if(activation_type < ACTIVATION_NONE || activation_type > ACTIVATION_TANH) {
+            LOGE("Unsupported activation type %d", activation_type);
+            return;
+        }
+
+        uint32_t rows = (inner == 1) ? outer : outer * channels;
+        uint32_t items_per_row = (inner == 1) ? channels : inner;
+        ParallelFor(rows, GET_PARALLEL_GRAIN(items_per_row),
+                    [=](uint32_t begin, uint32_t end) {
+            switch(activation_type) {
+                case ACTIVATION_NONE:
+                    bias_activation<ACTIVATION_NONE>(data, channels, inner, begin, end, biases, activation_threshold);
+                    break;
+                case ACTIVATION_RELU:
+                    bias_activation<ACTIVATION_RELU>(data, channels, inner, begin, end, biases, activation_threshold);
+                    break;
+                case ACTIVATION_LEAKY:
+                    bias_activation<ACTIVATION_LEAKY>(data, channels, inner, begin, end, biases, activation_threshold);
+                    break;
+                case ACTIVATION_SIGMOID:
+                    bias_activation<ACTIVATION_SIGMOID>(data, channels, inner, begin, end, biases, activation_threshold);
+                    break;
+                case ACTIVATION_TANH:
+                    bias_activation<ACTIVATION_TANH>(data, channels, inner, begin, end, biases, activation_threshold);
+                    break;
+            }
+        });
+    }
+
+    /*
+     * Epilogue of gemm-based layers followed by a 2x2 max-pooling with stride 2, only the pooled output is written
+     * Bias and activations are monotonic, so they are applied once after the max
+     */
+    void DM_Execution_Engine_CPU::ExecuteBiasActivationMaxPool2x2(MEMORY_LAYOUT mem_layout,
+                                                                  float *input, uint32_t channels, uint32_t input_h, uint32_t input_w,
+                                                                  float *output, uint32_t output_h, uint32_t output_w,
+                                                                  float *biases, int activation_type, float activation_threshold) {
+        if(mem_layout == MEMORY_LAYOUT_DM) {
+            //one chunk item is one pooled row
+            ParallelFor(output_h, GET_PARALLEL_GRAIN(output_w * channels),
+                        [=](uint32_t ph_begin, uint32_t ph_end) {
+                for(uint32_t ph = ph_begin ; ph < ph_end ; ph++) {
+                    for(uint32_t pw = 0 ; pw < output_w ; pw++) {
+                        float *row_0 = input + ((ph * 2) * input_w + pw * 2) * channels;
+                        float *row_1 = row_0 + input_w * channels;
+                        float *out = output + (ph * output_w + pw) * channels;
+                        for(uint32_t c = 0 ; c < channels ; c++) {
+                            float value = std::max(std::max(row_0[c], row_0[c + channels]), std::max(row_1[c], row_1[c + channels]));
+                            if(biases != NULL)
+                                value += biases[c];
+                            out[c] = ACTIVATE(value, activation_type, activation_threshold);
+                        }
+                    }
+                }
+            });
+        } else {
+            //one chunk item is one channel
+            ParallelFor(channels, GET_PARALLEL_GRAIN(output_h * output_w),
+                        [=](uint32_t c_begin, uint32_t c_end) {
+                for(uint32_t c = c_begin ; c < c_end ; c++) {
+                    float *in = input + c * input_h * input_w;
+                    float *out = output + c * output_h * output_w;
+                    float bias = (biases != NULL) ? biases[c] : 0;
+                    for(uint32_t ph = 0 ; ph < output_h ; ph++) {
+                        float *row_0 = in + (ph * 2) * input_w;
+                        float *row_1 = row_0 + input_w;
+                        for(uint32_t pw = 0 ; pw < output_w ; pw++) {
+                            float value = std::max(std::max(row_0[pw * 2], row_0[pw * 2 + 1]), std::max(row_1[pw * 2], row_1[pw * 2 + 1]));
+                            out[ph * output_w + pw] = ACTIVATE(value + bias, activation_type, activation_threshold);
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    float *DM_Execution_Engine_CPU::AllocateArena(size_t size_in_bytes) {
+        return new float[(size_in_bytes + sizeof(float) - 1) / sizeof(float)];
+    }
+
+    void DM_Execution_Engine_CPU::ReleaseArena(float *arena) {
+        if(arena != NULL)
+            delete[] arena;
+    }
 }
\ No newline at end of file
@@ -26,49 +26,59 @@
 #include <dm_execution_engine_gpu.hpp>
 #include <dm_kernels.hpp>
 #include <cstdlib>
+#include <clblast_half.h>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
 namespace deepmon {
-    DM_Execution_Engine_GPU::DM_Execution_Engine_GPU() : DM_Execution_Engine(ENVIRONMENT_GPU) {
-        //initialize GPU
-        if(!this->scan_for_gpus()) {
-            LOGE("Failed to scan for gpus");
-            return;
-        }
-
-        //compile kernels
-        if(!compile_kernels()) {
-            LOGE("Failed to compile kernel code");
-            return;
-        }
+    //queue used by the calling thread, see SelectQueue
+    static thread_local uint current_queue_id = 0;
 
-        //extract kernels
-        if(!read_kernels()) {
-            LOGE("Failed to extract kernels from program code");
-            return;
-        }
+    static void release_gpu_buffer(cl_mem buffer) {
+        clReleaseMemObject(buffer);
+    }
 
-        this->has_working_gpu = true;
-        this->initialized = true;
+    DM_Execution_Engine_GPU::DM_Execution_Engine_GPU() : DM_Execution_Engine(ENVIRONMENT_GPU) {
+        this->memory_pool = new DM_Memory_Pool<cl_mem>(release_gpu_buffer, DEFAULT_MEMORY_POOL_LIMIT);
     }
 
     DM_Execution_Engine_GPU::DM_Execution_Engine_GPU(std::string package_path) : DM_Execution_Engine(ENVIRONMENT_GPU) {
-        //initialize GPU
+        this->memory_pool = new DM_Memory_Pool<cl_mem>(release_gpu_buffer, DEFAULT_MEMORY_POOL_LIMIT);
+        this->package_path = package_path;
+        //compiled programs are cached next to the kernel files
+        this->program_cache = DM_Program_Cache(package_path);
+    }
+
+    bool DM_Execution_Engine_GPU::Initialize() {
+        std::call_once(this->start_flag, [this] { start(); });
+        return this->has_working_gpu;
+    }
+
+    //device, context and queues only, kernel files are compiled by GetKernel
+    void DM_Execution_Engine_GPU::start() {
         if(!this->scan_for_gpus()) {
             LOGE("Failed to scan for gpus");
             return;
         }
 
-        //compile kernels
-        if(!compile_kernels(package_path)) {
-            LOGE("Failed to compile kernel code");
-            return;
+        //fp16 kernels are only compiled on devices with cl_khr_fp16
+        size_t extensions_length = 0;
+        cl_int err = clGetDeviceInfo(this->device, CL_DEVICE_EXTENSIONS, 0, NULL, &extensions_length);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err == CL_SUCCESS && extensions_length > 0) {
+            std::vector<char> extensions(extensions_length + 1, '\0');
+            err = clGetDeviceInfo(this->device, CL_DEVICE_EXTENSIONS, extensions_length, extensions.data(), NULL);
+            SAMPLE_CHECK_ERRORS(err);
+            if(err == CL_SUCCESS && std::string(extensions.data()).find(std::string("cl_khr_fp16")) != std::string::npos)
+                this->support_fp16 = true;
         }
+        if(!this->support_fp16)
+            LOGD("No support for cl_khr_fp16");
 
-        //extract kernels
-        if(!read_kernels()) {
-            LOGE("Failed to extract kernels from program code");
-            return;
-        }
+        //tuned launches of an earlier run on this device
+        this->kernel_tuner.Open(this->package_path.empty() ? std::string("") : this->package_path + "/" + DEFAULT_TUNING_FILE,
+                                this->device_signature);
 
         this->has_working_gpu = true;
         this->initialized = true;
@@ -193,6 +203,24 @@ namespace deepmon {
             LOGD("Device has version %s", version);
 #endif
 
+            char device_name[128] = {0};
+            char driver_version[64] = {0};
+            clGetDeviceInfo(this->device, CL_DEVICE_NAME, sizeof (device_name) - 1, device_name, 0);
+            clGetDeviceInfo(this->device, CL_DRIVER_VERSION, sizeof (driver_version) - 1, driver_version, 0);
+            this->device_signature = std::string(device_name) + " / " + std::string(version, strnlen(version, sizeof (version))) +
+                                     " / " + std::string(driver_version);
+
+            //alignment of sub-buffers
+            cl_uint align_in_bits = 0;
+            err = clGetDeviceInfo(this->device,
+                                  CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                                  sizeof (align_in_bits),
+                                  &align_in_bits,
+                                  0);
+            SAMPLE_CHECK_ERRORS(err);
+            if(err == CL_SUCCESS && align_in_bits >= 8)
+                this->mem_base_addr_align = align_in_bits / 8;
+
             //create one queue for each compute units just in case
             this->queues = new cl_command_queue[this->num_compute_units];
             for(uint qid = 0 ; qid < this->num_compute_units ; qid++) {
@@ -230,6 +258,14 @@ namespace deepmon {
         LOGD("--%s--", __PRETTY_FUNCTION__);
 #endif
 
+        //binaries of an earlier start skip the compilation
+        cl_program cached_program = this->program_cache.Load(this->context, this->device, this->device_signature,
+                                                             source, build_args);
+        if(cached_program != NULL) {
+            LOGD("Program loaded from cache");
+            return cached_program;
+        }
+
         cl_int err = CL_SUCCESS;
         const char *kernelSource = source.c_str();
         cl_program program = clCreateProgramWithSource(
@@ -249,6 +285,9 @@ namespace deepmon {
             return NULL;
         }
 
+        if(err == CL_SUCCESS)
+            this->program_cache.Store(program, this->device, this->device_signature, source, build_args);
+
         return program;
     }
 
@@ -295,6 +334,10 @@ namespace deepmon {
     std::string DM_Execution_Engine_GPU::read_file(std::string path) {
 
         FILE *fp = fopen(path.c_str(),"r");
+        if(fp == NULL) {
+            LOGE("Failed to open %s", path.c_str());
+            return std::string("");
+        }
         int fd = fileno(fp);
         struct stat buf;
         fstat(fd, &buf);
@@ -311,145 +354,188 @@ namespace deepmon {
         return data;
     }
 
-    bool DM_Execution_Engine_GPU::compile_kernels() {
-#ifdef PRINT_FUNCTION_NAME
-        LOGD("--%s--", __PRETTY_FUNCTION__);
-#endif
+    //without a package path only the kernels embedded in dm_kernels.hpp are available
+    std::string DM_Execution_Engine_GPU::get_kernel_source(std::string file) {
+        if(this->package_path.empty()) {
+            if(file == "common.cl")
+                return kernels.at(0);
+            if(file == "im2col.cl")
+                return kernels.at(1);
+            return std::string("");
+        }
 
-        bool is_compiled = true;
-        cl_int err = CL_SUCCESS;
+        return read_file(this->package_path + "/" + file);
+    }
 
-        std::string build_args = "";
+    //called with kernels_mutex held, a file failing to compile is not tried again
+    bool DM_Execution_Engine_GPU::compile_kernel_file(PRESICION_TYPE precision, DM_Kernel_File &kernel_file, std::string build_options) {
+        std::pair<std::string, PRESICION_TYPE> program_key(kernel_file.file + " " + build_options, precision);
+        if(this->programs.find(program_key) != this->programs.end())
+            return this->programs.find(program_key)->second != NULL;
+
+        cl_program program = NULL;
+        if(precision == PRECISION_32 || (precision == PRECISION_16 && this->support_fp16)) {
+            //every file uses the types and helpers of common.cl
+            std::string source_string = (precision == PRECISION_32) ? "#define PRECISION 32\n" : "#define PRECISION 16\n";
+            source_string += get_kernel_source("common.cl") + "\n";
+            if(kernel_file.file != "common.cl") {
+                std::string source = get_kernel_source(kernel_file.file);
+                if(source.empty())
+                    LOGE("No source for %s", kernel_file.file.c_str());
+                else
+                    program = build_program(source_string + source + "\n", build_options);
+            } else
+                program = build_program(source_string, build_options);
+        }
 
-        //compile for 32-bits floating point
-        std::string source_string = "";
-        source_string += "#define PRECISION 32\n";
-        for(int i = 0 ; i < kernels.size() ; i++) {
-            source_string += kernels.at(i);
+        this->programs.insert(std::pair<std::pair<std::string, PRESICION_TYPE>, cl_program>(program_key, program));
+        if(program == NULL) {
+            LOGE("Failed to compile %s for FP%d (%s)", kernel_file.file.c_str(), (precision == PRECISION_32) ? 32 : 16,
+                 build_options.c_str());
+            return false;
         }
 
-        //LOGD("%s",source_string.c_str());
+        unsigned int vector_width = DEFAULT_VECTOR_WIDTH;
+        size_t vwm_pos = build_options.find("-DVWM=");
+        if(vwm_pos != std::string::npos)
+            vector_width = atoi(build_options.c_str() + vwm_pos + strlen("-DVWM="));
 
-        cl_program program_32 = build_program(source_string, build_args);
-        if(program_32 == NULL)
-            return false;
-        this->program_32 = program_32;
-
-        //compile for 16-bits floating point
-        char extensions[1024];
-        size_t extension_length = 0;
-        clGetDeviceInfo(this->device, CL_DEVICE_EXTENSIONS,
-                        sizeof (extensions),
-                        extensions,
-                        &extension_length);
-
-        //search support for fp16 in extensions
-        if(std::string(extensions).find(std::string("cl_khr_fp16")) != std::string::npos) {
-            source_string = "";
-            source_string += "#define PRECISION 16\n";
-            for(int i = 0 ; i < kernels.size() ; i++) {
-                source_string += kernels.at(i);
-            }
-            cl_program program_16 = build_program(source_string, build_args);
-            if(program_16 != NULL) {
-                this->support_fp16 = true;
-                this->program_16 = program_16;
+        std::map<std::string, DM_Kernel_Object *> &kernels_map = (precision == PRECISION_32) ? this->kernels_map_fp32 : this->kernels_map_fp16;
+        for(int i = 0 ; i < kernel_file.kernel_names.size() ; i++) {
+            std::string kernel_name = kernel_file.kernel_names.at(i);
+#ifdef PRINT_VARS
+            LOGD("FP%d Program: Extracting %s kernel", (precision == PRECISION_32) ? 32 : 16, kernel_name.c_str());
+#endif
+            cl_int err = CL_SUCCESS;
+            cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &err);
+            SAMPLE_CHECK_ERRORS(err);
+            if(err == CL_SUCCESS) {
+                //extract more information
+                DM_Kernel_Object *kobj = new DM_Kernel_Object(kernel, this->device, vector_width);
+                std::pair<std::string, DM_Kernel_Object *> pair(kernel_name + " " + build_options, kobj);
+                kernels_map.insert(pair);
             }
-        } else {
-            LOGD("No support for cl_khr_fp16");
         }
 
-        return is_compiled;
+        return true;
     }
 
-    bool DM_Execution_Engine_GPU::compile_kernels(std::string package_path) {
-        bool is_compiled = true;
-        std::string build_args = "";
-
-        //compile for 32-bits floating point
-        std::string source_string = "";
-        source_string += "#define PRECISION 32\n";
-        for(int i = 0 ; i < this->kernel_files.size() ; i++) {
-            //read file
-            std::string data = read_file(package_path + "/" + this->kernel_files.at(i));
-            source_string += data + "\n";
-        }
+    DM_Kernel_Object *DM_Execution_Engine_GPU::get_kernel_object(PRESICION_TYPE precision, std::string kernel_name,
+                                                                std::string build_options) {
+        if(!Initialize())
+            return NULL;
 
-        cl_program program_32 = build_program(source_string, build_args);
-        if(program_32 == NULL)
-            return false;
-        this->program_32 = program_32;
-
-        //compile for 16-bits floating point
-        char extensions[1024];
-        size_t extension_length = 0;
-        clGetDeviceInfo(this->device, CL_DEVICE_EXTENSIONS,
-                        sizeof (extensions),
-                        extensions,
-                        &extension_length);
-
-        //search support for fp16 in extensions
-        if(std::string(extensions).find(std::string("cl_khr_fp16")) != std::string::npos) {
-            source_string = "";
-            source_string += "#define PRECISION 16\n";
+        std::lock_guard<std::mutex> lock(this->kernels_mutex);
+        std::map<std::string, DM_Kernel_Object *> &kernels_map = (precision == PRECISION_32) ? this->kernels_map_fp32 : this->kernels_map_fp16;
+        std::string kernel_key = kernel_name + " " + build_options;
+        std::map<std::string, DM_Kernel_Object *>::iterator it = kernels_map.find(kernel_key);
+        if(it == kernels_map.end()) {
+            //first use of the file defining the kernel
             for(int i = 0 ; i < this->kernel_files.size() ; i++) {
-                //read file
-                std::string data = read_file(package_path + "/" + this->kernel_files.at(i));
-                source_string += data + "\n";
+                std::vector<std::string> &names = this->kernel_files.at(i).kernel_names;
+                if(std::find(names.begin(), names.end(), kernel_name) != names.end()) {
+                    compile_kernel_file(precision, this->kernel_files.at(i), build_options);
+                    break;
+                }
             }
-            cl_program program_16 = build_program(source_string, build_args);
-            if(program_16 != NULL) {
-                this->support_fp16 = true;
-                this->program_16 = program_16;
+
+            it = kernels_map.find(kernel_key);
+            if(it == kernels_map.end()) {
+                LOGE("Kernel %s is not available", kernel_name.c_str());
+                return NULL;
             }
-        } else {
-            LOGD("No support for cl_khr_fp16");
         }
 
-        return is_compiled;
+        return it->second;
     }
 
-    bool DM_Execution_Engine_GPU::read_kernels() {
-        bool is_successful = false;
+    cl_kernel DM_Execution_Engine_GPU::GetKernel(PRESICION_TYPE precision, string kernel_name, string build_options) {
+        DM_Kernel_Object *kobj = get_kernel_object(precision, kernel_name, build_options);
+        return (kobj != NULL) ? kobj->get_kernel() : NULL;
+    }
 
-        if(this->program_32 != NULL) {
-            cl_int err = CL_SUCCESS;
-            for(int i = 0 ; i < this->kernel_names.size() ; i++) {
-                std::string kernel_name = this->kernel_names.at(i);
-#ifdef PRINT_VARS
-                LOGD("FP32 Program: Extracting %s kernel", kernel_name.c_str());
-#endif
-                cl_kernel kernel = clCreateKernel(this->program_32, kernel_name.c_str(), &err);
-                SAMPLE_CHECK_ERRORS(err);
-                if(err == CL_SUCCESS) {
-                    //extract more information
-                    DM_Kernel_Object *kobj = new DM_Kernel_Object(kernel);
-                    std::pair<std::string, DM_Kernel_Object *> pair(kernel_name, kobj);
-                    this->kernels_map_fp32.insert(pair);
-                }
-            }
-            is_successful = true;
+    static std::string get_vector_width_options(std::string build_options, unsigned int vector_width) {
+        if(vector_width == DEFAULT_VECTOR_WIDTH)
+            return build_options;
+        return build_options + (build_options.empty() ? "" : " ") + "-DVWM=" + std::to_string(vector_width);
+    }
+
+    cl_int DM_Execution_Engine_GPU::EnqueueTunedKernel(PRESICION_TYPE precision, std::string kernel_name, std::string build_options,
+                                                       std::string key, DM_Tuning_Space space, DM_Blob *output,
+                                                       DM_Kernel_Launcher launcher) {
+        if(space.vector_widths.empty())
+            space.vector_widths.push_back(DEFAULT_VECTOR_WIDTH);
+        if(space.local_sizes.empty())
+            space.local_sizes.push_back(std::vector<size_t>());
+
+        //specialized variants are tuned separately from the generic kernel
+        std::string tuning_key = kernel_name + ((precision == PRECISION_32) ? ":fp32:" : ":fp16:") + key
+                                 + (build_options.empty() ? "" : ":jit");
+        //entries outside of the space (e.g. a driver-chosen local size for a kernel which needs an explicit one) are handled as missing
+        DM_Launch_Params params;
+        bool is_found = this->kernel_tuner.Find(tuning_key, &params);
+        if(is_found && (std::find(space.vector_widths.begin(), space.vector_widths.end(), params.vector_width) == space.vector_widths.end() ||
+                        std::find(space.local_sizes.begin(), space.local_sizes.end(), params.local_size) == space.local_sizes.end())) {
+            LOGE("Tuning database entry of %s is not a candidate, ignored", tuning_key.c_str());
+            is_found = false;
         }
+        if(!is_found) {
+            params.vector_width = space.vector_widths.at(0);
+            params.local_size = space.local_sizes.at(0);
+
+            if(this->is_tuning) {
+                //the output is written by every candidate, failed candidates must not leave it corrupted
+                bool was_corrupted = output->is_corrupted();
+                double best_ms = -1;
+                for(int v = 0 ; v < space.vector_widths.size() ; v++) {
+                    DM_Kernel_Object *kobj = get_kernel_object(precision, kernel_name,
+                                                               get_vector_width_options(build_options, space.vector_widths.at(v)));
+                    if(kobj == NULL)
+                        continue;
+
+                    for(int l = 0 ; l < space.local_sizes.size() ; l++) {
+                        std::vector<size_t> &local_size = space.local_sizes.at(l);
+                        size_t work_group_size = 1;
+                        for(int d = 0 ; d < local_size.size() ; d++)
+                            work_group_size *= local_size.at(d);
+                        if(kobj->get_max_work_group_size() > 0 && work_group_size > kobj->get_max_work_group_size())
+                            continue;
+
+                        const size_t *lgs = local_size.empty() ? NULL : local_size.data();
+                        bool is_failed = launcher(kobj->get_kernel(), lgs) != CL_SUCCESS;
+                        FinalizeAllTasks();
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        for(int r = 0 ; r < TUNING_RUNS && !is_failed ; r++)
+                            is_failed = launcher(kobj->get_kernel(), lgs) != CL_SUCCESS;
+                        FinalizeAllTasks();
+                        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                        if(is_failed) {
+                            output->set_corrupted(was_corrupted);
+                            continue;
+                        }
+                        if(best_ms < 0 || ms < best_ms) {
+                            best_ms = ms;
+                            params.vector_width = space.vector_widths.at(v);
+                            params.local_size = local_size;
+                        }
+                    }
+                }
 
-        if(this->program_16 != NULL) {
-            cl_int err = CL_SUCCESS;
-            for(int i = 0 ; i < this->kernel_names.size() ; i++) {
-                std::string kernel_name = this->kernel_names.at(i);
-#ifdef PRINT_VARS
-                LOGD("FP16 Program: Extracting %s kernel", kernel_name.c_str());
-#endif
-                cl_kernel kernel = clCreateKernel(this->program_16, kernel_name.c_str(), &err);
-                SAMPLE_CHECK_ERRORS(err);
-                if(err == CL_SUCCESS) {
-                    //extract more information
-                    DM_Kernel_Object *kobj = new DM_Kernel_Object(kernel);
-                    std::pair<std::string, DM_Kernel_Object *> pair(kernel_name, kobj);
-                    this->kernels_map_fp16.insert(pair);
+                if(best_ms >= 0) {
+                    LOGD("Tuned %s: VWM %u, local size %u, %.3f ms", tuning_key.c_str(), params.vector_width,
+                         params.local_size.empty() ? 0 : (uint32_t)params.local_size.at(0), best_ms / TUNING_RUNS);
+                    this->kernel_tuner.Store(tuning_key, params);
                 }
             }
         }
 
-        return is_successful;
+        cl_kernel kernel = GetKernel(precision, kernel_name, get_vector_width_options(build_options, params.vector_width));
+        if(kernel == NULL) {
+            output->set_corrupted(true);
+            return CL_INVALID_KERNEL;
+        }
+        return launcher(kernel, params.local_size.empty() ? NULL : params.local_size.data());
     }
 
     void DM_Execution_Engine_GPU::FinalizeAllTasks() {
@@ -459,6 +545,142 @@ namespace deepmon {
         }
     }
 
+    cl_command_queue DM_Execution_Engine_GPU::GetCurrentQueue() {
+        if(!Initialize())
+            return NULL;
+        return this->queues[current_queue_id];
+    }
+
+    void DM_Execution_Engine_GPU::SelectQueue(uint queue_id) {
+        current_queue_id = queue_id % this->num_queues;
+    }
+
+    bool DM_Execution_Engine_GPU::ForkQueues() {
+        std::lock_guard<std::mutex> lock(this->scheduler_mutex);
+        if(this->num_queues < 2 || this->is_forked)
+            return false;
+
+        cl_event fork_event = NULL;
+        cl_int err = clEnqueueMarkerWithWaitList(GetCurrentQueue(), 0, NULL, &fork_event);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS)
+            return false;
+
+        for(uint i = 0 ; i < this->num_queues && err == CL_SUCCESS ; i++) {
+            if(i == current_queue_id)
+                continue;
+            err = clEnqueueBarrierWithWaitList(this->queues[i], 1, &fork_event, NULL);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+        clReleaseEvent(fork_event);
+
+        //queues already waiting for the marker only lose a bit of concurrency
+        if(err != CL_SUCCESS)
+            return false;
+
+        this->is_forked = true;
+        this->fork_queue_id = current_queue_id;
+        return true;
+    }
+
+    bool DM_Execution_Engine_GPU::JoinQueues(cl_event *event) {
+        std::lock_guard<std::mutex> lock(this->scheduler_mutex);
+        if(!this->is_forked)
+            return false;
+
+        cl_int err = CL_SUCCESS;
+        std::vector<cl_event> join_events;
+        for(uint i = 0 ; i < this->num_queues && err == CL_SUCCESS ; i++) {
+            if(i == this->fork_queue_id)
+                continue;
+            cl_event join_event = NULL;
+            err = clEnqueueMarkerWithWaitList(this->queues[i], 0, NULL, &join_event);
+            SAMPLE_CHECK_ERRORS(err);
+            if(err == CL_SUCCESS)
+                join_events.push_back(join_event);
+        }
+
+        if(err == CL_SUCCESS) {
+            err = clEnqueueBarrierWithWaitList(this->queues[this->fork_queue_id],
+                                               join_events.size(), join_events.data(), event);
+            SAMPLE_CHECK_ERRORS(err);
+        }
+        for(int i = 0 ; i < join_events.size() ; i++)
+            clReleaseEvent(join_events.at(i));
+
+        //without the barrier, the deferred buffers are only safe once every queue is idle
+        if(err != CL_SUCCESS) {
+            if(event != NULL)
+                *event = NULL;
+            FinalizeAllTasks();
+        }
+
+        //later commands on the forking queue run after everything enqueued while forked
+        for(int i = 0 ; i < this->deferred_buffers.size() ; i++) {
+            DM_Deferred_Buffer &deferred = this->deferred_buffers.at(i);
+            this->memory_pool->Release(deferred.buffer, deferred.size_class, deferred.precision);
+        }
+        this->deferred_buffers.clear();
+
+        this->is_forked = false;
+        current_queue_id = this->fork_queue_id;
+        return true;
+    }
+
+    std::vector<cl_event> DM_Execution_Engine_GPU::GetWaitList(std::vector<DM_Blob *> blobs) {
+        std::vector<cl_event> wait_list;
+        for(int i = 0 ; i < blobs.size() ; i++) {
+            if(blobs.at(i) == NULL || blobs.at(i)->get_ready_event() == NULL)
+                continue;
+            if(std::find(wait_list.begin(), wait_list.end(), blobs.at(i)->get_ready_event()) == wait_list.end())
+                wait_list.push_back(blobs.at(i)->get_ready_event());
+        }
+        return wait_list;
+    }
+
+    cl_int DM_Execution_Engine_GPU::EnqueueKernel(cl_kernel kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size,
+                                                  std::vector<DM_Blob *> inputs, DM_Blob *output) {
+        //output is waited for as well, a reused blob may still be read or written by earlier commands
+        inputs.push_back(output);
+        std::vector<cl_event> wait_list = GetWaitList(inputs);
+
+        cl_event event = NULL;
+        cl_int err = clEnqueueNDRangeKernel(
+                GetCurrentQueue(),
+                kernel,
+                work_dim,
+                0,
+                global_size,
+                local_size,
+                wait_list.size(), wait_list.empty() ? NULL : wait_list.data(), &event
+        );
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(err != CL_SUCCESS) {
+            if(output != NULL)
+                output->set_corrupted(true);
+            return err;
+        }
+
+        if(output != NULL)
+            output->set_ready_event(event);
+        else
+            clReleaseEvent(event);
+
+        return err;
+    }
+
+    void DM_Execution_Engine_GPU::WaitForBlob(DM_Blob *blob) {
+        cl_event event = blob->get_ready_event();
+        if(event == NULL)
+            return;
+
+        cl_int err = clWaitForEvents(1, &event);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS)
+            blob->set_corrupted(true);
+    }
+
     bool DM_Execution_Engine_GPU::read_data_from_host_fp32(cl_mem cl_data, float *data, int size_in_bytes) {
         cl_int err = CL_SUCCESS;
 
@@ -502,7 +724,7 @@ namespace deepmon {
         if(err != CL_SUCCESS)
             return false;
 
-        cl_kernel kernel = (this->kernels_map_fp16.find(std::string(KERNEL_CONVERT_FLOAT_TO_HALF))->second)->get_kernel();
+        cl_kernel kernel = GetKernel(PRECISION_16, KERNEL_CONVERT_FLOAT_TO_HALF);
         err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &cl_tmp);
         err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &cl_data);
         SAMPLE_CHECK_ERRORS(err);
@@ -511,22 +733,26 @@ namespace deepmon {
 
         size_t wgs[1] = {(size_t) size_in_bytes / sizeof(cl_half)};
 
-        cl_command_queue queue = GetCurrentQueue();
+        //data belongs to the caller, the conversion has to be done before returning
+        cl_event event = NULL;
         err = clEnqueueNDRangeKernel(
-                queue,
+                GetCurrentQueue(),
                 kernel,
                 1,
                 0,
                 wgs,
                 0,
-                0, 0, 0
+                0, 0, &event
         );
         SAMPLE_CHECK_ERRORS(err);
-        if(err != CL_SUCCESS)
+        if(err != CL_SUCCESS) {
+            clReleaseMemObject(cl_tmp);
             return false;
+        }
 
-        err = clFinish(queue);
+        err = clWaitForEvents(1, &event);
         SAMPLE_CHECK_ERRORS(err);
+        clReleaseEvent(event);
 
         clReleaseMemObject(cl_tmp);
 
@@ -554,56 +780,110 @@ namespace deepmon {
             if(blob->get_precision() == PRECISION_16 && !this->support_fp16)
                 return NULL;
 
-            cl_int err = CL_SUCCESS;
-
-            cl_mem cl_data = NULL;
-            int cl_data_size = blob->get_size() * sizeof(cl_float);
-            if(blob->get_precision() == PRECISION_16) {
-                cl_data = clCreateBuffer(
-                        this->context,
-                        CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
-                        cl_data_size, //size in bytes * 2 because of float
-                        NULL,//buffer of data
-                        &err);
-                SAMPLE_CHECK_ERRORS(err);
-                if(err != CL_SUCCESS)
-                    return NULL;
-
-                if(!execute_half_to_float_conversion(cl_data, blob->get_gpu_data(), blob->get_size())) {
-                    clReleaseMemObject(cl_data);
-                    return NULL;
-                }
-            } else if(blob->get_precision() == PRECISION_32) {
-                cl_data = blob->get_gpu_data();
+            result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_CPU, PRECISION_32, NULL);
+            if(result->is_corrupted() || !CopyToHost(blob, result->get_cpu_data())) {
+                delete result;
+                return NULL;
             }
+        }
 
-            cl_command_queue current_queue = GetCurrentQueue();
+        return result;
+    }
 
-            float *data = (float *)clEnqueueMapBuffer(current_queue, \
-					cl_data, \
-					CL_TRUE, CL_MAP_READ, \
-					0, \
-					cl_data_size, \
-					0, NULL, NULL, &err);
+    //the read below is the point where the host waits for the commands producing blob
+    bool DM_Execution_Engine_GPU::CopyToHost(DM_Blob *blob, float *data) {
+        if(!this->has_working_gpu || blob->get_env() != ENVIRONMENT_GPU)
+            return false;
+        if(blob->get_precision() == PRECISION_16 && !this->support_fp16)
+            return false;
+
+        cl_int err = CL_SUCCESS;
+        cl_mem cl_data = blob->get_gpu_data();
+        int cl_data_size = blob->get_size() * sizeof(cl_float);
+        cl_event ready_event = blob->get_ready_event();
+        if(ready_event != NULL)
+            clRetainEvent(ready_event);
+
+        if(blob->get_precision() == PRECISION_16) {
+            if(ready_event != NULL)
+                clReleaseEvent(ready_event);
+            ready_event = NULL;
+
+            cl_data = clCreateBuffer(
+                    this->context,
+                    CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                    cl_data_size, //size in bytes * 2 because of float
+                    NULL,//buffer of data
+                    &err);
             SAMPLE_CHECK_ERRORS(err);
-            if(err != CL_SUCCESS) {
-                if(blob->get_precision() == PRECISION_16)
-                    clReleaseMemObject(cl_data);
-                return NULL;
+            if(err != CL_SUCCESS)
+                return false;
+
+            if(!execute_half_to_float_conversion(cl_data, blob, &ready_event)) {
+                clReleaseMemObject(cl_data);
+                return false;
             }
+        }
 
-            result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_CPU, PRECISION_32, data);
+        err = clEnqueueReadBuffer(GetCurrentQueue(), cl_data, CL_TRUE, 0, cl_data_size, data,
+                                  (ready_event != NULL) ? 1 : 0, (ready_event != NULL) ? &ready_event : NULL, NULL);
+        SAMPLE_CHECK_ERRORS(err);
+        if(ready_event != NULL)
+            clReleaseEvent(ready_event);
+        if(blob->get_precision() == PRECISION_16)
+            clReleaseMemObject(cl_data);
 
-            clEnqueueUnmapMemObject(current_queue, \
-					cl_data, \
-					data, \
-					0, NULL, NULL);
+        return err == CL_SUCCESS;
+    }
 
-            if(blob->get_precision() == PRECISION_16)
-                clReleaseMemObject(cl_data);
-        }
+    /*
+     * Zero-copy: the buffer uses the host memory directly if data is aligned on CL_DEVICE_MEM_BASE_ADDR_ALIGN
+     * (drivers copy misaligned host pointers), NULL in that case, data has to stay valid while the buffer is used
+     */
+    cl_mem DM_Execution_Engine_GPU::WrapHostMemory(float *data, size_t size_in_bytes) {
+        if(!Initialize() || data == NULL)
+            return NULL;
+        if(((uintptr_t)data) % std::max(this->mem_base_addr_align, (uint)sizeof(float)) != 0)
+            return NULL;
 
-        return result;
+        cl_int err = CL_SUCCESS;
+        cl_mem cl_data = clCreateBuffer(
+                this->context,
+                CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+                size_in_bytes,
+                data,
+                &err);
+        SAMPLE_CHECK_ERRORS_WITH_NULL_RETURN(err);
+
+        return cl_data;
+    }
+
+    float *DM_Execution_Engine_GPU::MapForWriting(DM_Blob *blob) {
+        if(!this->has_working_gpu || blob->get_env() != ENVIRONMENT_GPU || blob->get_precision() != PRECISION_32)
+            return NULL;
+
+        //the previous content is discarded, commands still writing the blob have to finish first
+        WaitForBlob(blob);
+        cl_int err = CL_SUCCESS;
+        float *data = (float *)clEnqueueMapBuffer(GetCurrentQueue(), \
+					blob->get_gpu_data(), \
+					CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, \
+					0, \
+					blob->get_size() * sizeof(cl_float), \
+					0, NULL, NULL, &err);
+        SAMPLE_CHECK_ERRORS_WITH_NULL_RETURN(err);
+
+        return data;
+    }
+
+    void DM_Execution_Engine_GPU::Unmap(DM_Blob *blob, float *data) {
+        cl_event event = NULL;
+        cl_int err = clEnqueueUnmapMemObject(GetCurrentQueue(), blob->get_gpu_data(), data, 0, NULL, &event);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS)
+            blob->set_corrupted(true);
+        else
+            blob->set_ready_event(event);
     }
 
     DM_Blob * DM_Execution_Engine_GPU::convert_to_gpu_fp32_blob(DM_Blob *blob) {
@@ -618,16 +898,18 @@ namespace deepmon {
 
             result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_GPU, PRECISION_32, NULL);
 
-            bool is_successful;
+            bool is_successful = false;
+            cl_event event = NULL;
             if(blob->get_precision() == PRECISION_32)
-                is_successful = execute_memcpy(PRECISION_32, result->get_gpu_data(), blob->get_gpu_data(), blob->get_size());
+                is_successful = execute_memcpy(PRECISION_32, result->get_gpu_data(), blob, &event);
             else if(blob->get_precision() == PRECISION_16)
-                is_successful = execute_half_to_float_conversion(result->get_gpu_data(), blob->get_gpu_data(), blob->get_size());
+                is_successful = execute_half_to_float_conversion(result->get_gpu_data(), blob, &event);
 
             if(!is_successful) {
                 delete result;
                 return NULL;
             }
+            result->set_ready_event(event);
         } else if(blob->get_env() == ENVIRONMENT_CPU) {
             result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_GPU, PRECISION_32, blob->get_cpu_data());
         }
@@ -644,16 +926,18 @@ namespace deepmon {
         if(blob->get_env() == ENVIRONMENT_GPU) {
             result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_GPU, PRECISION_16, NULL);
 
-            bool is_successful;
+            bool is_successful = false;
+            cl_event event = NULL;
             if(blob->get_precision() == PRECISION_16)
-                is_successful = execute_memcpy(PRECISION_16, result->get_gpu_data(), blob->get_gpu_data(), blob->get_size());
+                is_successful = execute_memcpy(PRECISION_16, result->get_gpu_data(), blob, &event);
             else if(blob->get_precision() == PRECISION_32)
-                is_successful = execute_float_to_half_conversion(result->get_gpu_data(), blob->get_gpu_data(), blob->get_size());
+                is_successful = execute_float_to_half_conversion(result->get_gpu_data(), blob, &event);
 
             if(!is_successful) {
                 delete result;
                 return NULL;
             }
+            result->set_ready_event(event);
         } else if(blob->get_env() == ENVIRONMENT_CPU) {
             result = new DM_Blob(blob->get_shapes(), ENVIRONMENT_GPU, PRECISION_16, blob->get_cpu_data());
         }
@@ -661,16 +945,10 @@ namespace deepmon {
         return result;
     }
 
-    bool DM_Execution_Engine_GPU::execute_memcpy(PRESICION_TYPE precision, cl_mem cl_output, cl_mem cl_input,
-                                                 int num_items) {
-        cl_command_queue current_queue = GetCurrentQueue();
+    //kernel(input, output) over the items of input, enqueued after the commands producing input
+    bool DM_Execution_Engine_GPU::execute_copy_kernel(cl_kernel kernel, cl_mem cl_output, DM_Blob *input, cl_event *event) {
         cl_int err = CL_SUCCESS;
-
-        cl_kernel kernel = NULL;
-        if(precision == PRECISION_32)
-            kernel = (this->kernels_map_fp32.find(std::string(KERNEL_MEMCPY)))->second->get_kernel();
-        else if(precision == PRECISION_16)
-            kernel = (this->kernels_map_fp16.find(std::string(KERNEL_MEMCPY)))->second->get_kernel();
+        cl_mem cl_input = input->get_gpu_data();
 
         err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &cl_input);
         err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &cl_output);
@@ -679,18 +957,18 @@ namespace deepmon {
             return false;
         }
 
-        size_t wgs[1] = {(size_t)num_items};
+        size_t wgs[1] = {(size_t)input->get_size()};
+        std::vector<cl_event> wait_list = GetWaitList(std::vector<DM_Blob *> {input});
 
         err = clEnqueueNDRangeKernel(
-                current_queue,
+                GetCurrentQueue(),
                 kernel,
                 1,
                 0,
                 wgs,
                 0,
-                0, 0, 0
+                wait_list.size(), wait_list.empty() ? NULL : wait_list.data(), event
         );
-        err |= clFinish(current_queue);
         SAMPLE_CHECK_ERRORS(err);
 
         if(err != CL_SUCCESS) {
@@ -700,77 +978,29 @@ namespace deepmon {
         return true;
     }
 
-    bool DM_Execution_Engine_GPU::execute_float_to_half_conversion(cl_mem cl_output, cl_mem cl_input,
-                                                                   int num_items) {
-        cl_command_queue current_queue = GetCurrentQueue();
-        cl_int err = CL_SUCCESS;
-
-        cl_kernel kernel = (this->kernels_map_fp16.find(std::string(KERNEL_CONVERT_FLOAT_TO_HALF)))->second->get_kernel();
-
-        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &cl_input);
-        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &cl_output);
-        SAMPLE_CHECK_ERRORS(err);
-        if(err != CL_SUCCESS) {
-            return false;
-        }
-
-        size_t wgs[1] = {(size_t)num_items};
-
-        err = clEnqueueNDRangeKernel(
-                current_queue,
-                kernel,
-                1,
-                0,
-                wgs,
-                0,
-                0, 0, 0
-        );
-        err |= clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
-
-        if(err != CL_SUCCESS) {
-            return false;
-        }
+    bool DM_Execution_Engine_GPU::execute_memcpy(PRESICION_TYPE precision, cl_mem cl_output, DM_Blob *input, cl_event *event) {
+        cl_kernel kernel = NULL;
+        if(precision == PRECISION_32)
+            kernel = GetKernel(PRECISION_32, KERNEL_MEMCPY);
+        else if(precision == PRECISION_16)
+            kernel = GetKernel(PRECISION_16, KERNEL_MEMCPY);
 
-        return true;
+        return execute_copy_kernel(kernel, cl_output, input, event);
     }
 
-    bool DM_Execution_Engine_GPU::execute_half_to_float_conversion(cl_mem cl_output, cl_mem cl_input,
-                                                                   int num_items) {
-        cl_command_queue current_queue = GetCurrentQueue();
-        cl_int err = CL_SUCCESS;
-
-        cl_kernel kernel = (this->kernels_map_fp16.find(std::string(KERNEL_CONVERT_HALF_TO_FLOAT)))->second->get_kernel();
-
-        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &cl_input);
-        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &cl_output);
-        SAMPLE_CHECK_ERRORS(err);
-        if(err != CL_SUCCESS) {
-            return false;
-        }
-
-        size_t wgs[1] = {(size_t)num_items};
-
-        err = clEnqueueNDRangeKernel(
-                current_queue,
-                kernel,
-                1,
-                0,
-                wgs,
-                0,
-                0, 0, 0
-        );
-        err |= clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
-
-        if(err != CL_SUCCESS) {
-            return false;
-        }
+    bool DM_Execution_Engine_GPU::execute_float_to_half_conversion(cl_mem cl_output, DM_Blob *input, cl_event *event) {
+        cl_kernel kernel = GetKernel(PRECISION_16, KERNEL_CONVERT_FLOAT_TO_HALF);
+        return execute_copy_kernel(kernel, cl_output, input, event);
+    }
 
-        return true;
+    bool DM_Execution_Engine_GPU::execute_half_to_float_conversion(cl_mem cl_output, DM_Blob *input, cl_event *event) {
+        cl_kernel kernel = GetKernel(PRECISION_16, KERNEL_CONVERT_HALF_TO_FLOAT);
+        return execute_copy_kernel(kernel, cl_output, input, event);
     }
 
     void DM_Execution_Engine_GPU::AllocateMemory(DM_Blob *blob, float *initialized_data) {
+        //the first gpu blob brings the device up
+        Initialize();
         if(blob->get_env() == this->evn) {
             int size_in_bytes = 0;
             if(blob->get_precision() == PRECISION_32 && this->has_working_gpu) {
@@ -783,21 +1013,26 @@ namespace deepmon {
             }
             blob->set_mem_size(size_in_bytes);
 
-            cl_int err = CL_SUCCESS;
-            cl_mem cl_data = clCreateBuffer(
-                    this->context,
-                    CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
-                    size_in_bytes, //size in bytes
-                    NULL,//buffer of data
-                    &err);
-            SAMPLE_CHECK_ERRORS(err);
-            if(err != CL_SUCCESS) {
-                blob->set_corrupted(true);
-                return;
+            size_t size_class = DM_Memory_Pool<cl_mem>::GetSizeClass(size_in_bytes);
+            cl_mem cl_data = NULL;
+            if(!this->memory_pool->Acquire(size_class, blob->get_precision(), &cl_data)) {
+                cl_int err = CL_SUCCESS;
+                cl_data = clCreateBuffer(
+                        this->context,
+                        CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                        size_class, //size in bytes
+                        NULL,//buffer of data
+                        &err);
+                SAMPLE_CHECK_ERRORS(err);
+                if(err != CL_SUCCESS) {
+                    blob->set_corrupted(true);
+                    return;
+                }
             }
 
             if(initialized_data != NULL) {
                 if(!read_data_from_host(cl_data, initialized_data, size_in_bytes, blob->get_precision())) {
+                    this->memory_pool->Release(cl_data, size_class, blob->get_precision());
                     blob->set_corrupted(true);
                     return;
                 }
@@ -808,6 +1043,75 @@ namespace deepmon {
             blob->set_corrupted(true);
     }
 
+    void DM_Execution_Engine_GPU::ReleaseMemory(DM_Blob *blob) {
+        cl_mem cl_data = blob->get_gpu_data();
+        if(cl_data == NULL)
+            return;
+
+        size_t size_class = DM_Memory_Pool<cl_mem>::GetSizeClass(blob->get_mem_size());
+        blob->set_gpu_data(NULL);
+        {
+            std::lock_guard<std::mutex> lock(this->scheduler_mutex);
+            //commands on other queues may still use the buffer
+            if(this->is_forked) {
+                DM_Deferred_Buffer deferred = {cl_data, size_class, blob->get_precision()};
+                this->deferred_buffers.push_back(deferred);
+                return;
+            }
+        }
+        this->memory_pool->Release(cl_data, size_class, blob->get_precision());
+    }
+
+    DM_Memory_Pool_Stats DM_Execution_Engine_GPU::GetMemoryPoolStats() {
+        return this->memory_pool->GetStats();
+    }
+
+    void DM_Execution_Engine_GPU::TrimMemoryPool(size_t keep_bytes) {
+        this->memory_pool->Trim(keep_bytes);
+    }
+
+    void DM_Execution_Engine_GPU::SetMemoryPoolLimit(size_t max_bytes_held) {
+        this->memory_pool->SetMaxBytesHeld(max_bytes_held);
+    }
+
+    cl_mem DM_Execution_Engine_GPU::AllocateArena(size_t size_in_bytes) {
+        if(!Initialize())
+            return NULL;
+
+        cl_int err = CL_SUCCESS;
+        cl_mem arena = clCreateBuffer(
+                this->context,
+                CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                size_in_bytes,
+                NULL,
+                &err);
+        SAMPLE_CHECK_ERRORS_WITH_NULL_RETURN(err);
+
+        return arena;
+    }
+
+    void DM_Execution_Engine_GPU::ReleaseArena(cl_mem arena) {
+        if(arena != NULL)
+            clReleaseMemObject(arena);
+    }
+
+    cl_mem DM_Execution_Engine_GPU::CreateSubBuffer(cl_mem arena, size_t offset, size_t size_in_bytes) {
+        if(arena == NULL)
+            return NULL;
+
+        cl_int err = CL_SUCCESS;
+        cl_buffer_region region = {offset, size_in_bytes};
+        cl_mem sub_buffer = clCreateSubBuffer(
+                arena,
+                CL_MEM_READ_WRITE,
+                CL_BUFFER_CREATE_TYPE_REGION,
+                &region,
+                &err);
+        SAMPLE_CHECK_ERRORS_WITH_NULL_RETURN(err);
+
+        return sub_buffer;
+    }
+
     DM_Blob * DM_Execution_Engine_GPU::blob_convert_to_cpu_blob(DM_Blob *blob) {
         return convert_to_cpu_blob(blob);
     }
@@ -831,14 +1135,12 @@ namespace deepmon {
                                                 uint32_t output_h, uint32_t output_w,
                                                 DM_Blob *im2col_output, uint32_t im2col_offset) {
         cl_int err = CL_SUCCESS;
-        cl_command_queue current_queue = GetCurrentQueue();
 
         cl_mem cl_input = input->get_gpu_data();
         cl_mem cl_output = im2col_output->get_gpu_data();
 
         if(mem_layout == MEMORY_LAYOUT_CAFFE) {
-            cl_kernel kernel = (precision == PRECISION_32) ? kernels_map_fp32.find(KERNEL_CAFFE_IM2COL)->second->get_kernel() :
-                               kernels_map_fp16.find(KERNEL_CAFFE_IM2COL)->second->get_kernel();
+            cl_kernel kernel = GetKernel(precision, KERNEL_CAFFE_IM2COL);
 
             uint32_t num_kernels = output_h * output_w * input->get_shape_at(CAFFE_BLOB_INOUT_CHANNELS_IDX);
 
@@ -868,18 +1170,7 @@ namespace deepmon {
 
             size_t wgs[1] = {(size_t)(output_h * output_w)};
 
-            err = clEnqueueNDRangeKernel(
-                    current_queue,
-                    kernel,
-                    1,
-                    0,
-                    wgs,
-                    0,
-                    0, 0, 0
-            );
-            err |= clFinish(current_queue);
-            SAMPLE_CHECK_ERRORS(err);
-
+            err = EnqueueKernel(kernel, 1, wgs, NULL, std::vector<DM_Blob *> {input}, im2col_output);
             if(err != CL_SUCCESS) {
                 im2col_output->set_corrupted(true);
                 return;
@@ -891,4 +1182,127 @@ namespace deepmon {
              */
         }
     }
+
+    void DM_Execution_Engine_GPU::ExecuteBiasActivation(PRESICION_TYPE precision, DM_Blob *data,
+                                                        uint32_t channels, uint32_t inner,
+                                                        DM_Blob *biases, int activation_type, float activation_threshold) {
+        if(biases == NULL && activation_type == ACTIVATION_NONE)
+            return;
+
+        cl_int err = CL_SUCCESS;
+        cl_kernel kernel = GetKernel(precision, KERNEL_BIAS_ACTIVATE);
+
+        cl_mem cl_data = data->get_gpu_data();
+        //the kernel never reads biases if has_bias = 0, any valid buffer will do
+        cl_mem cl_biases = (biases != NULL) ? biases->get_gpu_data() : cl_data;
+        int n = data->get_total_size();
+        int has_bias = (biases != NULL) ? 1 : 0;
+
+        int i = 0;
+        err  = clSetKernelArg(kernel, i++, sizeof(cl_int), &n);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_data);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &channels);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &inner);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &has_bias);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_biases);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &activation_type);
+        if(precision == PRECISION_32) {
+            cl_float negative_slope = activation_threshold;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &negative_slope);
+        } else {
+            half negative_slope = FloatToHalf(activation_threshold);
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &negative_slope);
+        }
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS) {
+            data->set_corrupted(true);
+            return;
+        }
+
+        size_t wgs[1] = {(size_t)n};
+
+        err = EnqueueKernel(kernel, 1, wgs, NULL, std::vector<DM_Blob *> {biases}, data);
+        if(err != CL_SUCCESS) {
+            data->set_corrupted(true);
+            return;
+        }
+    }
+
+    void DM_Execution_Engine_GPU::ExecuteBiasActivationMaxPool2x2(PRESICION_TYPE precision, MEMORY_LAYOUT mem_layout,
+                                                                  DM_Blob *input, uint32_t channels, uint32_t input_h, uint32_t input_w,
+                                                                  DM_Blob *output, uint32_t output_h, uint32_t output_w,
+                                                                  DM_Blob *biases, int activation_type, float activation_threshold) {
+        cl_int err = CL_SUCCESS;
+        cl_kernel kernel = GetKernel(precision, KERNEL_BIAS_ACTIVATE_MAXPOOL);
+
+        cl_mem cl_input = input->get_gpu_data();
+        cl_mem cl_output = output->get_gpu_data();
+        //the kernel never reads biases if has_bias = 0, any valid buffer will do
+        cl_mem cl_biases = (biases != NULL) ? biases->get_gpu_data() : cl_input;
+        int n = output->get_total_size();
+        int is_dm_layout = (mem_layout == MEMORY_LAYOUT_DM) ? 1 : 0;
+        int has_bias = (biases != NULL) ? 1 : 0;
+
+        int i = 0;
+        err  = clSetKernelArg(kernel, i++, sizeof(cl_int), &n);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_input);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &channels);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &input_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &input_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_output);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &is_dm_layout);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &has_bias);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_biases);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &activation_type);
+        if(precision == PRECISION_32) {
+            cl_float negative_slope = activation_threshold;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &negative_slope);
+        } else {
+            half negative_slope = FloatToHalf(activation_threshold);
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &negative_slope);
+        }
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS) {
+            output->set_corrupted(true);
+            return;
+        }
+
+        size_t wgs[1] = {(size_t)n};
+
+        err = EnqueueKernel(kernel, 1, wgs, NULL, std::vector<DM_Blob *> {input, biases}, output);
+        if(err != CL_SUCCESS) {
+            output->set_corrupted(true);
+            return;
+        }
+    }
+
+    void DM_Execution_Engine_GPU::WriteColumns(DM_Blob *data, uint32_t rows, uint32_t columns,
+                                               uint32_t first_column, uint32_t num_columns, float *host_data) {
+        if(data->get_precision() != PRECISION_32 || first_column + num_columns > columns) {
+            LOGE("Cannot write columns [%d, %d) of a [%d x %d] blob", first_column, first_column + num_columns, rows, columns);
+            data->set_corrupted(true);
+            return;
+        }
+
+        //one rectangle: rows of num_columns floats, the rows of the blob are columns floats apart
+        size_t buffer_origin[3] = {first_column * sizeof(float), 0, 0};
+        size_t host_origin[3] = {0, 0, 0};
+        size_t region[3] = {num_columns * sizeof(float), rows, 1};
+
+        //blocking, host_data belongs to the caller
+        std::vector<cl_event> wait_list = GetWaitList(std::vector<DM_Blob *> {data});
+        cl_int err = clEnqueueWriteBufferRect(GetCurrentQueue(), data->get_gpu_data(), CL_TRUE,
+                                              buffer_origin, host_origin, region,
+                                              columns * sizeof(float), 0,
+                                              num_columns * sizeof(float), 0,
+                                              host_data, wait_list.size(), wait_list.empty() ? NULL : wait_list.data(), NULL);
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(err != CL_SUCCESS) {
+            data->set_corrupted(true);
+            return;
+        }
+    }
 }
\ No newline at end of file
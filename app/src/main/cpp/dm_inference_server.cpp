@@ -0,0 +1,157 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_inference_server.hpp>
+#include <dm_log.hpp>
+#include <cstring>
+#include <algorithm>
+
+namespace deepmon {
+    DM_Inference_Server::DM_Inference_Server(DM_Net *net, uint32_t max_batch_size, uint32_t max_wait_us) {
+        this->net = net;
+        this->max_batch_size = std::max(max_batch_size, (uint32_t)1);
+        this->max_wait = std::chrono::microseconds(max_wait_us);
+        this->dispatcher = std::thread(&DM_Inference_Server::dispatcher_loop, this);
+    }
+
+    DM_Inference_Server::~DM_Inference_Server() {
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            this->stopped = true;
+        }
+        requests_cond.notify_all();
+        this->dispatcher.join();
+
+        while(!pending_requests.empty()) {
+            DM_Inference_Request *request = pending_requests.front();
+            pending_requests.pop_front();
+            delete request->input;
+            request->result.set_value(NULL);
+            delete request;
+        }
+    }
+
+    std::future<DM_Blob *> DM_Inference_Server::Submit(DM_Blob *input) {
+        DM_Inference_Request *request = new DM_Inference_Request();
+        request->input = input;
+        request->submit_time = std::chrono::steady_clock::now();
+        std::future<DM_Blob *> result = request->result.get_future();
+
+        bool is_stopped = false;
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            is_stopped = this->stopped;
+            if(!is_stopped)
+                pending_requests.push_back(request);
+        }
+
+        if(is_stopped) {
+            delete request->input;
+            request->result.set_value(NULL);
+            delete request;
+        } else
+            requests_cond.notify_one();
+
+        return result;
+    }
+
+    void DM_Inference_Server::dispatcher_loop() {
+        while(true) {
+            std::vector<DM_Inference_Request *> batch;
+            {
+                std::unique_lock<std::mutex> lock(requests_mutex);
+                requests_cond.wait(lock, [this] { return this->stopped || !this->pending_requests.empty(); });
+                if(this->stopped)
+                    return;
+
+                //the oldest request bounds the time spent waiting for a full batch
+                DM_Time_Point deadline = pending_requests.front()->submit_time + this->max_wait;
+                requests_cond.wait_until(lock, deadline, [this] {
+                    return this->stopped || this->pending_requests.size() >= this->max_batch_size;
+                });
+                if(this->stopped)
+                    return;
+
+                while(!pending_requests.empty() && batch.size() < this->max_batch_size) {
+                    batch.push_back(pending_requests.front());
+                    pending_requests.pop_front();
+                }
+            }
+
+            run_batch(batch);
+        }
+    }
+
+    void DM_Inference_Server::run_batch(std::vector<DM_Inference_Request *> &batch) {
+        uint32_t batch_size = batch.size();
+        vector<uint32_t> input_shapes = net->GetInputShapes(batch_size);
+        uint32_t input_size = 1;
+        for(int i = 1 ; i < input_shapes.size() ; i++)
+            input_size *= input_shapes.at(i);
+
+        //frames are stacked into one cpu blob, a frame of a wrong size fails alone
+        DM_Blob *input = new DM_Blob(input_shapes, ENVIRONMENT_CPU, PRECISION_32, NULL);
+        vector<bool> is_valid(batch_size, true);
+        for(uint32_t i = 0 ; i < batch_size ; i++) {
+            DM_Blob *frame = batch.at(i)->input;
+            if(frame->get_env() != ENVIRONMENT_CPU || frame->get_precision() != PRECISION_32 ||
+               frame->get_size() != input_size) {
+                LOGE("Inference server: frame does not match the input of the network");
+                memset(input->get_cpu_data() + i * input_size, 0, input_size * sizeof(float));
+                is_valid[i] = false;
+            } else
+                memcpy(input->get_cpu_data() + i * input_size, frame->get_cpu_data(), input_size * sizeof(float));
+            delete frame;
+        }
+
+        DM_Time_Point start = std::chrono::steady_clock::now();
+        DM_Blob *result = net->Forward(input);
+        DM_Time_Point end = std::chrono::steady_clock::now();
+        forward_histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        uint32_t output_size = net->GetOutputSize();
+        for(uint32_t i = 0 ; i < batch_size ; i++) {
+            DM_Inference_Request *request = batch.at(i);
+            DM_Blob *output = NULL;
+            if(result != NULL && is_valid[i])
+                output = new DM_Blob(net->GetOutputShapes(), ENVIRONMENT_CPU, PRECISION_32, result->get_cpu_data() + i * output_size);
+
+            latency_histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - request->submit_time).count());
+            request->result.set_value(output);
+            delete request;
+        }
+
+        if(result != NULL)
+            delete result;
+
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        this->num_batches++;
+        this->num_batched_requests += batch_size;
+    }
+
+    double DM_Inference_Server::GetMeanBatchSize() {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        return (num_batches > 0) ? (double)num_batched_requests / num_batches : 0;
+    }
+}
@@ -0,0 +1,100 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_kernel_tuner.hpp>
+#include <dm_log.hpp>
+#include <json/json.h>
+#include <fstream>
+
+namespace deepmon {
+    void DM_Kernel_Tuner::Open(std::string path, std::string device_signature) {
+        std::lock_guard<std::mutex> lock(this->tuner_mutex);
+        this->path = path;
+        this->device_signature = device_signature;
+        this->tuned_params.clear();
+        this->is_modified = false;
+        if(path.empty())
+            return;
+
+        std::ifstream in(path.c_str());
+        if(!in.is_open())
+            return;
+
+        Json::Value db;
+        Json::Reader reader;
+        if(!reader.parse(in, db) || db["DEVICE"].asString() != device_signature) {
+            LOGD("Tuning database %s is outdated", path.c_str());
+            return;
+        }
+
+        Json::Value kernels = db["KERNELS"];
+        for(Json::Value::iterator it = kernels.begin() ; it != kernels.end() ; ++it) {
+            DM_Launch_Params params;
+            params.vector_width = (*it)["VWM"].asUInt();
+            for(Json::Value::iterator ls_it = (*it)["LOCAL"].begin() ; ls_it != (*it)["LOCAL"].end() ; ++ls_it)
+                params.local_size.push_back((*ls_it).asUInt());
+            this->tuned_params[it.key().asString()] = params;
+        }
+        LOGD("Tuning database %s: %d launches", path.c_str(), (int)this->tuned_params.size());
+    }
+
+    bool DM_Kernel_Tuner::Find(std::string key, DM_Launch_Params *params) {
+        std::lock_guard<std::mutex> lock(this->tuner_mutex);
+        std::map<std::string, DM_Launch_Params>::iterator it = this->tuned_params.find(key);
+        if(it == this->tuned_params.end())
+            return false;
+        *params = it->second;
+        return true;
+    }
+
+    void DM_Kernel_Tuner::Store(std::string key, DM_Launch_Params params) {
+        std::lock_guard<std::mutex> lock(this->tuner_mutex);
+        this->tuned_params[key] = params;
+        this->is_modified = true;
+    }
+
+    void DM_Kernel_Tuner::Save() {
+        std::lock_guard<std::mutex> lock(this->tuner_mutex);
+        if(this->path.empty() || !this->is_modified)
+            return;
+
+        Json::Value db;
+        db["DEVICE"] = this->device_signature;
+        for(std::map<std::string, DM_Launch_Params>::iterator it = this->tuned_params.begin() ; it != this->tuned_params.end() ; it++) {
+            Json::Value launch;
+            launch["VWM"] = it->second.vector_width;
+            launch["LOCAL"] = Json::Value(Json::arrayValue);
+            for(int i = 0 ; i < it->second.local_size.size() ; i++)
+                launch["LOCAL"].append((Json::UInt)it->second.local_size.at(i));
+            db["KERNELS"][it->first] = launch;
+        }
+
+        std::ofstream out(this->path.c_str());
+        if(!out.is_open()) {
+            LOGE("Cannot write tuning database %s", this->path.c_str());
+            return;
+        }
+        out << db;
+        this->is_modified = false;
+    }
+}
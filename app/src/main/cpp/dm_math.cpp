@@ -0,0 +1,203 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_math.hpp>
+#include <dm_simd.hpp>
+#include <dm_common.hpp>
+#include <float.h>
+#include <string.h>
+
+namespace deepmon {
+    //cephes expf: exp(x) = 2^n * exp(r) with r in [-ln2/2, ln2/2]
+    //inputs are clamped so that 2^n stays a normal float
+#define EXP_HI          88.0f
+#define EXP_LO          -87.0f
+#define EXP_LOG2E       1.44269504088896341f
+#define EXP_C1          0.693359375f
+#define EXP_C2          -2.12194440e-4f
+#define EXP_P0          1.9875691500E-4f
+#define EXP_P1          1.3981999507E-3f
+#define EXP_P2          8.3334519073E-3f
+#define EXP_P3          4.1665795894E-2f
+#define EXP_P4          1.6666665459E-1f
+#define EXP_P5          5.0000001201E-1f
+
+    static inline dm_simd_f dm_simd_exp(dm_simd_f x) {
+        x = dm_simd_min(dm_simd_max(x, dm_simd_set1(EXP_LO)), dm_simd_set1(EXP_HI));
+
+        dm_simd_f n = dm_simd_floor(dm_simd_add(dm_simd_mul(x, dm_simd_set1(EXP_LOG2E)), dm_simd_set1(0.5f)));
+        x = dm_simd_sub(x, dm_simd_mul(n, dm_simd_set1(EXP_C1)));
+        x = dm_simd_sub(x, dm_simd_mul(n, dm_simd_set1(EXP_C2)));
+
+        dm_simd_f y = dm_simd_set1(EXP_P0);
+        y = dm_simd_add(dm_simd_mul(y, x), dm_simd_set1(EXP_P1));
+        y = dm_simd_add(dm_simd_mul(y, x), dm_simd_set1(EXP_P2));
+        y = dm_simd_add(dm_simd_mul(y, x), dm_simd_set1(EXP_P3));
+        y = dm_simd_add(dm_simd_mul(y, x), dm_simd_set1(EXP_P4));
+        y = dm_simd_add(dm_simd_mul(y, x), dm_simd_set1(EXP_P5));
+        y = dm_simd_add(dm_simd_mul(dm_simd_mul(y, x), x), dm_simd_add(x, dm_simd_set1(1.0f)));
+
+        return dm_simd_mul(y, dm_simd_pow2(n));
+    }
+
+    static inline dm_simd_f dm_simd_sigmoid(dm_simd_f x) {
+        dm_simd_f one = dm_simd_set1(1.0f);
+        return dm_simd_div(one, dm_simd_add(one, dm_simd_exp(dm_simd_sub(dm_simd_set1(0), x))));
+    }
+
+    //tanh(x) = 2 * sigmoid(2x) - 1
+    static inline dm_simd_f dm_simd_tanh(dm_simd_f x) {
+        dm_simd_f s = dm_simd_sigmoid(dm_simd_add(x, x));
+        return dm_simd_sub(dm_simd_add(s, s), dm_simd_set1(1.0f));
+    }
+
+    //scalar tails use the same approximation as the vector part
+    static inline float dm_exp_scalar(float x) {
+        x = x < EXP_LO ? EXP_LO : (x > EXP_HI ? EXP_HI : x);
+
+        float n = (float)((int)(x * EXP_LOG2E + 0.5f + 128.0f)) - 128.0f;
+        x = x - n * EXP_C1 - n * EXP_C2;
+
+        float y = ((((EXP_P0 * x + EXP_P1) * x + EXP_P2) * x + EXP_P3) * x + EXP_P4) * x + EXP_P5;
+        y = y * x * x + x + 1.0f;
+
+        int bits = ((int)n + 127) << 23;
+        float pow2;
+        memcpy(&pow2, &bits, sizeof(float));
+        return y * pow2;
+    }
+
+    static inline float dm_sigmoid_scalar(float x) {
+        return 1.0f / (1.0f + dm_exp_scalar(-x));
+    }
+
+    void dm_relu(const float *in, float *out, uint32_t n) {
+        dm_simd_f zero = dm_simd_set1(0);
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH)
+            dm_simd_store(out + i, dm_simd_max(dm_simd_load(in + i), zero));
+        for(; i < n ; i++)
+            out[i] = in[i] > 0 ? in[i] : 0;
+    }
+
+    //max(x, 0) + slope * min(x, 0) needs no select
+    void dm_leaky_relu(const float *in, float *out, uint32_t n, float negative_slope) {
+        dm_simd_f zero = dm_simd_set1(0);
+        dm_simd_f slope = dm_simd_set1(negative_slope);
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH) {
+            dm_simd_f x = dm_simd_load(in + i);
+            dm_simd_store(out + i, dm_simd_add(dm_simd_max(x, zero), dm_simd_mul(dm_simd_min(x, zero), slope)));
+        }
+        for(; i < n ; i++)
+            out[i] = in[i] > 0 ? in[i] : in[i] * negative_slope;
+    }
+
+    void dm_exp(const float *in, float *out, uint32_t n) {
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH)
+            dm_simd_store(out + i, dm_simd_exp(dm_simd_load(in + i)));
+        for(; i < n ; i++)
+            out[i] = dm_exp_scalar(in[i]);
+    }
+
+    void dm_sigmoid(const float *in, float *out, uint32_t n) {
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH)
+            dm_simd_store(out + i, dm_simd_sigmoid(dm_simd_load(in + i)));
+        for(; i < n ; i++)
+            out[i] = dm_sigmoid_scalar(in[i]);
+    }
+
+    void dm_tanh(const float *in, float *out, uint32_t n) {
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH)
+            dm_simd_store(out + i, dm_simd_tanh(dm_simd_load(in + i)));
+        for(; i < n ; i++)
+            out[i] = 2.0f * dm_sigmoid_scalar(2.0f * in[i]) - 1.0f;
+    }
+
+    void dm_activate(const float *in, float *out, uint32_t n, int activation_type, float negative_slope) {
+        switch(activation_type) {
+            case ACTIVATION_RELU:
+                dm_relu(in, out, n);
+                break;
+            case ACTIVATION_LEAKY:
+                dm_leaky_relu(in, out, n, negative_slope);
+                break;
+            case ACTIVATION_SIGMOID:
+                dm_sigmoid(in, out, n);
+                break;
+            case ACTIVATION_TANH:
+                dm_tanh(in, out, n);
+                break;
+            default:
+                if(in != out)
+                    memcpy(out, in, n * sizeof(float));
+                break;
+        }
+    }
+
+    /*
+     * Online softmax: every lane keeps a running max m and sum s of exp(x - m),
+     * s is rescaled by exp(m_old - m_new) whenever the max grows. Lanes are merged at the end
+     */
+    void dm_softmax(const float *in, float *out, uint32_t n) {
+        float lane_max[DM_SIMD_WIDTH];
+        float lane_sum[DM_SIMD_WIDTH];
+
+        dm_simd_f vmax = dm_simd_set1(-FLT_MAX);
+        dm_simd_f vsum = dm_simd_set1(0);
+        uint32_t i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH) {
+            dm_simd_f x = dm_simd_load(in + i);
+            dm_simd_f new_max = dm_simd_max(vmax, x);
+            vsum = dm_simd_add(dm_simd_mul(vsum, dm_simd_exp(dm_simd_sub(vmax, new_max))),
+                               dm_simd_exp(dm_simd_sub(x, new_max)));
+            vmax = new_max;
+        }
+        dm_simd_store(lane_max, vmax);
+        dm_simd_store(lane_sum, vsum);
+
+        float max_value = -FLT_MAX;
+        for(int l = 0 ; l < DM_SIMD_WIDTH ; l++)
+            max_value = lane_max[l] > max_value ? lane_max[l] : max_value;
+        for(uint32_t j = i ; j < n ; j++)
+            max_value = in[j] > max_value ? in[j] : max_value;
+
+        float sum = 0;
+        for(int l = 0 ; l < DM_SIMD_WIDTH ; l++)
+            sum += lane_sum[l] * dm_exp_scalar(lane_max[l] - max_value);
+        for(uint32_t j = i ; j < n ; j++)
+            sum += dm_exp_scalar(in[j] - max_value);
+
+        float scale = 1.0f / sum;
+        dm_simd_f vscale = dm_simd_set1(scale);
+        dm_simd_f vmax_value = dm_simd_set1(max_value);
+        i = 0;
+        for(; i + DM_SIMD_WIDTH <= n ; i += DM_SIMD_WIDTH)
+            dm_simd_store(out + i, dm_simd_mul(dm_simd_exp(dm_simd_sub(dm_simd_load(in + i), vmax_value)), vscale));
+        for(; i < n ; i++)
+            out[i] = dm_exp_scalar(in[i] - max_value) * scale;
+    }
+}
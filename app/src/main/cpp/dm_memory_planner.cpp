@@ -0,0 +1,88 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <dm_memory_planner.hpp>
+
+namespace deepmon {
+    int DM_Memory_Planner::AddTensor(size_t size, int first_use, int last_use) {
+        DM_Planned_Tensor tensor;
+        tensor.size = size;
+        tensor.first_use = first_use;
+        tensor.last_use = last_use;
+        tensor.offset = 0;
+
+        this->tensors.push_back(tensor);
+        this->total_size += size;
+        this->planned = false;
+
+        return this->tensors.size() - 1;
+    }
+
+    void DM_Memory_Planner::Plan(size_t alignment) {
+        if(alignment == 0)
+            alignment = 1;
+
+        //place the biggest tensors first, they are the hardest ones to fit into gaps
+        std::vector<int> order;
+        for(int i = 0 ; i < tensors.size() ; i++)
+            order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return tensors.at(a).size > tensors.at(b).size;
+        });
+
+        this->arena_size = 0;
+        std::vector<int> placed;
+        for(int i = 0 ; i < order.size() ; i++) {
+            DM_Planned_Tensor &tensor = tensors.at(order.at(i));
+
+            //collect already placed tensors which are alive at the same time
+            std::vector<int> conflicts;
+            for(int j = 0 ; j < placed.size() ; j++) {
+                DM_Planned_Tensor &other = tensors.at(placed.at(j));
+                if(other.first_use <= tensor.last_use && tensor.first_use <= other.last_use)
+                    conflicts.push_back(placed.at(j));
+            }
+            std::sort(conflicts.begin(), conflicts.end(), [this](int a, int b) {
+                return tensors.at(a).offset < tensors.at(b).offset;
+            });
+
+            //take the first gap which is big enough
+            size_t offset = 0;
+            for(int j = 0 ; j < conflicts.size() ; j++) {
+                DM_Planned_Tensor &other = tensors.at(conflicts.at(j));
+                if(offset + tensor.size <= other.offset)
+                    break;
+                size_t end = other.offset + other.size;
+                end = (end + alignment - 1) / alignment * alignment;
+                offset = std::max(offset, end);
+            }
+
+            tensor.offset = offset;
+            this->arena_size = std::max(this->arena_size, offset + tensor.size);
+            placed.push_back(order.at(i));
+        }
+
+        this->planned = true;
+    }
+}
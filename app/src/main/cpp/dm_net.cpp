@@ -32,7 +32,10 @@
 #include <layers/dm_layer_fc.hpp>
 #include <layers/dm_layer_relu.hpp>
 #include <layers/dm_layer_activation.hpp>
+#include <dm_memory_planner.hpp>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 using namespace std;
 using namespace deepmon;
@@ -44,25 +47,15 @@ namespace deepmon {
             return;
         }
 
+        if(net_param->GetNumThreads() > 0)
+            DeepMon::Get().GetCpuExecutionEngine().SetNumThreads(net_param->GetNumThreads());
+
         for(int i = 0 ; i < net_param->GetLayerNames().size() ; i++) {
             string layer_name = net_param->GetLayerNames().at(i);
             DM_Layer_Param param = net_param->GetLayerParam(layer_name);
             LOGD("Parsing layer %s", layer_name.c_str());
-            DM_Layer *layer = NULL;
-
-            if(!param.GetType().compare(LAYER_NAME_DATA)) {
-                layer = new DM_Layer_Data(param);
-            } else if(!param.GetType().compare(LAYER_NAME_CONV)) {
-                layer = new DM_Layer_Conv(param);
-            } else if(!param.GetType().compare(LAYER_NAME_POOLING)) {
-                layer = new DM_Layer_Pooling(param);
-            } else if(!param.GetType().compare(LAYER_NAME_FULLY_CONNECTED)) {
-                layer = new DM_Layer_Fc(param);
-            } else if(!param.GetType().compare(LAYER_NAME_SOFTMAX)) {
-                layer = new DM_Layer_Softmax(param);
-            } else if(!param.GetType().compare(LAYER_NAME_ACTIVATION)) {
-                layer = new DM_Layer_Activation(param);
-            }
+            DM_Layer *layer = create_layer(param);
+            layer->SetSpecializingKernels(net_param->IsSpecializingKernels());
             layers.push_back(layer);
 
             pair<string, DM_Layer *> pair(layer_name, layer);
@@ -158,27 +151,456 @@ namespace deepmon {
             }
         }
 
+        //placement has to be known before layers are fused and weights are loaded
+        if(net_param->IsAutoPlacing())
+            place_layers(net_param);
+
+        if(net_param->IsFusingLayers())
+            fuse_layers();
+
         //load weights - implement later
         for(int i = 0 ; i < pipeline.size() ; i++) {
             pipeline.at(i)->LoadWeights();
         }
+
+        //the memory plan depends on the layers running in parallel
+        if(net_param->IsUsingMultipleQueues())
+            schedule_queues();
+
+        this->is_planning_memory = net_param->IsPlanningMemory();
+        if(this->is_planning_memory)
+            plan_memory(1);
+
+        if(net_param->IsTuningKernels())
+            tune_kernels();
     }
 
-    DM_Blob * DM_Net::Forward(DM_Blob *input_blob) {
+    DM_Layer *DM_Net::create_layer(DM_Layer_Param &param) {
+        DM_Layer *layer = NULL;
+
+        if(!param.GetType().compare(LAYER_NAME_DATA)) {
+            layer = new DM_Layer_Data(param);
+        } else if(!param.GetType().compare(LAYER_NAME_CONV)) {
+            layer = new DM_Layer_Conv(param);
+        } else if(!param.GetType().compare(LAYER_NAME_POOLING)) {
+            layer = new DM_Layer_Pooling(param);
+        } else if(!param.GetType().compare(LAYER_NAME_FULLY_CONNECTED)) {
+            layer = new DM_Layer_Fc(param);
+        } else if(!param.GetType().compare(LAYER_NAME_SOFTMAX)) {
+            layer = new DM_Layer_Softmax(param);
+        } else if(!param.GetType().compare(LAYER_NAME_ACTIVATION)) {
+            layer = new DM_Layer_Activation(param);
+        }
+        if(layer != NULL)
+            layer->SetFusionAllowed(param.IsFusionAllowed());
+
+        return layer;
+    }
+
+    /*
+     * Returns the only top layer of layer if both of them can be merged into one layer:
+     * no other consumer of layer's output, same environment and precision, nobody opted out
+     */
+    DM_Layer *DM_Net::get_fusable_top_layer(DM_Layer *layer) {
+        if(!layer->IsFusionAllowed() || layer->GetTopLayersNames().size() != 1)
+            return NULL;
+
+        DM_Layer *top_layer = name_to_layer_map.find(layer->GetTopLayersNames().at(0))->second;
+        if(!top_layer->IsFusionAllowed() || top_layer->GetBottomLayersNames().size() != 1)
+            return NULL;
+
+        if(top_layer->GetEnvironment() != layer->GetEnvironment() || top_layer->GetPrecision() != layer->GetPrecision())
+            return NULL;
+
+        return top_layer;
+    }
+
+    //layer takes over the work of top_layer and its consumers
+    void DM_Net::merge_top_into_layer(DM_Layer *layer, DM_Layer *top_layer) {
+        vector<string> top_names = top_layer->GetTopLayersNames();
+        for(int i = 0 ; i < top_names.size() ; i++)
+            name_to_layer_map.find(top_names.at(i))->second->ReplaceBottomLayer(top_layer->GetName(), layer->GetName());
+        layer->SetTopLayers(top_names);
+
+        remove_layer(top_layer);
+    }
+
+    //top_layer takes over the work of layer and its inputs
+    void DM_Net::merge_layer_into_top(DM_Layer *layer, DM_Layer *top_layer) {
+        vector<string> bottom_names = layer->GetBottomLayersNames();
+        for(int i = 0 ; i < bottom_names.size() ; i++)
+            name_to_layer_map.find(bottom_names.at(i))->second->ReplaceTopLayer(layer->GetName(), top_layer->GetName());
+        top_layer->SetBottomLayers(bottom_names);
+
+        remove_layer(layer);
+    }
+
+    void DM_Net::remove_layer(DM_Layer *layer) {
+        pipeline.erase(std::find(pipeline.begin(), pipeline.end(), layer));
+        layers.erase(std::find(layers.begin(), layers.end(), layer));
+        name_to_layer_map.erase(layer->GetName());
+        delete layer;
+    }
+
+    /*
+     * Merge chains of layers into single layers so that intermediate blobs are never written to memory
+     * Conv/Fc + Activation: activation is applied in the gemm epilogue
+     * Conv + MaxPool 2x2/s2: pooling is done in the epilogue, only the pooled output is written
+     * Activation + MaxPool: activation is applied to the pooled values
+     * A layer opts out with "no_fusion": true in main.dm, the whole pass with "FUSE_LAYERS": false
+     */
+    void DM_Net::fuse_layers() {
+        int num_fusions = 0;
+
+        int i = 1;
+        while(i < pipeline.size()) {
+            DM_Layer *layer = pipeline.at(i);
+            DM_Layer *top_layer = get_fusable_top_layer(layer);
+            if(top_layer == NULL) {
+                i++;
+                continue;
+            }
+
+            string layer_name = layer->GetName();
+            string top_layer_name = top_layer->GetName();
+
+            DM_Layer_Activation *top_activation = dynamic_cast<DM_Layer_Activation *>(top_layer);
+            DM_Layer_Pooling *top_pooling = dynamic_cast<DM_Layer_Pooling *>(top_layer);
+            DM_Layer_Activation *activation = dynamic_cast<DM_Layer_Activation *>(layer);
+
+            bool is_fused = false;
+            if(top_activation != NULL &&
+               layer->FuseActivation(top_activation->GetActivationType(), top_activation->GetActivationThreshold())) {
+                merge_top_into_layer(layer, top_layer);
+                is_fused = true;
+            } else if(top_pooling != NULL && top_pooling->IsMaxPool2x2Stride2() &&
+                      top_pooling->GetActivationType() == ACTIVATION_NONE && layer->FuseMaxPool2x2()) {
+                merge_top_into_layer(layer, top_layer);
+                is_fused = true;
+            } else if(activation != NULL && top_pooling != NULL &&
+                      top_pooling->FuseActivation(activation->GetActivationType(), activation->GetActivationThreshold())) {
+                merge_layer_into_top(layer, top_layer);
+                is_fused = true;
+            }
+
+            if(is_fused) {
+                //the merged layer might be fused again with its new top layer
+                LOGD("Fused %s and %s", layer_name.c_str(), top_layer_name.c_str());
+                num_fusions++;
+            } else {
+                i++;
+            }
+        }
+
+        LOGD("Fusion pass: %d fusions, %d layers left", num_fusions, (int)pipeline.size());
+    }
+
+    void DM_Net::plan_memory(uint32_t batch_size) {
+        int num_layers = pipeline.size();
+        this->planned_batch_size = batch_size;
+
+        map<string, int> name_to_idx;
+        for(int i = 0 ; i < num_layers ; i++) {
+            name_to_idx.insert(pair<string, int>(pipeline.at(i)->GetName(), i));
+        }
+
+        /*
+         * root[i] is the index of the layer which owns the memory of layer i's output
+         * -1 means the output is not planned (network input or a blob converted between environments)
+         */
+        vector<int> root(num_layers, -1);
+        for(int i = 1 ; i < num_layers ; i++) {
+            DM_Layer *layer = pipeline.at(i);
+            bool is_aliasing = layer->IsOutputAliasingInput();
+            if(!is_aliasing && !layer->IsInPlaceCapable()) {
+                root[i] = i;
+                continue;
+            }
+
+            int bottom_idx = name_to_idx.find(layer->GetBottomLayersNames().at(0))->second;
+            DM_Layer *bottom_layer = pipeline.at(bottom_idx);
+            bool is_same_memory = bottom_layer->GetEnvironment() == layer->GetEnvironment() &&
+                                  (layer->GetEnvironment() == ENVIRONMENT_CPU || bottom_layer->GetPrecision() == layer->GetPrecision());
+
+            if(is_aliasing) {
+                if(is_same_memory)
+                    root[i] = root[bottom_idx];
+            } else {
+                //in-place only if this layer is the single consumer of its input
+                if(is_same_memory && bottom_layer->GetTopLayersNames().size() == 1)
+                    root[i] = root[bottom_idx];
+                else
+                    root[i] = i;
+            }
+        }
+
+        //liveness: a blob is alive from its producer until its last consumer
+        vector<int> last_use(num_layers, -1);
+        for(int i = 0 ; i < num_layers ; i++) {
+            DM_Layer *layer = pipeline.at(i);
+            if(root[i] >= 0)
+                last_use[root[i]] = max(last_use[root[i]], i);
+
+            vector<string> bottom_names = layer->GetBottomLayersNames();
+            for(int j = 0 ; j < bottom_names.size() ; j++) {
+                int r = root[name_to_idx.find(bottom_names.at(j))->second];
+                if(r >= 0)
+                    last_use[r] = max(last_use[r], i);
+            }
+
+            //outputs of the network have to survive until the end of DM_Net::Forward
+            if(layer->GetTopLayersNames().size() == 0 && root[i] >= 0)
+                last_use[root[i]] = num_layers;
+        }
+
+        //queues of a parallel run are not ordered, every blob used in the run is alive during the whole run
+        vector<int> first_use(num_layers);
+        for(int i = 0 ; i < num_layers ; i++)
+            first_use[i] = i;
+        for(int r = 0 ; r < parallel_regions.size() ; r++) {
+            for(int i = 0 ; i < num_layers ; i++) {
+                if(root[i] != i || first_use[i] > parallel_regions.at(r).second || last_use[i] < parallel_regions.at(r).first)
+                    continue;
+                first_use[i] = min(first_use[i], parallel_regions.at(r).first);
+                last_use[i] = max(last_use[i], parallel_regions.at(r).second);
+            }
+        }
+
+        DM_Memory_Planner cpu_planner;
+        DM_Memory_Planner gpu_planner;
+        vector<int> tensor_ids(num_layers, -1);
+        for(int i = 0 ; i < num_layers ; i++) {
+            if(root[i] != i)
+                continue;
+
+            DM_Layer *layer = pipeline.at(i);
+            vector<uint32_t> shapes = layer->GetOutputShapes();
+            size_t num_items = batch_size;
+            for(int j = 0 ; j < shapes.size() ; j++)
+                num_items *= shapes.at(j);
+
+            if(layer->GetEnvironment() == ENVIRONMENT_CPU) {
+                tensor_ids[i] = cpu_planner.AddTensor(num_items * sizeof(float), first_use[i], last_use[i]);
+            } else {
+                size_t item_size = (layer->GetPrecision() == PRECISION_16) ? sizeof(cl_half) : sizeof(cl_float);
+                tensor_ids[i] = gpu_planner.AddTensor(num_items * item_size, first_use[i], last_use[i]);
+            }
+        }
+
+        cpu_planner.Plan(64);
+        if(cpu_planner.GetNumTensors() > 0) {
+            this->cpu_arena = DeepMon::Get().GetCpuExecutionEngine().AllocateArena(cpu_planner.GetArenaSize());
+            LOGD("CPU memory plan: %d blobs, arena %u bytes instead of %u bytes",
+                 cpu_planner.GetNumTensors(), (uint32_t)cpu_planner.GetArenaSize(), (uint32_t)cpu_planner.GetTotalTensorsSize());
+        }
+
+        if(gpu_planner.GetNumTensors() > 0) {
+            DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+            gpu_planner.Plan(gpu_engine.GetMemBaseAddrAlign());
+            this->gpu_arena = gpu_engine.AllocateArena(gpu_planner.GetArenaSize());
+            if(this->gpu_arena == NULL) {
+                LOGE("Failed to allocate GPU arena, GPU layers will allocate their own blobs");
+            } else {
+                LOGD("GPU memory plan: %d blobs, arena %u bytes instead of %u bytes",
+                     gpu_planner.GetNumTensors(), (uint32_t)gpu_planner.GetArenaSize(), (uint32_t)gpu_planner.GetTotalTensorsSize());
+            }
+        }
+
+        //slots of the arenas, views for a given batch size are created from them when that batch size is first used
+        this->planned_roots = root;
+        this->planned_offsets.assign(num_layers, -1);
+        for(int i = 0 ; i < num_layers ; i++) {
+            if(tensor_ids[i] < 0)
+                continue;
+            if(pipeline.at(i)->GetEnvironment() == ENVIRONMENT_CPU)
+                this->planned_offsets[i] = cpu_planner.GetOffset(tensor_ids[i]);
+            else if(this->gpu_arena != NULL)
+                this->planned_offsets[i] = gpu_planner.GetOffset(tensor_ids[i]);
+        }
+
+        use_memory_plan(batch_size);
+    }
+
+    /*
+     * Hands the views of the plan for batch_size (at most planned_batch_size) to the layers
+     * Every slot is sized for planned_batch_size, a smaller batch uses the beginning of the same slot
+     */
+    void DM_Net::use_memory_plan(uint32_t batch_size) {
+        int num_layers = pipeline.size();
+
+        map<uint32_t, vector<DM_Blob *> >::iterator it = this->planned_views.find(batch_size);
+        if(it == this->planned_views.end()) {
+            //create views on the arenas
+            vector<DM_Blob *> planned_outputs(num_layers, NULL);
+            for(int i = 0 ; i < num_layers ; i++) {
+                if(this->planned_offsets[i] < 0)
+                    continue;
+
+                DM_Layer *layer = pipeline.at(i);
+                vector<uint32_t> shapes({batch_size});
+                vector<uint32_t> output_shapes = layer->GetOutputShapes();
+                shapes.insert(shapes.end(), output_shapes.begin(), output_shapes.end());
+
+                DM_Blob *blob = NULL;
+                if(layer->GetEnvironment() == ENVIRONMENT_CPU) {
+                    float *view = this->cpu_arena + this->planned_offsets[i] / sizeof(float);
+                    blob = new DM_Blob(shapes, ENVIRONMENT_CPU, PRECISION_32, view, NULL);
+                } else {
+                    size_t item_size = (layer->GetPrecision() == PRECISION_16) ? sizeof(cl_half) : sizeof(cl_float);
+                    size_t size_in_bytes = 1;
+                    for(int j = 0 ; j < shapes.size() ; j++)
+                        size_in_bytes *= shapes.at(j);
+                    size_in_bytes *= item_size;
+
+                    cl_mem view = DeepMon::Get().GetGpuExecutionEngine().CreateSubBuffer(this->gpu_arena,
+                                                                                         this->planned_offsets[i],
+                                                                                         size_in_bytes);
+                    if(view == NULL)
+                        continue;
+                    this->planned_sub_buffers.push_back(view);
+                    blob = new DM_Blob(shapes, ENVIRONMENT_GPU, layer->GetPrecision(), NULL, view);
+                }
+
+                //the memory belongs to the plan, it is not deleted when its last consumer is done
+                blob->set_pinned(true);
+                this->planned_blobs.push_back(blob);
+                planned_outputs[i] = blob;
+            }
+
+            //in-place layers write into the slot of their input
+            for(int i = 0 ; i < num_layers ; i++) {
+                int root = this->planned_roots[i];
+                if(root >= 0 && root != i && pipeline.at(i)->IsInPlaceCapable())
+                    planned_outputs[i] = planned_outputs[root];
+            }
+
+            it = this->planned_views.insert(pair<uint32_t, vector<DM_Blob *> >(batch_size, planned_outputs)).first;
+        }
+
+        for(int i = 0 ; i < num_layers ; i++)
+            pipeline.at(i)->SetPlannedOutput(it->second.at(i));
+    }
+
+    //the forward using the plan has to be finished
+    void DM_Net::release_memory_plan() {
+        for(int i = 0 ; i < pipeline.size() ; i++)
+            pipeline.at(i)->SetPlannedOutput(NULL);
+
+        for(int i = 0 ; i < planned_blobs.size() ; i++)
+            delete planned_blobs.at(i);
+        planned_blobs.clear();
+        planned_views.clear();
+        planned_roots.clear();
+        planned_offsets.clear();
+        for(int i = 0 ; i < planned_sub_buffers.size() ; i++)
+            clReleaseMemObject(planned_sub_buffers.at(i));
+        planned_sub_buffers.clear();
+
+        DeepMon::Get().GetCpuExecutionEngine().ReleaseArena(this->cpu_arena);
+        this->cpu_arena = NULL;
+        if(this->gpu_arena != NULL)
+            DeepMon::Get().GetGpuExecutionEngine().ReleaseArena(this->gpu_arena);
+        this->gpu_arena = NULL;
+        this->planned_batch_size = 0;
+    }
+
+    void DM_Net::tune_kernels() {
+        //cpu-only networks never bring the gpu up
+        bool has_gpu_layers = false;
+        for(int i = 0 ; i < pipeline.size() ; i++) {
+            if(pipeline.at(i)->GetEnvironment() == ENVIRONMENT_GPU)
+                has_gpu_layers = true;
+        }
+        if(!has_gpu_layers || !IsWorking())
+            return;
+
+        vector<uint32_t> shapes = GetInputShapes();
+        uint32_t num_items = 1;
+        for(int i = 0 ; i < shapes.size() ; i++)
+            num_items *= shapes.at(i);
+        float *data = new float[num_items];
+        for(int i = 0 ; i < num_items ; i++)
+            data[i] = (float)(i % 255) / 255.0f - 0.5f;
+        DM_Blob *input = new DM_Blob(shapes, ENVIRONMENT_CPU, PRECISION_32, data);
+        delete[] data;
+
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        gpu_engine.SetTuning(true);
+        DM_Blob *result = Forward(input);
+        gpu_engine.SetTuning(false);
+        gpu_engine.SaveTuning();
+
+        if(result != NULL)
+            delete result;
+    }
+
+    //output blob of the last layer, still counting DM_Net as a consumer, NULL if the forward failed
+    DM_Blob * DM_Net::run_pipeline(DM_Blob *input_blob) {
         if(!IsWorking()) {
             return NULL;
         }
+        if(IsStreaming()) {
+            LOGE("Forward is not available in streaming mode, use Submit/Poll");
+            return NULL;
+        }
+
+        //every dimension but the batch is fixed by the network
+        vector<uint32_t> input_shapes = GetInputShapes(input_blob->get_shape_at(0));
+        if(input_blob->get_shapes() != input_shapes || input_shapes.at(0) == 0) {
+            LOGE("Input blob does not match the input of the network");
+            delete input_blob;
+            return NULL;
+        }
+
+        /*
+         * The previous forward is done (its result has been read back), the plan can be replaced
+         * Arenas only grow, so they are reallocated at most when a batch larger than all previous ones comes in
+         */
+        if(this->is_planning_memory) {
+            if(input_shapes.at(0) > this->planned_batch_size) {
+                release_memory_plan();
+                plan_memory(input_shapes.at(0));
+            } else {
+                use_memory_plan(input_shapes.at(0));
+            }
+        }
+
+        //consumer counts and corrupted flags left by an interrupted forward
+        for(int i = 0 ; i < planned_blobs.size() ; i++) {
+            planned_blobs.at(i)->reset_consumers();
+            planned_blobs.at(i)->set_corrupted(false);
+        }
 
-        //push input_blob into data layer
+        //push input_blob into data layer, the net owns it from now on
+        input_blob->add_consumers(1);
         this->pipeline.at(0)->EnqueueInputBlob(input_blob);
         DM_Blob *result = NULL;
 
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        int region_idx = 0;
+        bool is_forked = false;
         for(int i = 0 ; i < pipeline.size() ; i++) {
             LOGD("Processing layer %s", pipeline.at(i)->GetName().c_str());
 
+            //without a fork (single queue, or the queues are busy with another fork) the run stays on the current queue
+            if(region_idx < parallel_regions.size() && parallel_regions.at(region_idx).first == i)
+                is_forked = gpu_engine.ForkQueues();
+            if(is_forked)
+                gpu_engine.SelectQueue(layer_queues.at(i));
+
             result = pipeline.at(i)->Forward();
 
+            if(region_idx < parallel_regions.size() && parallel_regions.at(region_idx).second == i) {
+                if(is_forked)
+                    gpu_engine.JoinQueues(NULL);
+                is_forked = false;
+                region_idx++;
+            }
+
             if(result == NULL || result->is_corrupted()) {
+                //inputs already queued for the remaining layers (e.g. by other branches) are never consumed
+                for(int j = i + 1 ; j < pipeline.size() ; j++)
+                    pipeline.at(j)->DropInputBlobs();
                 break;
             }
 
@@ -189,25 +611,72 @@ namespace deepmon {
             }
         }
 
+        if(is_forked)
+            gpu_engine.JoinQueues(NULL);
+
+        //views of the memory plan (pinned) belong to the plan, they are reset by the next forward
         if(result != NULL && result->is_corrupted()) {
-            delete result;
+            if(!result->is_pinned())
+                delete result;
             result = NULL;
         }
 
-        if(result != NULL) {
-            //process final blob
-            DM_Blob *final_result = result->ConvertToCpuBlob();
+        return result;
+    }
 
-            //free result if needed
-            if(!pipeline.at(pipeline.size() - 1)->IsUsingPersistentBlob()) {
-                delete result;
-            }
+    DM_Blob * DM_Net::Forward(DM_Blob *input_blob) {
+        std::lock_guard<std::mutex> lock(forward_mutex);
+        DM_Blob *result = run_pipeline(input_blob);
+        if(result == NULL)
+            return NULL;
+
+        //process final blob
+        DM_Blob *final_result = result->ConvertToCpuBlob();
+
+        //DM_Net is the last consumer of the result, blobs of the memory plan are reused by the next forward
+        if(result->release_consumer())
+            delete result;
 
-            result = final_result;
-            //result->print_blob();
+        return final_result;
+    }
+
+    bool DM_Net::Forward(DM_Blob *input_blob, float *output) {
+        std::lock_guard<std::mutex> lock(forward_mutex);
+        DM_Blob *result = run_pipeline(input_blob);
+        if(result == NULL)
+            return false;
+
+        bool is_successful = true;
+        if(result->get_env() == ENVIRONMENT_CPU)
+            memcpy(output, result->get_cpu_data(), result->get_size() * sizeof(float));
+        else
+            is_successful = DeepMon::Get().GetGpuExecutionEngine().CopyToHost(result, output);
+
+        if(result->release_consumer())
+            delete result;
+
+        return is_successful;
+    }
+
+    DM_Blob *DM_Net::CreateInputView(float *data, uint32_t batch_size) {
+        vector<uint32_t> shapes = GetInputShapes(batch_size);
+        //views read the caller's memory, an in-place first layer must not overwrite it
+        if(GetInputEnvironment() == ENVIRONMENT_CPU) {
+            DM_Blob *blob = new DM_Blob(shapes, ENVIRONMENT_CPU, PRECISION_32, data, NULL);
+            blob->set_read_only(true);
+            return blob;
         }
 
+        size_t size_in_bytes = sizeof(float);
+        for(int i = 0 ; i < shapes.size() ; i++)
+            size_in_bytes *= shapes.at(i);
+        cl_mem view = DeepMon::Get().GetGpuExecutionEngine().WrapHostMemory(data, size_in_bytes);
+        if(view == NULL)
+            return new DM_Blob(shapes, ENVIRONMENT_GPU, PRECISION_32, data);
 
-        return result;
+        DM_Blob *blob = new DM_Blob(shapes, ENVIRONMENT_GPU, PRECISION_32, NULL, view);
+        blob->set_owning_gpu_view(true);
+        blob->set_read_only(true);
+        return blob;
     }
 }
\ No newline at end of file
@@ -0,0 +1,345 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_net.hpp>
+#include <dm.hpp>
+#include <json/json.h>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+
+//timed runs of every candidate, the fastest one counts, an extra first run warms up kernels and memory pools
+#define PLACEMENT_TIMING_RUNS       3
+#define PLACEMENT_INFINITE_COST     1e30
+
+using namespace std;
+using namespace deepmon;
+
+namespace deepmon {
+    static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //blob of the given shapes filled with small non-zero values, so that no kernel hits a fast path for zeros
+    static DM_Blob *create_synthetic_blob(vector<uint32_t> shapes, ENVIRONMENT_TYPE env, PRESICION_TYPE precision) {
+        uint32_t num_items = 1;
+        for(int i = 0 ; i < shapes.size() ; i++)
+            num_items *= shapes.at(i);
+
+        float *data = new float[num_items];
+        for(int i = 0 ; i < num_items ; i++)
+            data[i] = (float)(i % 255) / 255.0f - 0.5f;
+
+        DM_Blob *blob = new DM_Blob(shapes, env, precision, data);
+        delete[] data;
+        return blob;
+    }
+
+    //mirrors the conversions of DM_Layer::Forward
+    static bool is_conversion_needed(ENVIRONMENT_TYPE from_env, PRESICION_TYPE from_precision,
+                                     ENVIRONMENT_TYPE to_env, PRESICION_TYPE to_precision) {
+        return from_env != to_env || (to_env == ENVIRONMENT_GPU && from_precision != to_precision);
+    }
+
+    double DM_Net::time_layer(DM_Layer_Param &param, DM_Net_Placement placement, vector<vector<uint32_t> > inputs_shapes) {
+        DM_Layer *layer = create_layer(param);
+        if(layer == NULL)
+            return PLACEMENT_INFINITE_COST;
+
+        //layers which refuse the placement can still be timed on their configured one
+        bool is_placed = !layer->IsCorrupted() && (layer->SetPlacement(placement.env, placement.precision) ||
+                         (layer->GetEnvironment() == placement.env && layer->GetPrecision() == placement.precision));
+        if(!is_placed) {
+            delete layer;
+            return PLACEMENT_INFINITE_COST;
+        }
+
+        layer->ComputeOutputShapes(inputs_shapes);
+        if(layer->IsCorrupted()) {
+            delete layer;
+            return PLACEMENT_INFINITE_COST;
+        }
+        layer->LoadWeights();
+
+        //pinned inputs are neither deleted nor overwritten by Forward
+        vector<DM_Blob *> inputs;
+        for(int i = 0 ; i < inputs_shapes.size() ; i++) {
+            vector<uint32_t> shapes({1});
+            shapes.insert(shapes.end(), inputs_shapes.at(i).begin(), inputs_shapes.at(i).end());
+            DM_Blob *input = create_synthetic_blob(shapes, placement.env, placement.precision);
+            input->set_pinned(true);
+            inputs.push_back(input);
+        }
+
+        double best_ms = PLACEMENT_INFINITE_COST;
+        for(int run = 0 ; run <= PLACEMENT_TIMING_RUNS ; run++) {
+            for(int i = 0 ; i < inputs.size() ; i++) {
+                inputs.at(i)->add_consumers(1);
+                layer->EnqueueInputBlob(inputs.at(i));
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            DM_Blob *result = layer->Forward();
+            if(placement.env == ENVIRONMENT_GPU)
+                DeepMon::Get().GetGpuExecutionEngine().FinalizeAllTasks();
+            double ms = elapsed_ms(start);
+
+            bool is_failed = (result == NULL || result->is_corrupted());
+            if(result != NULL && std::find(inputs.begin(), inputs.end(), result) == inputs.end() && result->release_consumer())
+                delete result;
+
+            if(is_failed) {
+                best_ms = PLACEMENT_INFINITE_COST;
+                break;
+            }
+            if(run > 0)
+                best_ms = min(best_ms, ms);
+        }
+
+        for(int i = 0 ; i < inputs.size() ; i++)
+            delete inputs.at(i);
+        delete layer;
+
+        return best_ms;
+    }
+
+    double DM_Net::time_conversion(vector<uint32_t> shapes, DM_Net_Placement from, DM_Net_Placement to) {
+        if(!is_conversion_needed(from.env, from.precision, to.env, to.precision))
+            return 0;
+
+        DM_Blob *blob = create_synthetic_blob(shapes, from.env, from.precision);
+
+        double best_ms = PLACEMENT_INFINITE_COST;
+        for(int run = 0 ; run <= PLACEMENT_TIMING_RUNS ; run++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            DM_Blob *converted = DeepMon::Get().ConvertBlob(blob, to.env, to.precision);
+            DeepMon::Get().GetGpuExecutionEngine().FinalizeAllTasks();
+            double ms = elapsed_ms(start);
+
+            if(converted == NULL || converted->is_corrupted()) {
+                if(converted != NULL)
+                    delete converted;
+                best_ms = PLACEMENT_INFINITE_COST;
+                break;
+            }
+            delete converted;
+
+            if(run > 0)
+                best_ms = min(best_ms, ms);
+        }
+
+        delete blob;
+        return best_ms;
+    }
+
+    /*
+     * Dynamic programming over the pipeline: cost[i][c] is the lowest latency of layers [1, i] with layer i on candidates[c]
+     * The output of the previous layer is converted according to both placements,
+     * inputs produced by earlier layers (branches) are converted from the best placement found for their producer
+     * The result is exact for chains of layers, which covers the models of DeepMon
+     */
+    bool DM_Net::calibrate_placement(DM_Net_Parameter *net_param, map<string, DM_Net_Placement> &placements) {
+        int num_layers = pipeline.size();
+
+        vector<DM_Net_Placement> candidates;
+        candidates.push_back({ENVIRONMENT_CPU, PRECISION_32});
+        if(DeepMon::Get().GetGpuExecutionEngine().Initialize()) {
+            candidates.push_back({ENVIRONMENT_GPU, PRECISION_32});
+            if(DeepMon::Get().GetGpuExecutionEngine().IsSupportingFP16())
+                candidates.push_back({ENVIRONMENT_GPU, PRECISION_16});
+        }
+        int num_candidates = candidates.size();
+
+        map<string, int> name_to_idx;
+        for(int i = 0 ; i < num_layers ; i++)
+            name_to_idx.insert(pair<string, int>(pipeline.at(i)->GetName(), i));
+
+        //the data layer keeps its configured placement, it receives the input of the network
+        DM_Net_Placement data_placement = {pipeline.at(0)->GetEnvironment(), pipeline.at(0)->GetPrecision()};
+
+        //conversions[i][a][b]: cost of moving the output of layer i from candidates[a] to candidates[b]
+        vector<vector<vector<double> > > conversions(num_layers,
+                                                     vector<vector<double> >(num_candidates, vector<double>(num_candidates, 0)));
+        vector<double> data_conversions(num_candidates, 0);
+
+        vector<vector<double> > cost(num_layers, vector<double>(num_candidates, PLACEMENT_INFINITE_COST));
+        vector<vector<int> > prev_candidate(num_layers, vector<int>(num_candidates, -1));
+        vector<int> best_candidate(num_layers, -1);
+
+        vector<uint32_t> data_shapes({1});
+        vector<uint32_t> data_output_shapes = pipeline.at(0)->GetOutputShapes();
+        data_shapes.insert(data_shapes.end(), data_output_shapes.begin(), data_output_shapes.end());
+        for(int c = 0 ; c < num_candidates ; c++)
+            data_conversions[c] = time_conversion(data_shapes, data_placement, candidates.at(c));
+
+        for(int i = 1 ; i < num_layers ; i++) {
+            DM_Layer *layer = pipeline.at(i);
+
+            vector<uint32_t> output_shapes({1});
+            vector<uint32_t> layer_output_shapes = layer->GetOutputShapes();
+            output_shapes.insert(output_shapes.end(), layer_output_shapes.begin(), layer_output_shapes.end());
+            for(int a = 0 ; a < num_candidates ; a++) {
+                for(int b = 0 ; b < num_candidates ; b++)
+                    conversions[i][a][b] = (a == b) ? 0 : time_conversion(output_shapes, candidates.at(a), candidates.at(b));
+            }
+
+            vector<string> bottom_names = layer->GetBottomLayersNames();
+            vector<vector<uint32_t> > inputs_shapes;
+            for(int j = 0 ; j < bottom_names.size() ; j++)
+                inputs_shapes.push_back(name_to_layer_map.find(bottom_names.at(j))->second->GetOutputShapes());
+
+            for(int c = 0 ; c < num_candidates ; c++) {
+                double layer_cost = time_layer(net_param->GetLayerParam(layer->GetName()), candidates.at(c), inputs_shapes);
+                if(layer_cost >= PLACEMENT_INFINITE_COST)
+                    continue;
+
+                bool is_reading_prev = false;
+                for(int j = 0 ; j < bottom_names.size() ; j++) {
+                    int bottom_idx = name_to_idx.find(bottom_names.at(j))->second;
+                    if(bottom_idx == 0)
+                        layer_cost += data_conversions[c];
+                    else if(bottom_idx == i - 1)
+                        is_reading_prev = true;
+                    else
+                        layer_cost += conversions[bottom_idx][best_candidate[bottom_idx]][c];
+                }
+
+                //outputs of the network are converted to the cpu at the end of DM_Net::Forward
+                if(layer->GetTopLayersNames().size() == 0)
+                    layer_cost += conversions[i][c][0];
+
+                if(i == 1) {
+                    cost[i][c] = layer_cost;
+                    continue;
+                }
+
+                for(int p = 0 ; p < num_candidates ; p++) {
+                    if(cost[i - 1][p] >= PLACEMENT_INFINITE_COST)
+                        continue;
+                    double total_cost = cost[i - 1][p] + layer_cost + (is_reading_prev ? conversions[i - 1][p][c] : 0);
+                    if(total_cost < cost[i][c]) {
+                        cost[i][c] = total_cost;
+                        prev_candidate[i][c] = p;
+                    }
+                }
+            }
+
+            for(int c = 0 ; c < num_candidates ; c++) {
+                if(cost[i][c] < PLACEMENT_INFINITE_COST && (best_candidate[i] < 0 || cost[i][c] < cost[i][best_candidate[i]]))
+                    best_candidate[i] = c;
+            }
+
+            if(best_candidate[i] < 0) {
+                LOGE("[%s]: No placement works, keep the configured placements", layer->GetName().c_str());
+                return false;
+            }
+            LOGD("[%s]: CPU %.3f ms, GPU-FP32 %.3f ms, GPU-FP16 %.3f ms (accumulated)", layer->GetName().c_str(),
+                 cost[i][0], (num_candidates > 1) ? cost[i][1] : -1.0, (num_candidates > 2) ? cost[i][2] : -1.0);
+        }
+
+        if(num_layers < 2)
+            return true;
+
+        int c = best_candidate[num_layers - 1];
+        LOGD("Placement plan: %.3f ms", cost[num_layers - 1][c]);
+        for(int i = num_layers - 1 ; i >= 1 ; i--) {
+            placements[pipeline.at(i)->GetName()] = candidates.at(c);
+            c = prev_candidate[i][c];
+        }
+
+        return true;
+    }
+
+    //a plan is only valid on the device it was made on, and for the same layers
+    bool DM_Net::read_placement(string path, map<string, DM_Net_Placement> &placements) {
+        ifstream in(path.c_str());
+        if(!in.is_open())
+            return false;
+
+        Json::Value plan;
+        Json::Reader reader;
+        if(!reader.parse(in, plan) || plan["DEVICE"].asString() != DeepMon::Get().GetGpuExecutionEngine().GetDeviceSignature()) {
+            LOGD("Placement plan %s is outdated", path.c_str());
+            return false;
+        }
+
+        for(int i = 1 ; i < pipeline.size() ; i++) {
+            string layer_name = pipeline.at(i)->GetName();
+            if(!plan["LAYERS"].isMember(layer_name)) {
+                LOGD("Placement plan %s misses layer %s", path.c_str(), layer_name.c_str());
+                return false;
+            }
+
+            Json::Value layer = plan["LAYERS"][layer_name];
+            DM_Net_Placement placement;
+            placement.env = layer["USE_GPU"].asBool() ? ENVIRONMENT_GPU : ENVIRONMENT_CPU;
+            placement.precision = (placement.env == ENVIRONMENT_GPU && layer["USE_HALF"].asBool()) ? PRECISION_16 : PRECISION_32;
+            placements[layer_name] = placement;
+        }
+
+        return true;
+    }
+
+    void DM_Net::write_placement(string path, map<string, DM_Net_Placement> &placements) {
+        Json::Value plan;
+        plan["DEVICE"] = DeepMon::Get().GetGpuExecutionEngine().GetDeviceSignature();
+        for(map<string, DM_Net_Placement>::iterator it = placements.begin() ; it != placements.end() ; it++) {
+            plan["LAYERS"][it->first]["USE_GPU"] = (it->second.env == ENVIRONMENT_GPU);
+            plan["LAYERS"][it->first]["USE_HALF"] = (it->second.precision == PRECISION_16);
+        }
+
+        ofstream out(path.c_str());
+        if(!out.is_open()) {
+            LOGE("Cannot write placement plan %s", path.c_str());
+            return;
+        }
+        out << plan;
+    }
+
+    /*
+     * "AUTO_PLACEMENT": true in main.dm overrides USE_GPU/USE_HALF of the layers
+     * The plan is read from "PLACEMENT_FILE" (placement.dm by default) or calibrated and written there
+     */
+    void DM_Net::place_layers(DM_Net_Parameter *net_param) {
+        map<string, DM_Net_Placement> placements;
+        if(!read_placement(net_param->GetPlacementPath(), placements)) {
+            LOGD("Calibrating the placement of %d layers", (int)pipeline.size() - 1);
+            if(!calibrate_placement(net_param, placements))
+                return;
+            write_placement(net_param->GetPlacementPath(), placements);
+        }
+
+        for(int i = 1 ; i < pipeline.size() ; i++) {
+            DM_Layer *layer = pipeline.at(i);
+            map<string, DM_Net_Placement>::iterator it = placements.find(layer->GetName());
+            if(it == placements.end())
+                continue;
+
+            if(!layer->SetPlacement(it->second.env, it->second.precision))
+                LOGD("[%s]: Keeps its configured placement", layer->GetName().c_str());
+            else
+                LOGD("[%s]: Placed on %s-FP%d", layer->GetName().c_str(),
+                     (it->second.env == ENVIRONMENT_GPU) ? "GPU" : "CPU", (it->second.precision == PRECISION_16) ? 16 : 32);
+        }
+    }
+}
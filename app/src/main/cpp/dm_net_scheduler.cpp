@@ -0,0 +1,118 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_net.hpp>
+#include <dm.hpp>
+
+namespace deepmon {
+    /*
+     * Every layer gets the branch it belongs to, -1 for the trunk
+     * A consumer of a trunk layer with several tops opens a new branch, a layer with inputs from
+     * several branches (or from the trunk) joins them back. Consecutive branch layers of the pipeline
+     * form a run, runs with at least two branches and only gpu layers are forked over the queues
+     */
+    void DM_Net::schedule_queues() {
+        int num_layers = pipeline.size();
+        this->layer_queues.assign(num_layers, -1);
+        this->parallel_regions.clear();
+
+        //cpu-only networks never bring the gpu up
+        bool has_gpu_layers = false;
+        for(int i = 0 ; i < num_layers ; i++) {
+            if(pipeline.at(i)->GetEnvironment() == ENVIRONMENT_GPU)
+                has_gpu_layers = true;
+        }
+        if(!has_gpu_layers)
+            return;
+
+        uint num_queues = DeepMon::Get().GetGpuExecutionEngine().GetNumQueues();
+        if(num_queues < 2)
+            return;
+
+        map<string, int> name_to_idx;
+        for(int i = 0 ; i < num_layers ; i++) {
+            name_to_idx.insert(pair<string, int>(pipeline.at(i)->GetName(), i));
+        }
+
+        vector<int> branch(num_layers, -1);
+        int num_branches = 0;
+        for(int i = 1 ; i < num_layers ; i++) {
+            vector<string> bottom_names = pipeline.at(i)->GetBottomLayersNames();
+            bool is_on_trunk = bottom_names.empty();
+            int label = -1;
+            for(int j = 0 ; j < bottom_names.size() && !is_on_trunk ; j++) {
+                int bottom_idx = name_to_idx.find(bottom_names.at(j))->second;
+                if(branch[bottom_idx] < 0) {
+                    //a trunk input only ends the trunk if it is shared with other layers
+                    if(pipeline.at(bottom_idx)->GetTopLayersNames().size() < 2)
+                        is_on_trunk = true;
+                } else if(label < 0) {
+                    label = branch[bottom_idx];
+                } else if(label != branch[bottom_idx]) {
+                    is_on_trunk = true;
+                }
+            }
+
+            if(is_on_trunk)
+                branch[i] = -1;
+            else if(label >= 0)
+                branch[i] = label;
+            else
+                branch[i] = num_branches++;
+        }
+
+        int first = 0;
+        while(first < num_layers) {
+            if(branch[first] < 0) {
+                first++;
+                continue;
+            }
+
+            int last = first;
+            while(last + 1 < num_layers && branch[last + 1] >= 0)
+                last++;
+
+            //branches get queues in order of appearance
+            map<int, int> branch_to_queue;
+            bool is_gpu_only = true;
+            for(int i = first ; i <= last ; i++) {
+                if(pipeline.at(i)->GetEnvironment() != ENVIRONMENT_GPU)
+                    is_gpu_only = false;
+                if(branch_to_queue.find(branch[i]) == branch_to_queue.end()) {
+                    int queue_id = branch_to_queue.size() % num_queues;
+                    branch_to_queue.insert(pair<int, int>(branch[i], queue_id));
+                }
+            }
+
+            if(is_gpu_only && branch_to_queue.size() > 1) {
+                for(int i = first ; i <= last ; i++)
+                    this->layer_queues[i] = branch_to_queue.find(branch[i])->second;
+                this->parallel_regions.push_back(pair<int, int>(first, last));
+                LOGD("Layers %s to %s run on %d queues", pipeline.at(first)->GetName().c_str(),
+                     pipeline.at(last)->GetName().c_str(), (int)min((uint)branch_to_queue.size(), num_queues));
+            }
+
+            first = last + 1;
+        }
+    }
+}
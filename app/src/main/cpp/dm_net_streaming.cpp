@@ -0,0 +1,282 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_net.hpp>
+#include <dm.hpp>
+#include <chrono>
+
+#define STREAM_IDLE_SPINS       64  //yields of an idle stage before it starts sleeping
+#define STREAM_IDLE_SLEEP_US    200
+
+namespace deepmon {
+    static void idle_wait(int &idle_rounds) {
+        if(idle_rounds < STREAM_IDLE_SPINS) {
+            idle_rounds++;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(STREAM_IDLE_SLEEP_US));
+        }
+    }
+
+    static void release_blob(DM_Blob *blob) {
+        if(blob != NULL && blob->release_consumer())
+            delete blob;
+    }
+
+    /*
+     * A new stage starts at every layer whose environment differs from the previous layer
+     * The data layer only forwards the input, it always belongs to the first stage
+     */
+    void DM_Net::build_stages() {
+        this->stages.clear();
+        this->layer_to_stage.assign(pipeline.size(), 0);
+        this->name_to_pipeline_idx.clear();
+
+        for(int i = 0 ; i < pipeline.size() ; i++) {
+            name_to_pipeline_idx.insert(pair<string, int>(pipeline.at(i)->GetName(), i));
+
+            if(i == 0 || (i > 1 && pipeline.at(i)->GetEnvironment() != pipeline.at(i - 1)->GetEnvironment())) {
+                DM_Net_Stage stage;
+                stage.first_layer = i;
+                stage.last_layer = i + 1;
+                stage.env = pipeline.at(i)->GetEnvironment();
+                this->stages.push_back(stage);
+            } else {
+                this->stages.back().last_layer = i + 1;
+                if(i == 1)
+                    this->stages.back().env = pipeline.at(i)->GetEnvironment();
+            }
+            this->layer_to_stage[i] = this->stages.size() - 1;
+        }
+    }
+
+    bool DM_Net::StartStreaming(uint32_t queue_capacity) {
+        //a forward still running uses the memory plan which is taken away below
+        std::lock_guard<std::mutex> lock(forward_mutex);
+        if(!IsWorking() || IsStreaming())
+            return false;
+
+        build_stages();
+
+        //frames of different stages are alive at the same time, they cannot share the slots of the memory plan
+        this->saved_planned_outputs.clear();
+        for(int i = 0 ; i < pipeline.size() ; i++) {
+            this->saved_planned_outputs.push_back(pipeline.at(i)->GetPlannedOutput());
+            pipeline.at(i)->SetPlannedOutput(NULL);
+        }
+
+        for(int i = 0 ; i <= this->stages.size() ; i++)
+            this->stage_queues.push_back(new DM_SPSC_Queue<DM_Net_Frame *>(queue_capacity > 0 ? queue_capacity : 1));
+
+        this->stop_streaming = false;
+        this->is_streaming = true;
+        for(int i = 0 ; i < this->stages.size() ; i++) {
+            LOGD("Stage %d: %s -> %s on %s", i,
+                 pipeline.at(stages[i].first_layer)->GetName().c_str(), pipeline.at(stages[i].last_layer - 1)->GetName().c_str(),
+                 (stages[i].env == ENVIRONMENT_CPU) ? "CPU" : "GPU");
+            this->stage_threads.push_back(std::thread(&DM_Net::stage_loop, this, i));
+        }
+
+        return true;
+    }
+
+    void DM_Net::StopStreaming() {
+        std::lock_guard<std::mutex> lock(forward_mutex);
+        if(!IsStreaming())
+            return;
+
+        this->stop_streaming = true;
+        for(int i = 0 ; i < this->stage_threads.size() ; i++)
+            this->stage_threads[i].join();
+        this->stage_threads.clear();
+
+        //frames which did not make it through the pipeline
+        for(int i = 0 ; i < this->stage_queues.size() ; i++) {
+            DM_Net_Frame *frame = NULL;
+            while(this->stage_queues[i]->TryPop(&frame))
+                drop_frame(frame);
+            delete this->stage_queues[i];
+        }
+        this->stage_queues.clear();
+
+        for(int i = 0 ; i < pipeline.size() ; i++)
+            pipeline.at(i)->SetPlannedOutput(this->saved_planned_outputs.at(i));
+        this->saved_planned_outputs.clear();
+
+        this->is_streaming = false;
+    }
+
+    bool DM_Net::Submit(DM_Blob *blob) {
+        if(!IsStreaming() || blob == NULL)
+            return false;
+
+        DM_Net_Frame *frame = new DM_Net_Frame();
+        frame->input = blob;
+        frame->result = NULL;
+        frame->failed = false;
+
+        if(!this->stage_queues.front()->TryPush(frame)) {
+            delete frame;
+            return false;
+        }
+        return true;
+    }
+
+    bool DM_Net::Poll(DM_Blob **result) {
+        DM_Net_Frame *frame = NULL;
+        if(!IsStreaming() || !this->stage_queues.back()->TryPop(&frame))
+            return false;
+
+        *result = frame->result;
+        delete frame;
+        return true;
+    }
+
+    void DM_Net::drop_frame(DM_Net_Frame *frame) {
+        if(frame->input != NULL)
+            delete frame->input;
+        for(int i = 0 ; i < frame->pending_blobs.size() ; i++)
+            release_blob(frame->pending_blobs[i].second);
+        if(frame->result != NULL)
+            delete frame->result;
+        delete frame;
+    }
+
+    void DM_Net::stage_loop(int stage_idx) {
+        DM_SPSC_Queue<DM_Net_Frame *> *in_queue = this->stage_queues[stage_idx];
+        DM_SPSC_Queue<DM_Net_Frame *> *out_queue = this->stage_queues[stage_idx + 1];
+
+        int idle_rounds = 0;
+        while(!this->stop_streaming) {
+            DM_Net_Frame *frame = NULL;
+            if(!in_queue->TryPop(&frame)) {
+                idle_wait(idle_rounds);
+                continue;
+            }
+
+            run_stage(stage_idx, frame);
+
+            //the next stage is busy, wait for a free slot
+            idle_rounds = 0;
+            while(!out_queue->TryPush(frame)) {
+                if(this->stop_streaming) {
+                    drop_frame(frame);
+                    return;
+                }
+                idle_wait(idle_rounds);
+            }
+            idle_rounds = 0;
+        }
+    }
+
+    /*
+     * Same as one slice of DM_Net::Forward, except that outputs for layers of later stages travel with the frame
+     * GPU blobs leaving a GPU stage for a CPU layer are read back here, so only GPU stages talk to the GPU
+     */
+    void DM_Net::run_stage(int stage_idx, DM_Net_Frame *frame) {
+        DM_Net_Stage &stage = this->stages[stage_idx];
+        if(frame->failed)
+            return;
+
+        //inputs produced by previous stages
+        vector<pair<int, DM_Blob *> > later_blobs;
+        for(int i = 0 ; i < frame->pending_blobs.size() ; i++) {
+            int layer_idx = frame->pending_blobs[i].first;
+            if(layer_to_stage[layer_idx] == stage_idx)
+                pipeline.at(layer_idx)->EnqueueInputBlob(frame->pending_blobs[i].second);
+            else
+                later_blobs.push_back(frame->pending_blobs[i]);
+        }
+        frame->pending_blobs = later_blobs;
+
+        if(frame->input != NULL) {
+            frame->input->add_consumers(1);
+            pipeline.at(0)->EnqueueInputBlob(frame->input);
+            frame->input = NULL;
+        }
+
+        //stages of the same environment run on different threads, only one of them may drive the engine at a time
+        DM_Execution_Engine *engine = (stage.env == ENVIRONMENT_CPU) ?
+                                      (DM_Execution_Engine *)&DeepMon::Get().GetCpuExecutionEngine() :
+                                      (DM_Execution_Engine *)&DeepMon::Get().GetGpuExecutionEngine();
+
+        for(int i = stage.first_layer ; i < stage.last_layer ; i++) {
+            std::lock_guard<std::mutex> lock(engine->GetExecutionMutex());
+
+            DM_Layer *layer = pipeline.at(i);
+            DM_Blob *result = layer->Forward();
+
+            if(result == NULL || result->is_corrupted()) {
+                LOGE("Streaming: %s failed", layer->GetName().c_str());
+                if(result != NULL)
+                    delete result;
+                frame->failed = true;
+                break;
+            }
+
+            vector<string> top_layers_names = layer->GetTopLayersNames();
+            if(top_layers_names.size() == 0) {
+                //network output, only the last layer of the pipeline is returned like in Forward
+                if(i == pipeline.size() - 1)
+                    frame->result = result->ConvertToCpuBlob();
+                release_blob(result);
+                continue;
+            }
+
+            for(int j = 0 ; j < top_layers_names.size() ; j++) {
+                int top_idx = name_to_pipeline_idx.find(top_layers_names.at(j))->second;
+                if(layer_to_stage[top_idx] == stage_idx) {
+                    pipeline.at(top_idx)->EnqueueInputBlob(result);
+                } else if(result->get_env() == ENVIRONMENT_GPU && pipeline.at(top_idx)->GetEnvironment() == ENVIRONMENT_CPU) {
+                    DM_Blob *converted = result->ConvertToCpuBlob();
+                    release_blob(result);
+                    if(converted == NULL) {
+                        LOGE("Streaming: failed to read back %s", layer->GetName().c_str());
+                        frame->failed = true;
+                        continue;
+                    }
+                    converted->add_consumers(1);
+                    frame->pending_blobs.push_back(pair<int, DM_Blob *>(top_idx, converted));
+                } else {
+                    frame->pending_blobs.push_back(pair<int, DM_Blob *>(top_idx, result));
+                }
+            }
+
+            if(frame->failed)
+                break;
+        }
+
+        if(frame->failed) {
+            //inputs already queued for the remaining layers of this frame
+            for(int i = stage.first_layer ; i < stage.last_layer ; i++)
+                pipeline.at(i)->DropInputBlobs();
+            for(int i = 0 ; i < frame->pending_blobs.size() ; i++)
+                release_blob(frame->pending_blobs[i].second);
+            frame->pending_blobs.clear();
+            if(frame->result != NULL) {
+                delete frame->result;
+                frame->result = NULL;
+            }
+        }
+    }
+}
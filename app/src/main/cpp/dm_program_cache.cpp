@@ -0,0 +1,155 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_program_cache.hpp>
+#include <dm_log.hpp>
+#include <cstdio>
+#include <vector>
+
+namespace deepmon {
+    //64-bit FNV-1a, stable across builds unlike std::hash
+    uint64_t DM_Program_Cache::hash(std::string data) {
+        uint64_t h = 14695981039346656037ULL;
+        for(int i = 0 ; i < data.size() ; i++) {
+            h ^= (uint8_t)data.at(i);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    std::string DM_Program_Cache::get_path(std::string key) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash(key));
+        return this->cache_dir + "/" + PROGRAM_CACHE_FILE_PREFIX + std::string(name) + ".bin";
+    }
+
+    std::string DM_Program_Cache::get_key(std::string device_signature, std::string source, std::string build_args) {
+        char source_hash[32];
+        snprintf(source_hash, sizeof(source_hash), "%016llx", (unsigned long long)hash(source));
+        return device_signature + "\n" + build_args + "\n" + std::string(source_hash);
+    }
+
+    /*
+     * File layout: magic, version, key length, key, binary size, binary
+     */
+    cl_program DM_Program_Cache::Load(cl_context context, cl_device_id device, std::string device_signature,
+                                      std::string source, std::string build_args) {
+        if(!IsEnabled())
+            return NULL;
+
+        std::string key = get_key(device_signature, source, build_args);
+        std::string path = get_path(key);
+        FILE *fp = fopen(path.c_str(), "rb");
+        if(fp == NULL)
+            return NULL;
+
+        uint32_t header[3] = {0, 0, 0};
+        uint64_t binary_size = 0;
+        std::string stored_key;
+        std::vector<unsigned char> binary;
+        bool is_valid = fread(header, sizeof(header), 1, fp) == 1 &&
+                        header[0] == PROGRAM_CACHE_MAGIC && header[1] == PROGRAM_CACHE_VERSION &&
+                        header[2] == key.size();
+        if(is_valid) {
+            stored_key.resize(header[2]);
+            is_valid = fread(&stored_key[0], 1, header[2], fp) == header[2] && stored_key == key;
+        }
+        if(is_valid)
+            is_valid = fread(&binary_size, sizeof(binary_size), 1, fp) == 1 && binary_size > 0;
+        if(is_valid) {
+            binary.resize(binary_size);
+            is_valid = fread(binary.data(), 1, binary_size, fp) == binary_size;
+        }
+        fclose(fp);
+
+        if(!is_valid) {
+            LOGD("Ignoring invalid program cache %s", path.c_str());
+            return NULL;
+        }
+
+        cl_int err = CL_SUCCESS;
+        cl_int binary_status = CL_SUCCESS;
+        size_t size = binary_size;
+        const unsigned char *data = binary.data();
+        cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, &data, &binary_status, &err);
+        if(err != CL_SUCCESS || binary_status != CL_SUCCESS) {
+            LOGD("Program cache %s was rejected by the driver", path.c_str());
+            if(program != NULL)
+                clReleaseProgram(program);
+            return NULL;
+        }
+
+        //binaries still have to be built, which only links them
+        err = clBuildProgram(program, 1, &device, build_args.c_str(), 0, 0);
+        if(err != CL_SUCCESS) {
+            LOGD("Failed to build program from cache %s", path.c_str());
+            clReleaseProgram(program);
+            return NULL;
+        }
+
+        return program;
+    }
+
+    void DM_Program_Cache::Store(cl_program program, cl_device_id device, std::string device_signature,
+                                 std::string source, std::string build_args) {
+        if(!IsEnabled())
+            return;
+
+        //the program is built for one device only
+        size_t binary_size = 0;
+        cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS || binary_size == 0)
+            return;
+
+        std::vector<unsigned char> binary(binary_size);
+        unsigned char *data = binary.data();
+        err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, NULL);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS)
+            return;
+
+        std::string key = get_key(device_signature, source, build_args);
+        std::string path = get_path(key);
+        //written next to the final file and renamed, a crash never leaves a truncated cache behind
+        std::string tmp_path = path + ".tmp";
+        FILE *fp = fopen(tmp_path.c_str(), "wb");
+        if(fp == NULL) {
+            LOGE("Failed to create program cache %s", tmp_path.c_str());
+            return;
+        }
+
+        uint32_t header[3] = {PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, (uint32_t)key.size()};
+        uint64_t size = binary_size;
+        bool is_written = fwrite(header, sizeof(header), 1, fp) == 1 &&
+                          fwrite(key.data(), 1, key.size(), fp) == key.size() &&
+                          fwrite(&size, sizeof(size), 1, fp) == 1 &&
+                          fwrite(data, 1, binary_size, fp) == binary_size;
+        is_written = (fclose(fp) == 0) && is_written;
+
+        if(!is_written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            LOGE("Failed to write program cache %s", path.c_str());
+            remove(tmp_path.c_str());
+        }
+    }
+}
@@ -0,0 +1,161 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <dm_thread_pool.hpp>
+#include <algorithm>
+
+#define CHUNKS_PER_THREAD       4 //more chunks than threads leave room for stealing
+
+namespace deepmon {
+    static thread_local bool is_inside_task = false;
+
+    DM_Thread_Pool::DM_Thread_Pool(int num_threads) {
+        this->num_threads = std::max(num_threads, 1);
+        this->num_pending_tasks = 0;
+
+        for(int i = 0 ; i < this->num_threads ; i++)
+            this->queues.push_back(new DM_Thread_Pool_Queue());
+
+        //the caller of ParallelFor is thread 0
+        for(int i = 1 ; i < this->num_threads ; i++)
+            this->workers.push_back(std::thread(&DM_Thread_Pool::worker_loop, this, i));
+    }
+
+    DM_Thread_Pool::~DM_Thread_Pool() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            this->stopped = true;
+        }
+        wake_cond.notify_all();
+
+        for(int i = 0 ; i < this->workers.size() ; i++)
+            this->workers[i].join();
+        for(int i = 0 ; i < this->queues.size() ; i++)
+            delete this->queues[i];
+    }
+
+    bool DM_Thread_Pool::IsInsideTask() {
+        return is_inside_task;
+    }
+
+    bool DM_Thread_Pool::pop_task(int thread_idx, DM_Thread_Pool_Task *task) {
+        //own queue first, newest task
+        {
+            DM_Thread_Pool_Queue *queue = this->queues[thread_idx];
+            std::lock_guard<std::mutex> lock(queue->queue_mutex);
+            if(!queue->tasks.empty()) {
+                *task = queue->tasks.back();
+                queue->tasks.pop_back();
+                num_pending_tasks--;
+                return true;
+            }
+        }
+
+        //steal the oldest task of another thread
+        for(int i = 1 ; i < this->num_threads ; i++) {
+            DM_Thread_Pool_Queue *queue = this->queues[(thread_idx + i) % this->num_threads];
+            std::lock_guard<std::mutex> lock(queue->queue_mutex);
+            if(!queue->tasks.empty()) {
+                *task = queue->tasks.front();
+                queue->tasks.pop_front();
+                num_pending_tasks--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void DM_Thread_Pool::run_task(DM_Thread_Pool_Task &task) {
+        bool was_inside_task = is_inside_task;
+        is_inside_task = true;
+        (*task.job->fn)(task.begin, task.end);
+        is_inside_task = was_inside_task;
+
+        //the job lives on the stack of its caller, it may be gone as soon as the lock is released
+        DM_Thread_Pool_Job *job = task.job;
+        std::lock_guard<std::mutex> lock(job->done_mutex);
+        if(--job->remaining == 0)
+            job->done_cond.notify_all();
+    }
+
+    void DM_Thread_Pool::worker_loop(int thread_idx) {
+        while(true) {
+            DM_Thread_Pool_Task task;
+            if(pop_task(thread_idx, &task)) {
+                run_task(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cond.wait(lock, [this] {
+                return this->stopped || this->num_pending_tasks > 0;
+            });
+            if(this->stopped)
+                return;
+        }
+    }
+
+    void DM_Thread_Pool::ParallelFor(uint32_t n, uint32_t grain, const std::function<void(uint32_t, uint32_t)> &fn) {
+        if(n == 0)
+            return;
+
+        grain = std::max(grain, (uint32_t)1);
+        uint32_t num_chunks = std::min((n + grain - 1) / grain, (uint32_t)(this->num_threads * CHUNKS_PER_THREAD));
+        if(this->num_threads == 1 || num_chunks <= 1 || is_inside_task) {
+            fn(0, n);
+            return;
+        }
+
+        DM_Thread_Pool_Job job;
+        job.fn = &fn;
+        job.remaining = num_chunks;
+
+        //chunks are dealt round-robin, the caller keeps the first one
+        for(uint32_t i = 0 ; i < num_chunks ; i++) {
+            DM_Thread_Pool_Task task;
+            task.job = &job;
+            task.begin = (uint32_t)((uint64_t)n * i / num_chunks);
+            task.end = (uint32_t)((uint64_t)n * (i + 1) / num_chunks);
+
+            DM_Thread_Pool_Queue *queue = this->queues[i % this->num_threads];
+            std::lock_guard<std::mutex> lock(queue->queue_mutex);
+            queue->tasks.push_back(task);
+            num_pending_tasks++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+        }
+        wake_cond.notify_all();
+
+        //help until no task is left, then wait for the chunks still running on workers
+        DM_Thread_Pool_Task task;
+        while(job.remaining > 0 && pop_task(0, &task))
+            run_task(task);
+
+        std::unique_lock<std::mutex> lock(job.done_mutex);
+        job.done_cond.wait(lock, [&job] {
+            return job.remaining == 0;
+        });
+    }
+}
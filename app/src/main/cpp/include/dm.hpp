@@ -60,6 +60,18 @@ namespace deepmon {
                 blob->set_corrupted(true);
             }
         }
+        void ReleaseMemory(DM_Blob *blob) {
+            if(blob->get_env() == ENVIRONMENT_CPU) {
+                this->cpu_execution_engine->ReleaseMemory(blob);
+            } else if(blob->get_env() == ENVIRONMENT_GPU) {
+                this->gpu_execution_engine->ReleaseMemory(blob);
+            }
+        }
+        //give back the buffers cached by the engines, keep_bytes are kept on each engine
+        void TrimMemoryPools(size_t keep_bytes) {
+            this->cpu_execution_engine->TrimMemoryPool(keep_bytes);
+            this->gpu_execution_engine->TrimMemoryPool(keep_bytes);
+        }
         DM_Blob *ConvertBlob(DM_Blob *blob, ENVIRONMENT_TYPE to_evn, PRESICION_TYPE to_precision) {
             DM_Blob *result = NULL;
 
@@ -69,7 +81,7 @@ namespace deepmon {
                 return result;
             }
 
-            if(!this->gpu_execution_engine->IsWorking())
+            if(!this->gpu_execution_engine->Initialize())
                 return NULL;
 
             if(to_evn == ENVIRONMENT_CPU)
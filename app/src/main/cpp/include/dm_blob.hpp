@@ -2,6 +2,7 @@
 #define DM_BLOB_HPP
 
 #include <vector>
+#include <atomic>
 #include <CL/cl.h>
 #include "dm_common.hpp"
 #include "dm_log.hpp"
@@ -14,16 +15,22 @@ namespace deepmon {
         PRESICION_TYPE precision;
 
         uint32_t size; //number of items
-        uint32_t mem_size; //number of bytes
+        uint32_t mem_size = 0; //number of bytes
         bool corrupted = false;
 
         float *cpu_data;
         cl_mem gpu_data;
 
-        bool is_persitent = false; //cannot be deleted during forward executions
+        std::atomic<uint32_t> num_consumers{0}; //layers (or DM_Net for network outputs) which still have to read this blob
+        bool pinned = false; //never deleted when the last consumer is done, the memory is managed by someone else
+        bool owns_memory = true; //false if the blob is only a view on memory owned by someone else (e.g. memory plan of DM_Net)
+        bool owns_gpu_view = false; //the gpu view is released with the blob (e.g. a buffer wrapping host memory)
+        bool read_only = false; //the memory belongs to the caller of DM_Net (e.g. a java array), layers must not write into it
+        cl_event ready_event = NULL; //last gpu command writing this blob, NULL if nothing is pending
 
     public:
         DM_Blob(std::vector<uint32_t> shapes, ENVIRONMENT_TYPE evn, PRESICION_TYPE precision_type, float * initialized_data);
+        DM_Blob(std::vector<uint32_t> shapes, ENVIRONMENT_TYPE evn, PRESICION_TYPE precision_type, float *cpu_view, cl_mem gpu_view);
         ~DM_Blob();
         ENVIRONMENT_TYPE get_env() {
             return this->environment;
@@ -64,11 +71,50 @@ namespace deepmon {
         void set_gpu_data(cl_mem data) {
             this->gpu_data = data;
         }
-        void set_persistent(bool is_persistent) {
-            this->is_persitent = is_persistent;
+        /*
+         * GPU commands are only enqueued, the next command reading or writing this blob waits for ready_event
+         * The blob takes the ownership of event and releases the previous one
+         */
+        void set_ready_event(cl_event event);
+        cl_event get_ready_event() {
+            return this->ready_event;
         }
-        bool is_persistent_blob() {
-            return this->is_persitent;
+        void set_pinned(bool is_pinned) {
+            this->pinned = is_pinned;
+        }
+        bool is_pinned() {
+            return this->pinned;
+        }
+        void set_read_only(bool is_read_only) {
+            this->read_only = is_read_only;
+        }
+        bool is_read_only() {
+            return this->read_only;
+        }
+        uint32_t get_num_consumers() {
+            return this->num_consumers;
+        }
+        void add_consumers(uint32_t num_consumers) {
+            this->num_consumers += num_consumers;
+        }
+        void reset_consumers() {
+            this->num_consumers = 0;
+        }
+        /*
+         * Called by a consumer when it does not need the blob anymore
+         * Returns true if it was the last consumer and the blob has to be deleted
+         */
+        bool release_consumer() {
+            //consumers may run on different threads in streaming mode
+            uint32_t remaining = this->num_consumers.load();
+            while(remaining > 0 && !this->num_consumers.compare_exchange_weak(remaining, remaining - 1));
+            return remaining <= 1 && !this->pinned;
+        }
+        bool is_owning_memory() {
+            return this->owns_memory;
+        }
+        void set_owning_gpu_view(bool is_owning) {
+            this->owns_gpu_view = is_owning;
         }
         uint32_t get_shape_at(int idx) {
             if(idx < shapes.size())
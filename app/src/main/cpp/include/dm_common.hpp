@@ -15,6 +15,7 @@
 #define DM_COMMON_HPP
 
 #include <string.h>
+#include <math.h>
 
 namespace deepmon {
     typedef enum {
@@ -70,6 +71,73 @@ namespace deepmon {
 #define LAYER_NAME_RELU                 "RELU"
 #define LAYER_NAME_LEAKY                "LEAKY"
 
+    //activations, shared by activation layers and the fused epilogue of conv/fc layers
+#define ACTIVATION_NONE_STR                 "NONE"
+#define ACTIVATION_RELU_STR                 "RELU"
+#define ACTIVATION_LEAKY_STR                "LEAKY"
+#define ACTIVATION_SIGMOID_STR              "SIGMOID"
+#define ACTIVATION_TANH_STR                 "TANH"
+
+#define ACTIVATION_NONE                     0
+#define ACTIVATION_RELU                     1
+#define ACTIVATION_LEAKY                    2
+#define ACTIVATION_SIGMOID                  3
+#define ACTIVATION_TANH                     4
+#define ACTIVATION_UNKNOWN                  -1
+
+    inline int GET_ACTIVATION_TYPE(const char *str) {
+        if(!strcmp(str, "") || !strcmp(str, ACTIVATION_NONE_STR))
+            return ACTIVATION_NONE;
+        if(!strcmp(str, ACTIVATION_RELU_STR))
+            return ACTIVATION_RELU;
+        if(!strcmp(str, ACTIVATION_LEAKY_STR))
+            return ACTIVATION_LEAKY;
+        if(!strcmp(str, ACTIVATION_SIGMOID_STR))
+            return ACTIVATION_SIGMOID;
+        if(!strcmp(str, ACTIVATION_TANH_STR))
+            return ACTIVATION_TANH;
+        return ACTIVATION_UNKNOWN;
+    }
+
+    //convolution algorithms, selected per layer with "CONV_ALGORITHM"
+#define CONV_ALGORITHM_AUTO_STR             "AUTO"
+#define CONV_ALGORITHM_IM2COL_STR           "IM2COL"
+#define CONV_ALGORITHM_WINOGRAD_2X2_STR     "WINOGRAD_2X2"
+#define CONV_ALGORITHM_WINOGRAD_4X4_STR     "WINOGRAD_4X4"
+
+#define CONV_ALGORITHM_AUTO                 0
+#define CONV_ALGORITHM_IM2COL               1
+#define CONV_ALGORITHM_WINOGRAD_2X2         2 //F(2x2, 3x3)
+#define CONV_ALGORITHM_WINOGRAD_4X4         3 //F(4x4, 3x3)
+#define CONV_ALGORITHM_UNKNOWN              -1
+
+    inline int GET_CONV_ALGORITHM(const char *str) {
+        if(!strcmp(str, "") || !strcmp(str, CONV_ALGORITHM_AUTO_STR))
+            return CONV_ALGORITHM_AUTO;
+        if(!strcmp(str, CONV_ALGORITHM_IM2COL_STR))
+            return CONV_ALGORITHM_IM2COL;
+        if(!strcmp(str, CONV_ALGORITHM_WINOGRAD_2X2_STR))
+            return CONV_ALGORITHM_WINOGRAD_2X2;
+        if(!strcmp(str, CONV_ALGORITHM_WINOGRAD_4X4_STR))
+            return CONV_ALGORITHM_WINOGRAD_4X4;
+        return CONV_ALGORITHM_UNKNOWN;
+    }
+
+    inline float ACTIVATE(float x, int activation_type, float negative_slope) {
+        switch(activation_type) {
+            case ACTIVATION_RELU:
+                return x > 0 ? x : 0;
+            case ACTIVATION_LEAKY:
+                return x > 0 ? x : x * negative_slope;
+            case ACTIVATION_SIGMOID:
+                return 1.0f / (1.0f + expf(-x));
+            case ACTIVATION_TANH:
+                return tanhf(x);
+            default:
+                return x;
+        }
+    }
+
     inline bool CMP_OPTION(char *str, const char *option) {
         bool ret = strncmp(str, option, strlen(option)) == 0 ? true : false;
         return ret;
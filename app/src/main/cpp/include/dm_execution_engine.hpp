@@ -14,6 +14,7 @@
 #ifndef DM_EXECUTION_ENGINE_HPP
 #define DM_EXECUTION_ENGINE_HPP
 
+#include <mutex>
 #include "dm_common.hpp"
 #include "dm_blob.hpp"
 
@@ -22,6 +23,7 @@ namespace deepmon {
     protected:
         ENVIRONMENT_TYPE evn;
         bool initialized = false;
+        std::mutex execution_mutex;
     public:
         DM_Execution_Engine(ENVIRONMENT_TYPE evn) {
             this->evn = evn;
@@ -29,7 +31,15 @@ namespace deepmon {
         bool IsWorking() {
             return this->initialized;
         }
+        /*
+         * Held by threads that run layers concurrently (streaming stages) around each layer
+         * Cached kernels of the GPU engine and scratch state of the CPU engine are not safe to share between two layers
+         */
+        std::mutex &GetExecutionMutex() {
+            return this->execution_mutex;
+        }
         virtual void AllocateMemory(DM_Blob *blob, float *initialized_data) = 0;
+        virtual void ReleaseMemory(DM_Blob *blob) = 0;
     };
 }
 
@@ -4,16 +4,58 @@
 
 #include <cstdint>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include "dm_common.hpp"
 #include "dm_execution_engine.hpp"
 #include "dm_blob.hpp"
+#include "dm_memory_pool.hpp"
+#include "dm_thread_pool.hpp"
+
+#define PARALLEL_GRAIN_ITEMS        4096 //smallest amount of scalar work worth a chunk of ParallelFor
+#define GEMM_GRAIN_ROWS             16 //smallest slice of a gemm worth a chunk of ExecuteGemm
 
 namespace deepmon {
+    //number of loop iterations per chunk when every iteration touches items_per_iteration items
+    inline uint32_t GET_PARALLEL_GRAIN(uint32_t items_per_iteration) {
+        if(items_per_iteration >= PARALLEL_GRAIN_ITEMS)
+            return 1;
+        return PARALLEL_GRAIN_ITEMS / (items_per_iteration > 0 ? items_per_iteration : 1);
+    }
 
     class DM_Execution_Engine_CPU : public DM_Execution_Engine {
+    private:
+        DM_Memory_Pool<float *> *memory_pool = NULL;
+        std::shared_ptr<DM_Thread_Pool> thread_pool; //replaced by SetNumThreads, ParallelFor keeps the one it started with
+        std::mutex thread_pool_mutex;
+        std::shared_ptr<DM_Thread_Pool> get_thread_pool();
     public:
         DM_Execution_Engine_CPU();
+        ~DM_Execution_Engine_CPU();
         void AllocateMemory(DM_Blob *blob, float *initialized_data);
+        void ReleaseMemory(DM_Blob *blob);
+        DM_Memory_Pool_Stats GetMemoryPoolStats();
+        void TrimMemoryPool(size_t keep_bytes);
+        void SetMemoryPoolLimit(size_t max_bytes_held);
+        void ExecuteBiasActivation(float *data, uint32_t outer, uint32_t channels, uint32_t inner,
+                                   float *biases, int activation_type, float activation_threshold);
+        void ExecuteBiasActivationMaxPool2x2(MEMORY_LAYOUT mem_layout,
+                                             float *input, uint32_t channels, uint32_t input_h, uint32_t input_w,
+                                             float *output, uint32_t output_h, uint32_t output_w,
+                                             float *biases, int activation_type, float activation_threshold);
+        //0 uses all cores, takes effect for the ParallelFor calls started after it returns
+        void SetNumThreads(int num_threads);
+        int GetNumThreads();
+        //runs fn(begin, end) over [0, n) on the thread pool, chunks hold at least grain items
+        void ParallelFor(uint32_t n, uint32_t grain, const std::function<void(uint32_t, uint32_t)> &fn);
+        /*
+         * Single-precision c = a * op(b) without transposing a, alpha = 1 and beta = 0
+         * OpenBLAS stays single-threaded, gemms must go through here to run on the pool
+         */
+        void ExecuteGemm(bool transpose_b, uint32_t m, uint32_t n, uint32_t k,
+                         float *a, uint32_t lda, float *b, uint32_t ldb, float *c, uint32_t ldc);
+        float *AllocateArena(size_t size_in_bytes);
+        void ReleaseArena(float *arena);
     };
 }
 
@@ -19,40 +19,76 @@
 #include "dm_execution_engine.hpp"
 #include "dm_kernel_defs.hpp"
 #include "dm_kernel_object.hpp"
+#include "dm_memory_pool.hpp"
+#include "dm_program_cache.hpp"
+#include "dm_kernel_tuner.hpp"
 #include <map>
 #include <string>
+#include <mutex>
+#include <functional>
 
 using namespace std;
 
 namespace deepmon {
     class DM_Execution_Engine_GPU : public DM_Execution_Engine {
     private:
-        std::vector<std::string> kernel_files {
-                std::string("common.cl"),
-                std::string("im2col.cl"),
-                std::string("conv.cl"),
-                std::string("pooling.cl"),
-                std::string("fc.cl"),
-                std::string("activation.cl"),
+        typedef struct {
+            std::string file;
+            std::vector<std::string> kernel_names;
+        } DM_Kernel_File;
+
+        //kernels defined by every file, a file is compiled (with common.cl) the first time one of its kernels is used
+        std::vector<DM_Kernel_File> kernel_files {
+                {std::string("common.cl"), {KERNEL_CONVERT_FLOAT_TO_HALF, KERNEL_CONVERT_HALF_TO_FLOAT, KERNEL_MEMCPY}},
+                {std::string("im2col.cl"), {KERNEL_CAFFE_IM2COL, KERNEL_CAFFE_COL2IM}},
+                {std::string("conv.cl"), {KERNEL_DM_CONV_BASE, KERNEL_DM_CONV_LOCAL, KERNEL_DM_CONV_LOCAL_MAXPOOL,
+                                          KERNEL_GROUPED_CONV, KERNEL_WINOGRAD_INPUT_TRANSFORM,
+                                          KERNEL_WINOGRAD_BATCHED_GEMM, KERNEL_WINOGRAD_OUTPUT_TRANSFORM}},
+                {std::string("pooling.cl"), {KERNEL_CAFFE_MAXPOOL, KERNEL_CAFFE_AVEPOOL, KERNEL_DM_MAXPOOL, KERNEL_DM_AVEPOOL}},
+                {std::string("fc.cl"), {KERNEL_DM_FC_BASE}},
+                {std::string("activation.cl"), {KERNEL_ACTIVATE_RELU, KERNEL_ACTIVATE_TANH, KERNEL_ACTIVATE_SIGMOID,
+                                                KERNEL_BIAS_ACTIVATE, KERNEL_BIAS_ACTIVATE_MAXPOOL}},
         };
+        std::string package_path; //empty: the kernels embedded in dm_kernels.hpp
+        std::once_flag start_flag;
         bool has_working_gpu = false;
         bool support_fp16 = false;
         //OpenCL objects
         std::string platform_name;
+        std::string device_signature; //device name, OpenCL version and driver version
         uint num_compute_units = 0;
         uint num_queues = 0;
+        uint mem_base_addr_align = 128; //in bytes, sub-buffers have to start at a multiple of it
         cl_platform_id platform_id;
         cl_context context;
         cl_device_id device;
         cl_command_queue *queues = NULL;
-        cl_program program_32;
-        cl_program program_16;
+        std::mutex kernels_mutex;
+        //(file and build options, precision) -> program, NULL if the file failed to compile
+        std::map<std::pair<std::string, PRESICION_TYPE>, cl_program> programs;
+        DM_Kernel_Tuner kernel_tuner;
+        bool is_tuning = false;
+        DM_Program_Cache program_cache; //disabled without a package path
+        DM_Memory_Pool<cl_mem> *memory_pool = NULL;
+
+        //queue scheduling, see ForkQueues
+        typedef struct {
+            cl_mem buffer;
+            size_t size_class;
+            PRESICION_TYPE precision;
+        } DM_Deferred_Buffer;
+
+        std::mutex scheduler_mutex;
+        bool is_forked = false;
+        uint fork_queue_id = 0;
+        std::vector<DM_Deferred_Buffer> deferred_buffers; //released while forked, recycled by JoinQueues
 
         std::string read_file(std::string path);
+        void start();
         bool scan_for_gpus();
-        bool compile_kernels();
-        bool compile_kernels(std::string package_path);
-        bool read_kernels();
+        std::string get_kernel_source(std::string file);
+        bool compile_kernel_file(PRESICION_TYPE precision, DM_Kernel_File &kernel_file, std::string build_options);
+        DM_Kernel_Object *get_kernel_object(PRESICION_TYPE precision, std::string kernel_name, std::string build_options);
         cl_program build_program(std::string source, std::string build_args);
         std::string get_program_build_log(cl_program program);
 
@@ -63,35 +99,24 @@ namespace deepmon {
         DM_Blob *convert_to_gpu_fp16_blob(DM_Blob *blob);
         DM_Blob *convert_to_cpu_blob(DM_Blob *blob);
 
-        //kernel activation
-        bool execute_memcpy(PRESICION_TYPE precision, cl_mem cl_output, cl_mem cl_input, int num_items);
-        bool execute_float_to_half_conversion(cl_mem cl_output, cl_mem cl_input, int num_items);
-        bool execute_half_to_float_conversion(cl_mem cl_output, cl_mem cl_input, int num_items);
-
-        //kernels list
-        std::vector<std::string> kernel_names {
-                std::string(KERNEL_CONVERT_FLOAT_TO_HALF),
-                std::string(KERNEL_CONVERT_HALF_TO_FLOAT),
-                std::string(KERNEL_MEMCPY),
-                std::string(KERNEL_CAFFE_IM2COL),
-                std::string(KERNEL_CAFFE_COL2IM),
-                std::string(KERNEL_DM_CONV_BASE),
-                std::string(KERNEL_DM_CONV_LOCAL),
-                std::string(KERNEL_DM_FC_BASE),
-                std::string(KERNEL_CAFFE_MAXPOOL),
-                std::string(KERNEL_CAFFE_AVEPOOL),
-                std::string(KERNEL_DM_MAXPOOL),
-                std::string(KERNEL_DM_AVEPOOL),
-                std::string(KERNEL_ACTIVATE_RELU),
-                std::string(KERNEL_ACTIVATE_TANH),
-                std::string(KERNEL_ACTIVATE_SIGMOID)
-        };
+        //kernel activation, *event is set to the event of the enqueued copy
+        bool execute_memcpy(PRESICION_TYPE precision, cl_mem cl_output, DM_Blob *input, cl_event *event);
+        bool execute_float_to_half_conversion(cl_mem cl_output, DM_Blob *input, cl_event *event);
+        bool execute_half_to_float_conversion(cl_mem cl_output, DM_Blob *input, cl_event *event);
+        bool execute_copy_kernel(cl_kernel kernel, cl_mem cl_output, DM_Blob *input, cl_event *event);
+
         std::map<std::string, DM_Kernel_Object *> kernels_map_fp32;
         std::map<std::string, DM_Kernel_Object *> kernels_map_fp16;
     public:
         DM_Execution_Engine_GPU();
         DM_Execution_Engine_GPU(std::string package_path);
 
+        /*
+         * The device is only brought up on first use (first gpu blob, kernel or device query),
+         * so CPU-only networks never pay for it. Returns false if there is no working gpu
+         */
+        bool Initialize();
+
         void ExecuteIm2Col(MEMORY_LAYOUT mem_layout, PRESICION_TYPE precision,
                            DM_Blob *input, uint32_t input_offset,
                            uint32_t filter_h, uint32_t filter_w,
@@ -100,32 +125,108 @@ namespace deepmon {
                            uint32_t dilation_h, uint32_t dilation_w,
                            uint32_t output_h, uint32_t output_w,
                            DM_Blob *im2col_output, uint32_t im2col_offset);
+        void ExecuteBiasActivation(PRESICION_TYPE precision, DM_Blob *data,
+                                   uint32_t channels, uint32_t inner,
+                                   DM_Blob *biases, int activation_type, float activation_threshold);
+        void ExecuteBiasActivationMaxPool2x2(PRESICION_TYPE precision, MEMORY_LAYOUT mem_layout,
+                                             DM_Blob *input, uint32_t channels, uint32_t input_h, uint32_t input_w,
+                                             DM_Blob *output, uint32_t output_h, uint32_t output_w,
+                                             DM_Blob *biases, int activation_type, float activation_threshold);
+        //copies host [rows x num_columns] floats into columns [first_column, first_column + num_columns) of a FP32 [rows x columns] blob
+        void WriteColumns(DM_Blob *data, uint32_t rows, uint32_t columns,
+                          uint32_t first_column, uint32_t num_columns, float *host_data);
+
 
+        /*
+         * Asynchronous execution: commands wait for the ready events of the blobs they touch and never block the host
+         * output records the event of the new command, only readbacks (ConvertToCpuBlob) wait on the host
+         */
+        cl_int EnqueueKernel(cl_kernel kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size,
+                             std::vector<DM_Blob *> inputs, DM_Blob *output);
+
+        /*
+         * Auto-tuning: launcher sets the arguments of the given kernel and enqueues it with local_size (NULL: driver's choice)
+         * build_options select a specialized variant of the kernel, the tuned VWM is added to them
+         * The launch parameters of (kernel, precision, key) come from the tuning database. A missing entry is either
+         * tuned now (every candidate of space is timed on the real arguments, see SetTuning) or replaced by the first candidates
+         */
+        //returns a cl_int error code, the typedef's attributes would be dropped as a template argument
+        typedef std::function<int(cl_kernel kernel, const size_t *local_size)> DM_Kernel_Launcher;
+        cl_int EnqueueTunedKernel(PRESICION_TYPE precision, std::string kernel_name, std::string build_options, std::string key,
+                                  DM_Tuning_Space space, DM_Blob *output, DM_Kernel_Launcher launcher);
+        void SetTuning(bool is_tuning) {
+            this->is_tuning = is_tuning;
+        }
+        //the database is kept next to the kernel files, it is only valid for this device
+        void SaveTuning() {
+            this->kernel_tuner.Save();
+        }
+        std::vector<cl_event> GetWaitList(std::vector<DM_Blob *> blobs);
+        //blocks until the pending commands writing blob are done
+        void WaitForBlob(DM_Blob *blob);
 
+        /*
+         * Queue scheduling: independent commands are spread over the queues created for the device
+         * ForkQueues makes every queue wait for the commands enqueued so far on the current queue,
+         * then SelectQueue picks the queue used by the calling thread for the following commands
+         * JoinQueues makes the forking queue wait for all the others and selects it again, *event (if not NULL) is that barrier
+         * Only one fork at a time, ForkQueues returns false if the device has one queue or another fork is running
+         * Buffers released while forked may still be used by other queues, they are only recycled after the join
+         */
+        bool ForkQueues();
+        void SelectQueue(uint queue_id);
+        bool JoinQueues(cl_event *event);
+        uint GetNumQueues() {
+            Initialize();
+            return this->num_queues;
+        }
         void FinalizeAllTasks();
         void AllocateMemory(DM_Blob *blob, float *initialized_data);
+        void ReleaseMemory(DM_Blob *blob);
+        DM_Memory_Pool_Stats GetMemoryPoolStats();
+        void TrimMemoryPool(size_t keep_bytes);
+        void SetMemoryPoolLimit(size_t max_bytes_held);
+        cl_mem AllocateArena(size_t size_in_bytes);
+
+        /*
+         * Host access without intermediate copies
+         * CopyToHost reads blob (either precision) as floats into data once the commands producing it are done
+         * WrapHostMemory returns a buffer using data itself, NULL if data is not aligned for it
+         * MapForWriting/Unmap give the host a pointer to fill an fp32 blob in place
+         */
+        bool CopyToHost(DM_Blob *blob, float *data);
+        cl_mem WrapHostMemory(float *data, size_t size_in_bytes);
+        float *MapForWriting(DM_Blob *blob);
+        void Unmap(DM_Blob *blob, float *data);
+        void ReleaseArena(cl_mem arena);
+        cl_mem CreateSubBuffer(cl_mem arena, size_t offset, size_t size_in_bytes);
+        uint GetMemBaseAddrAlign() {
+            Initialize();
+            return this->mem_base_addr_align;
+        }
+        bool IsSupportingFP16() {
+            Initialize();
+            return this->support_fp16;
+        }
+        //identifies the device in files which are only valid on one device, e.g. placement plans
+        std::string GetDeviceSignature() {
+            Initialize();
+            return this->device_signature;
+        }
         DM_Blob *blob_convert_to_cpu_blob(DM_Blob *blob);
         DM_Blob *blob_convert_to_gpu_blob(DM_Blob *blob, PRESICION_TYPE precision);
-        cl_command_queue GetCurrentQueue() {
-            return this->queues[0];
-        }
+        cl_command_queue GetCurrentQueue();
         cl_context  GetContext() {
+            Initialize();
             return this->context;
         }
 
         /*
          * Fixme: this should not be public function
+         * Compiles the file defining kernel_name for precision on its first use, NULL if that fails
+         * Every set of build options (e.g. -DVWM=8) is a separate variant of the file
          */
-        cl_kernel GetKernel(PRESICION_TYPE precision, string kernel_name) {
-            cl_kernel kernel = NULL;
-            if(precision == PRECISION_32) {
-                kernel = kernels_map_fp32.find(kernel_name)->second->get_kernel();
-            } else if(precision == PRECISION_16) {
-                kernel = kernels_map_fp16.find(kernel_name)->second->get_kernel();
-            }
-
-            return kernel;
-        }
+        cl_kernel GetKernel(PRESICION_TYPE precision, string kernel_name, string build_options = "");
     };
 }
 
@@ -0,0 +1,72 @@
+#ifndef DM_INFERENCE_SERVER_HPP
+#define DM_INFERENCE_SERVER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "dm_net.hpp"
+#include "dm_latency_histogram.hpp"
+
+#define DEFAULT_SERVER_MAX_BATCH_SIZE   8
+#define DEFAULT_SERVER_MAX_WAIT_US      5000
+
+namespace deepmon {
+    /*
+     * Dynamic batching on top of DM_Net::Forward
+     * Any thread submits single frames, one dispatcher thread groups the pending frames into a batch as soon as
+     * max_batch_size frames are waiting or the oldest one has waited max_wait_us, and runs it in one forward
+     * Other callers of the net's Forward (e.g. GetInference) keep working while the server runs,
+     * DM_Net::Forward holds the net's forward_mutex so their forwards and the batches run one after the other
+     */
+    class DM_Inference_Server {
+    private:
+        typedef std::chrono::steady_clock::time_point DM_Time_Point;
+        typedef struct {
+            DM_Blob *input; //cpu blob of batch 1
+            std::promise<DM_Blob *> result;
+            DM_Time_Point submit_time;
+        } DM_Inference_Request;
+
+        DM_Net *net;
+        uint32_t max_batch_size;
+        std::chrono::microseconds max_wait;
+
+        std::deque<DM_Inference_Request *> pending_requests;
+        std::mutex requests_mutex;
+        std::condition_variable requests_cond;
+        bool stopped = false;
+        std::thread dispatcher;
+
+        DM_Latency_Histogram latency_histogram; //submit to result, per request
+        DM_Latency_Histogram forward_histogram; //forward of a batch
+        uint64_t num_batches = 0;
+        uint64_t num_batched_requests = 0;
+
+        void dispatcher_loop();
+        void run_batch(std::vector<DM_Inference_Request *> &batch);
+    public:
+        DM_Inference_Server(DM_Net *net, uint32_t max_batch_size, uint32_t max_wait_us);
+        //pending requests are answered with NULL
+        ~DM_Inference_Server();
+
+        /*
+         * Takes the ownership of input (one frame of GetInputShapes())
+         * The future gives the cpu result of the frame (owned by the caller), or NULL if the inference failed
+         */
+        std::future<DM_Blob *> Submit(DM_Blob *input);
+
+        DM_Latency_Histogram &GetLatencyHistogram() {
+            return this->latency_histogram;
+        }
+        DM_Latency_Histogram &GetForwardHistogram() {
+            return this->forward_histogram;
+        }
+        double GetMeanBatchSize();
+    };
+}
+
+#endif
@@ -12,6 +12,13 @@ namespace deepmon {
 
 #define KERNEL_DM_CONV_BASE             "dm_conv_base"
 #define KERNEL_DM_CONV_LOCAL            "dm_conv_local"
+#define KERNEL_DM_CONV_LOCAL_MAXPOOL    "dm_conv_local_maxpool2x2"
+
+#define KERNEL_GROUPED_CONV             "grouped_conv"
+
+#define KERNEL_WINOGRAD_INPUT_TRANSFORM     "winograd_input_transform"
+#define KERNEL_WINOGRAD_BATCHED_GEMM        "winograd_batched_gemm"
+#define KERNEL_WINOGRAD_OUTPUT_TRANSFORM    "winograd_output_transform"
 
 #define KERNEL_DM_FC_BASE                  "fc_base"
 
@@ -24,6 +31,8 @@ namespace deepmon {
 #define KERNEL_ACTIVATE_RELU            "activate_relu"
 #define KERNEL_ACTIVATE_TANH            "activate_tanh"
 #define KERNEL_ACTIVATE_SIGMOID         "activate_sigmoid"
+#define KERNEL_BIAS_ACTIVATE            "bias_activate"
+#define KERNEL_BIAS_ACTIVATE_MAXPOOL    "bias_activate_maxpool2x2"
 }
 
 #endif
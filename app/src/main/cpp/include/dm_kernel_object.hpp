@@ -3,18 +3,44 @@
 
 #include "CL/cl.h"
 
+//VWM of common.cl when a kernel is compiled without -DVWM
+#define DEFAULT_VECTOR_WIDTH    4
+
 namespace deepmon {
     class DM_Kernel_Object {
     private:
         cl_kernel kernel;
+        unsigned int vector_width;
+        //launch limits of the kernel on its device
+        size_t max_work_group_size = 0;
+        size_t preferred_work_group_multiple = 1;
 
     public:
         DM_Kernel_Object(cl_kernel kernel) {
             this->kernel = kernel;
+            this->vector_width = DEFAULT_VECTOR_WIDTH;
+        }
+        DM_Kernel_Object(cl_kernel kernel, cl_device_id device, unsigned int vector_width) {
+            this->kernel = kernel;
+            this->vector_width = vector_width;
+            clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                     sizeof(this->max_work_group_size), &this->max_work_group_size, NULL);
+            clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                     sizeof(this->preferred_work_group_multiple), &this->preferred_work_group_multiple, NULL);
         }
         cl_kernel get_kernel() {
             return this->kernel;
         }
+        unsigned int get_vector_width() {
+            return this->vector_width;
+        }
+        //0 if unknown
+        size_t get_max_work_group_size() {
+            return this->max_work_group_size;
+        }
+        size_t get_preferred_work_group_multiple() {
+            return this->preferred_work_group_multiple;
+        }
     };
 }
 
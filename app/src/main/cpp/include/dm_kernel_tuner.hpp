@@ -0,0 +1,44 @@
+#ifndef DM_KERNEL_TUNER_HPP
+#define DM_KERNEL_TUNER_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TUNING_RUNS             3   //timed launches of every candidate, after one warm-up launch
+#define DEFAULT_TUNING_FILE     "tuning.dm"
+
+namespace deepmon {
+    typedef struct {
+        unsigned int vector_width; //VWM the kernel is compiled with
+        std::vector<size_t> local_size; //empty: chosen by the driver
+    } DM_Launch_Params;
+
+    //candidates of one launch, every vector width is tried with every local size, the first ones are the defaults
+    typedef struct {
+        std::vector<unsigned int> vector_widths;
+        std::vector<std::vector<size_t> > local_sizes;
+    } DM_Tuning_Space;
+
+    /*
+     * Database of tuned launch parameters, keyed by kernel, precision and the geometry of the launch
+     * The file is only valid for the device (and driver) it was written on, others start from an empty database
+     */
+    class DM_Kernel_Tuner {
+    private:
+        std::mutex tuner_mutex;
+        std::string path; //empty: the database is not persisted
+        std::string device_signature;
+        std::map<std::string, DM_Launch_Params> tuned_params;
+        bool is_modified = false;
+    public:
+        void Open(std::string path, std::string device_signature);
+        bool Find(std::string key, DM_Launch_Params *params);
+        void Store(std::string key, DM_Launch_Params params);
+        //writes the database if it changed since it was opened
+        void Save();
+    };
+}
+
+#endif
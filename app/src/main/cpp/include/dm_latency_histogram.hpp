@@ -0,0 +1,89 @@
+#ifndef DM_LATENCY_HISTOGRAM_HPP
+#define DM_LATENCY_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <algorithm>
+
+//8 linear steps per power of two: about 12% resolution from 16 us up to 2^32 us
+#define LATENCY_HISTOGRAM_STEPS         8
+#define LATENCY_HISTOGRAM_BUCKETS       (16 + 28 * LATENCY_HISTOGRAM_STEPS)
+
+namespace deepmon {
+    //thread-safe log-linear histogram of latencies in microseconds
+    class DM_Latency_Histogram {
+    private:
+        uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS] = {0};
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+        uint64_t max_us = 0;
+        std::mutex histogram_mutex;
+
+        static uint32_t get_bucket(uint64_t us) {
+            if(us < 16)
+                return (uint32_t)us;
+            uint32_t exponent = 63 - __builtin_clzll(us);
+            if(exponent > 31)
+                return LATENCY_HISTOGRAM_BUCKETS - 1;
+            uint32_t step = (uint32_t)(us >> (exponent - 3)) & (LATENCY_HISTOGRAM_STEPS - 1);
+            return 16 + (exponent - 4) * LATENCY_HISTOGRAM_STEPS + step;
+        }
+        //smallest latency of a bucket
+        static uint64_t get_bucket_start(uint32_t bucket) {
+            if(bucket < 16)
+                return bucket;
+            uint32_t exponent = (bucket - 16) / LATENCY_HISTOGRAM_STEPS + 4;
+            uint32_t step = (bucket - 16) % LATENCY_HISTOGRAM_STEPS;
+            return ((uint64_t)(LATENCY_HISTOGRAM_STEPS + step)) << (exponent - 3);
+        }
+    public:
+        void Record(uint64_t us) {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            buckets[get_bucket(us)]++;
+            count++;
+            sum_us += us;
+            if(us > max_us)
+                max_us = us;
+        }
+        //latency under which percentile (0 - 100) of the records are, 0 if nothing was recorded
+        uint64_t GetPercentile(double percentile) {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            if(count == 0)
+                return 0;
+
+            uint64_t rank = (uint64_t)(percentile / 100.0 * count);
+            if(rank >= count)
+                return max_us;
+            uint64_t seen = 0;
+            for(uint32_t i = 0 ; i < LATENCY_HISTOGRAM_BUCKETS ; i++) {
+                seen += buckets[i];
+                //upper bound of the bucket
+                if(seen > rank)
+                    return (i + 1 < LATENCY_HISTOGRAM_BUCKETS) ? std::min(get_bucket_start(i + 1), max_us) : max_us;
+            }
+            return max_us;
+        }
+        uint64_t GetCount() {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            return count;
+        }
+        double GetMean() {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            return (count > 0) ? (double)sum_us / count : 0;
+        }
+        uint64_t GetMax() {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            return max_us;
+        }
+        void Reset() {
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            for(uint32_t i = 0 ; i < LATENCY_HISTOGRAM_BUCKETS ; i++)
+                buckets[i] = 0;
+            count = 0;
+            sum_us = 0;
+            max_us = 0;
+        }
+    };
+}
+
+#endif
@@ -18,6 +18,7 @@ namespace deepmon {
             this->bottom_layers = bottom_layers;
             this->mem_layout = mem_layout;
         }
+        virtual ~DM_Layer() {}
 
         bool IsCorrupted() {
             return corrupted;
@@ -39,6 +40,68 @@ namespace deepmon {
         }
         vector<uint32_t> GetOutputShapes() {
             return vector<uint32_t>(output_shapes);
+        }
+        ENVIRONMENT_TYPE GetEnvironment() {
+            return this->env;
+        }
+        PRESICION_TYPE GetPrecision() {
+            return this->precision;
+        }
+        MEMORY_LAYOUT GetMemoryLayout() {
+            return this->mem_layout;
+        }
+        /*
+         * Layers which forward (one of) their inputs as output instead of producing a new blob
+         * DM_Net's memory planner does not reserve memory for them
+         */
+        virtual bool IsOutputAliasingInput() {
+            return false;
+        }
+        /*
+         * Element-wise layers which can write their output into their input blob when no other layer reads it
+         * DM_Net's memory planner gives them the slot of their input in that case
+         */
+        virtual bool IsInPlaceCapable() {
+            return false;
+        }
+        void SetPlannedOutput(DM_Blob *blob) {
+            this->planned_output = blob;
+        }
+        DM_Blob *GetPlannedOutput() {
+            return this->planned_output;
+        }
+        bool IsFusionAllowed() {
+            return this->fusion_allowed;
+        }
+        void SetFusionAllowed(bool is_allowed) {
+            this->fusion_allowed = is_allowed;
+        }
+        //gpu kernels are compiled for the exact geometry of the layer, see GEOMETRY in common.cl
+        bool IsSpecializingKernels() {
+            return this->specialize_kernels;
+        }
+        void SetSpecializingKernels(bool is_specializing) {
+            this->specialize_kernels = is_specializing;
+        }
+        /*
+         * Hooks of DM_Net's fusion pass, a layer returns true if it absorbed the operation
+         * FuseActivation: apply the activation to the output of this layer
+         * FuseMaxPool2x2: apply a 2x2 max-pooling with stride 2 and no padding to the output of this layer
+         */
+        virtual bool FuseActivation(int activation_type, float activation_threshold) {
+            return false;
+        }
+        virtual bool FuseMaxPool2x2() {
+            return false;
+        }
+        /*
+         * Hook of DM_Net's automatic placement, called before the weights are loaded
+         * A layer returns false and keeps its placement if it has no kernel for env and precision
+         */
+        virtual bool SetPlacement(ENVIRONMENT_TYPE env, PRESICION_TYPE precision) {
+            this->env = env;
+            this->precision = (env == ENVIRONMENT_GPU) ? precision : PRECISION_32;
+            return true;
         }
 		virtual void LoadWeights() = 0;
         virtual void PrintInfo() = 0;
@@ -47,9 +110,34 @@ namespace deepmon {
         void AppendTopLayer(string layer_name) {
             top_layers.push_back(layer_name);
         }
+        void SetTopLayers(vector<string> layer_names) {
+            this->top_layers = layer_names;
+        }
+        void SetBottomLayers(vector<string> layer_names) {
+            this->bottom_layers = layer_names;
+        }
+        void ReplaceTopLayer(string old_name, string new_name) {
+            for(int i = 0 ; i < top_layers.size() ; i++) {
+                if(top_layers.at(i) == old_name)
+                    top_layers[i] = new_name;
+            }
+        }
+        void ReplaceBottomLayer(string old_name, string new_name) {
+            for(int i = 0 ; i < bottom_layers.size() ; i++) {
+                if(bottom_layers.at(i) == old_name)
+                    bottom_layers[i] = new_name;
+            }
+        }
         void EnqueueInputBlob(DM_Blob *input) {
             this->input_queue.push(input);
         }
+        //releases the enqueued inputs without processing them, e.g. when a previous layer failed
+        void DropInputBlobs() {
+            while(!input_queue.empty()) {
+                release_input_blob(input_queue.front());
+                input_queue.pop();
+            }
+        }
         DM_Blob *Forward() {
             DM_Blob *result = NULL;
 
@@ -58,7 +146,9 @@ namespace deepmon {
                 DM_Blob *input = input_queue.front();
                 input_queue.pop();
 
-                if(this->env != input->get_env()) {
+                //gpu layers of different precisions do not share blobs either
+                if(this->env != input->get_env() ||
+                   (this->env == ENVIRONMENT_GPU && this->precision != input->get_precision())) {
                     //convert to correct environment
                     DM_Blob *converted_input = NULL;
                     if(this->env == ENVIRONMENT_CPU)
@@ -66,11 +156,12 @@ namespace deepmon {
                     else if(this->env == ENVIRONMENT_GPU)
                         converted_input = input->CovnertToGpuBlob(this->precision);
 
-                    if(!input->is_persistent_blob()) {
-                        delete input;
-                    }
+                    release_input_blob(input);
 
+                    //the converted copy is only read by this layer
                     input = converted_input;
+                    if(input != NULL)
+                        input->add_consumers(1);
                 }
 
                 input_blobs.push_back(input);
@@ -87,17 +178,22 @@ namespace deepmon {
                 return NULL;
             }
 
-            //delete inputs
+            /*
+             * Consumers of the result are the top layers, or DM_Net if this layer is an output of the network
+             * They are counted before the inputs are released so that a result which reuses an input survives
+             */
+            if(result != NULL) {
+                result->add_consumers(top_layers.size() > 0 ? top_layers.size() : 1);
+                if(this->persistant_blobs)
+                    result->set_pinned(true);
+            }
+
+            //release inputs, the last consumer deletes them
             for(int i = 0 ; i < input_blobs.size() ; i++) {
-                DM_Blob *input = input_blobs[i];
-                if(!input->is_persistent_blob())
-                    delete input;
+                release_input_blob(input_blobs[i]);
             }
             input_blobs.clear();
 
-            if(this->persistant_blobs)
-                result->set_persistent(true);
-
             return result;
         }
 	protected:
@@ -105,6 +201,8 @@ namespace deepmon {
         string type;
         bool persistant_blobs = false;
         bool corrupted = false;
+        bool fusion_allowed = true;
+        bool specialize_kernels = false;
         vector<string> bottom_layers;
         vector<string> top_layers;
 		ENVIRONMENT_TYPE env = ENVIRONMENT_CPU;
@@ -113,6 +211,30 @@ namespace deepmon {
         vector<vector<uint32_t>> inputs_shapes; //only used in some layers
         vector<uint32_t> output_shapes;
         queue<DM_Blob *> input_queue;
+        DM_Blob *planned_output = NULL; //slot assigned by DM_Net's memory planner
+        /*
+         * An input can be overwritten by this layer (in-place execution) only if no other layer reads it
+         * Pinned blobs (memory plan) are only reusable if the planner gave the same slot to this layer
+         * Read-only blobs (views on the caller's input) never are
+         */
+        bool IsInputReusable(DM_Blob *input) {
+            if(input->get_num_consumers() != 1 || input->is_read_only())
+                return false;
+            return !input->is_pinned() || input == this->planned_output || IsOutputAliasingInput();
+        }
+        void release_input_blob(DM_Blob *input) {
+            if(input != NULL && input->release_consumer())
+                delete input;
+        }
+        /*
+         * Output blobs should be created through this function
+         * so that the slot reserved by the memory plan is reused instead of allocating new memory
+         */
+        DM_Blob *CreateOutputBlob(vector<uint32_t> shapes) {
+            if(this->planned_output != NULL && this->planned_output->get_shapes() == shapes)
+                return this->planned_output;
+            return new DM_Blob(shapes, this->env, this->precision, NULL);
+        }
         virtual DM_Blob *ForwardCpu(vector<DM_Blob *> blobs) = 0;
         virtual DM_Blob *ForwardGpu(vector<DM_Blob *> blobs) = 0;
 	};
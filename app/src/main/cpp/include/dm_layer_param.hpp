@@ -19,6 +19,7 @@ namespace deepmon {
         string weights_path;
         vector<string> inputs;
         bool persistent_blobs = false;
+        bool fusion_allowed = true;
     public:
         DM_Layer_Param(string name, string type, string model_dir_path, \
                                 string conf_path, string weights_path, vector<string> inputs, \
@@ -54,6 +55,12 @@ namespace deepmon {
         bool IsUsingPersistentBlobs() {
             return persistent_blobs;
         }
+        bool IsFusionAllowed() {
+            return fusion_allowed;
+        }
+        void SetFusionAllowed(bool is_allowed) {
+            this->fusion_allowed = is_allowed;
+        }
         void PrintLayerParam() {
             LOGD("Layer's Name: %s", name.c_str());
             LOGD("\tTYPE: %s", type.c_str());
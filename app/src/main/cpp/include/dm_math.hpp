@@ -0,0 +1,23 @@
+#ifndef DM_MATH_HPP
+#define DM_MATH_HPP
+
+#include <cstdint>
+
+namespace deepmon {
+    /*
+     * Vectorized element-wise math of the CPU engine, in and out may be the same buffer
+     * exp is a polynomial approximation (relative error ~1e-7 in [-87, 88], clamped outside),
+     * sigmoid and tanh are derived from it (absolute error ~2e-7)
+     */
+    void dm_relu(const float *in, float *out, uint32_t n);
+    void dm_leaky_relu(const float *in, float *out, uint32_t n, float negative_slope);
+    void dm_exp(const float *in, float *out, uint32_t n);
+    void dm_sigmoid(const float *in, float *out, uint32_t n);
+    void dm_tanh(const float *in, float *out, uint32_t n);
+    //any ACTIVATION_* type, ACTIVATION_NONE only copies
+    void dm_activate(const float *in, float *out, uint32_t n, int activation_type, float negative_slope);
+    //softmax over n items, the max and the normalizer are found in a single pass
+    void dm_softmax(const float *in, float *out, uint32_t n);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef DM_MEMORY_PLANNER_HPP
+#define DM_MEMORY_PLANNER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace deepmon {
+    /*
+     * Static planner for one memory arena.
+     * Every tensor is described by its size and the interval of pipeline steps [first_use, last_use]
+     * in which it has to stay alive. Tensors whose intervals overlap never share memory,
+     * so the arena only needs to hold the maximum live set instead of the sum of all tensors.
+     */
+    class DM_Memory_Planner {
+    private:
+        typedef struct {
+            size_t size;
+            int first_use;
+            int last_use;
+            size_t offset;
+        } DM_Planned_Tensor;
+
+        std::vector<DM_Planned_Tensor> tensors;
+        size_t arena_size = 0;
+        size_t total_size = 0;
+        bool planned = false;
+    public:
+        int AddTensor(size_t size, int first_use, int last_use);
+        void Plan(size_t alignment);
+        size_t GetOffset(int tensor_id) {
+            return tensors.at(tensor_id).offset;
+        }
+        size_t GetArenaSize() {
+            return arena_size;
+        }
+        size_t GetTotalTensorsSize() {
+            return total_size;
+        }
+        uint32_t GetNumTensors() {
+            return tensors.size();
+        }
+        bool IsPlanned() {
+            return planned;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef DM_MEMORY_POOL_HPP
+#define DM_MEMORY_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <mutex>
+#include "dm_common.hpp"
+
+#define DEFAULT_MEMORY_POOL_LIMIT       (64 * 1024 * 1024) //bytes kept on the free lists of one engine
+
+namespace deepmon {
+    typedef struct {
+        uint64_t hits;
+        uint64_t misses;
+        size_t bytes_held;
+        uint32_t buffers_held;
+    } DM_Memory_Pool_Stats;
+
+    /*
+     * Recycling pool for the buffers of one execution engine.
+     * Requests are rounded up to a size class (4 classes per power of two, at least 256 bytes)
+     * and freed buffers are kept on a free list per (size class, precision) instead of being released.
+     * T is the buffer handle (float * on CPU, cl_mem on GPU), release_fn really frees one buffer.
+     */
+    template <typename T>
+    class DM_Memory_Pool {
+    private:
+        typedef std::pair<size_t, PRESICION_TYPE> DM_Pool_Key;
+
+        std::map<DM_Pool_Key, std::vector<T> > free_lists;
+        void (*release_fn)(T buffer);
+        size_t max_bytes_held;
+        DM_Memory_Pool_Stats stats;
+        std::mutex pool_mutex;
+
+        //release buffers, biggest size classes first, until at most keep_bytes are held
+        void trim_locked(size_t keep_bytes) {
+            typename std::map<DM_Pool_Key, std::vector<T> >::reverse_iterator it = free_lists.rbegin();
+            while(stats.bytes_held > keep_bytes && it != free_lists.rend()) {
+                std::vector<T> &buffers = it->second;
+                while(stats.bytes_held > keep_bytes && !buffers.empty()) {
+                    release_fn(buffers.back());
+                    buffers.pop_back();
+                    stats.bytes_held -= it->first.first;
+                    stats.buffers_held--;
+                }
+                it++;
+            }
+        }
+    public:
+        DM_Memory_Pool(void (*release_fn)(T buffer), size_t max_bytes_held) {
+            this->release_fn = release_fn;
+            this->max_bytes_held = max_bytes_held;
+            this->stats.hits = 0;
+            this->stats.misses = 0;
+            this->stats.bytes_held = 0;
+            this->stats.buffers_held = 0;
+        }
+        ~DM_Memory_Pool() {
+            Trim(0);
+        }
+
+        static size_t GetSizeClass(size_t size_in_bytes) {
+            size_t size_class = 256;
+            while(size_class < size_in_bytes) {
+                size_class <<= 1;
+            }
+            if(size_class <= 256)
+                return size_class;
+
+            //split [size_class / 2, size_class] into 4 steps
+            size_t step = size_class >> 3;
+            size_t result = size_class >> 1;
+            while(result < size_in_bytes) {
+                result += step;
+            }
+            return result;
+        }
+
+        /*
+         * Returns a buffer of exactly size_class bytes from the free list, or false if the caller
+         * has to allocate a new one.
+         */
+        bool Acquire(size_t size_class, PRESICION_TYPE precision, T *buffer) {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            typename std::map<DM_Pool_Key, std::vector<T> >::iterator it = free_lists.find(DM_Pool_Key(size_class, precision));
+            if(it == free_lists.end() || it->second.empty()) {
+                stats.misses++;
+                return false;
+            }
+
+            *buffer = it->second.back();
+            it->second.pop_back();
+            stats.hits++;
+            stats.bytes_held -= size_class;
+            stats.buffers_held--;
+            return true;
+        }
+
+        void Release(T buffer, size_t size_class, PRESICION_TYPE precision) {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if(size_class > max_bytes_held) {
+                release_fn(buffer);
+                return;
+            }
+
+            free_lists[DM_Pool_Key(size_class, precision)].push_back(buffer);
+            stats.bytes_held += size_class;
+            stats.buffers_held++;
+
+            if(stats.bytes_held > max_bytes_held)
+                trim_locked(max_bytes_held);
+        }
+
+        void Trim(size_t keep_bytes) {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            trim_locked(keep_bytes);
+        }
+
+        void SetMaxBytesHeld(size_t max_bytes_held) {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            this->max_bytes_held = max_bytes_held;
+            trim_locked(max_bytes_held);
+        }
+
+        DM_Memory_Pool_Stats GetStats() {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            return stats;
+        }
+    };
+}
+
+#endif
@@ -3,6 +3,10 @@
 
 #include "dm_net_parameter.hpp"
 #include "dm_layer.hpp"
+#include "dm_spsc_queue.hpp"
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 namespace deepmon {
@@ -12,11 +16,138 @@ namespace deepmon {
         map<string, DM_Layer *> name_to_layer_map;
         vector<DM_Layer *> pipeline;
         bool is_working = true;
+
+        /*
+         * Static memory plan of intermediate blobs, made for the largest batch size seen so far
+         * Smaller batches run in views of the same arenas, the views of every batch size are kept (planned_views)
+         */
+        bool is_planning_memory = false;
+        uint32_t planned_batch_size = 0;
+        float *cpu_arena = NULL;
+        cl_mem gpu_arena = NULL;
+        vector<int> planned_roots; //layer owning the slot of each layer's output, -1 if not planned
+        vector<int64_t> planned_offsets; //offset of each slot in its arena, -1 if the layer owns no slot
+        map<uint32_t, vector<DM_Blob *> > planned_views; //batch size -> planned output of each layer
+        vector<DM_Blob *> planned_blobs;
+        vector<cl_mem> planned_sub_buffers;
+        void plan_memory(uint32_t batch_size);
+        void use_memory_plan(uint32_t batch_size);
+        void release_memory_plan();
+
+        DM_Layer *create_layer(DM_Layer_Param &param);
+        //layers, their queues and the memory plan are shared by all forwards, callers on other threads wait here
+        std::mutex forward_mutex;
+        DM_Blob *run_pipeline(DM_Blob *input_blob);
+
+        /*
+         * Automatic placement: every layer is timed on each engine and precision, the plan minimizing
+         * the latency of the pipeline (conversions between engines included) is stored for later loads
+         */
+        typedef struct {
+            ENVIRONMENT_TYPE env;
+            PRESICION_TYPE precision;
+        } DM_Net_Placement;
+
+        void place_layers(DM_Net_Parameter *net_param);
+        bool calibrate_placement(DM_Net_Parameter *net_param, map<string, DM_Net_Placement> &placements);
+        bool read_placement(string path, map<string, DM_Net_Placement> &placements);
+        void write_placement(string path, map<string, DM_Net_Placement> &placements);
+        double time_layer(DM_Layer_Param &param, DM_Net_Placement placement, vector<vector<uint32_t> > inputs_shapes);
+        double time_conversion(vector<uint32_t> shapes, DM_Net_Placement from, DM_Net_Placement to);
+
+        /*
+         * Queue scheduling: runs of layers belonging to independent branches (e.g. the towers of an inception block)
+         * are forked over the gpu queues, the queues are joined again before the next layer outside the run
+         * layer_queues[i] is the queue of pipeline layer i inside a run, -1 outside
+         */
+        vector<int> layer_queues;
+        vector<pair<int, int> > parallel_regions; //pipeline indices [first, last] of every run
+        void schedule_queues();
+
+        //one forward on synthetic data with the gpu engine tuning every launch it has no parameters for
+        void tune_kernels();
+
+        //graph optimization
+        void fuse_layers();
+        DM_Layer *get_fusable_top_layer(DM_Layer *layer);
+        void merge_top_into_layer(DM_Layer *layer, DM_Layer *top_layer);
+        void merge_layer_into_top(DM_Layer *layer, DM_Layer *top_layer);
+        void remove_layer(DM_Layer *layer);
+
+        /*
+         * Streaming mode: the pipeline is cut into stages wherever the environment changes
+         * Every stage runs on its own thread, frames travel between stages through bounded lock-free queues
+         */
+        typedef struct {
+            DM_Blob *input; //consumed by the first stage
+            vector<pair<int, DM_Blob *> > pending_blobs; //(pipeline index of the consumer, blob) for layers of later stages
+            DM_Blob *result; //cpu blob, set by the last stage
+            bool failed;
+        } DM_Net_Frame;
+
+        typedef struct {
+            int first_layer; //pipeline indices [first_layer, last_layer)
+            int last_layer;
+            ENVIRONMENT_TYPE env;
+        } DM_Net_Stage;
+
+        vector<DM_Net_Stage> stages;
+        vector<int> layer_to_stage;
+        map<string, int> name_to_pipeline_idx;
+        //stage_queues[i] feeds stage i, the last queue holds finished frames
+        vector<DM_SPSC_Queue<DM_Net_Frame *> *> stage_queues;
+        vector<std::thread> stage_threads;
+        std::atomic<bool> is_streaming{false};
+        std::atomic<bool> stop_streaming{false};
+        vector<DM_Blob *> saved_planned_outputs;
+        void build_stages();
+        void stage_loop(int stage_idx);
+        void run_stage(int stage_idx, DM_Net_Frame *frame);
+        void drop_frame(DM_Net_Frame *frame);
     protected:
     public:
         DM_Net(string model_dir_path);
 
+        /*
+         * Takes the ownership of blob, the returned cpu blob belongs to the caller
+         * The batch size (first dimension of blob) may change from one call to the next,
+         * the result holds one output per input: GetOutputShapes(batch size)
+         * Thread-safe, concurrent calls run one after the other
+         */
         DM_Blob *Forward(DM_Blob *blob);
+        //same, the result is written into output (GetOutputSize(batch size) floats) instead of a new blob
+        bool Forward(DM_Blob *blob, float *output);
+
+        /*
+         * Input blob reading data (GetInputShapes(batch_size)) in place: a cpu view if the data layer runs on the cpu,
+         * a gpu buffer using data if it is aligned for the device, a copy otherwise
+         * data has to stay valid until the forward consuming the blob returns
+         */
+        DM_Blob *CreateInputView(float *data, uint32_t batch_size);
+        ENVIRONMENT_TYPE GetInputEnvironment() {
+            return pipeline.at(0)->GetEnvironment();
+        }
+        MEMORY_LAYOUT GetInputLayout() {
+            return pipeline.at(0)->GetMemoryLayout();
+        }
+
+        /*
+         * Streaming API, Forward is not available while streaming
+         * Submit takes the ownership of blob, it returns false (and the caller keeps the blob) if the first stage is full
+         * Poll returns true when a frame is finished, frames finish in submission order
+         * *result is the cpu blob of that frame (owned by the caller), or NULL if the frame failed
+         * Submit and Poll may be called from two different threads, but not concurrently with themselves
+         */
+        bool StartStreaming(uint32_t queue_capacity);
+        void StopStreaming();
+        bool Submit(DM_Blob *blob);
+        bool Poll(DM_Blob **result);
+        bool IsStreaming() {
+            return this->is_streaming;
+        }
+        uint32_t GetNumStages() {
+            return this->stages.size();
+        }
 
         bool IsWorking() {
             if(!is_working)
@@ -45,16 +176,16 @@ namespace deepmon {
             }
         }
 
-        vector<uint32_t> GetInputShapes() {
+        vector<uint32_t> GetInputShapes(uint32_t batch_size = 1) {
             vector<uint32_t> shapes;
-            shapes.push_back(1);
+            shapes.push_back(batch_size);
             vector<uint32_t> input_shapes = pipeline.at(0)->GetOutputShapes();
             for(int i = 0 ; i < input_shapes.size() ; i++)
                 shapes.push_back(input_shapes.at(i));
             return shapes;
         }
 
-        vector<uint32_t> GetOutputShapes() {
+        vector<uint32_t> GetOutputShapes(uint32_t batch_size = 1) {
 
             /*
              * FIXME: some models have multiple outputs
@@ -63,16 +194,16 @@ namespace deepmon {
              */
 
             vector<uint32_t> shapes;
-            shapes.push_back(1);
+            shapes.push_back(batch_size);
             vector<uint32_t> last_layer_shapes = pipeline.at(pipeline.size() - 1)->GetOutputShapes();
             for(int i = 0 ; i < last_layer_shapes.size() ; i++)
                 shapes.push_back(last_layer_shapes.at(i));
             return shapes;
         }
 
-        uint32_t GetOutputSize() {
+        uint32_t GetOutputSize(uint32_t batch_size = 1) {
             uint32_t size = 1;
-            vector<uint32_t> output_shapes = GetOutputShapes();
+            vector<uint32_t> output_shapes = GetOutputShapes(batch_size);
             for(int i = 0 ; i < output_shapes.size() ; i++)
                 size *= output_shapes.at(i);
             return size;
@@ -8,12 +8,23 @@
 
 #include <fstream>
 
+//plan of the automatic placement, relative to the model's directory
+#define DEFAULT_PLACEMENT_FILE      "placement.dm"
+
 using namespace std;
 namespace deepmon {
     class DM_Net_Parameter {
     private:
         bool persistent_blobs = false;
         bool use_dm_layout = false;
+        bool plan_memory = true;
+        bool fuse_layers = true;
+        bool multi_queue = true; //independent branches of the graph run on different gpu queues
+        int num_threads = 0; //threads of the cpu engine, 0 keeps the current setting
+        bool auto_placement = false; //layers are placed by DM_Net's calibration instead of USE_GPU/USE_HALF
+        bool tune_kernels = false; //launch parameters missing from the gpu engine's tuning database are tuned at load
+        bool specialize_kernels = false; //conv and pooling kernels are compiled per layer geometry
+        string placement_path;
         uint32_t num_layers = -1;
         vector<string> layer_names;
         map<string, DM_Layer_Param *> layer_names_to_layer_params;
@@ -28,6 +39,14 @@ namespace deepmon {
 
             this->use_dm_layout = net["USE_DM_LAYOUT"].asBool();
             this->persistent_blobs = net["PERSISTENT_BLOBS"].asBool();
+            this->plan_memory = net.get("PLAN_MEMORY", true).asBool();
+            this->fuse_layers = net.get("FUSE_LAYERS", true).asBool();
+            this->multi_queue = net.get("MULTI_QUEUE", true).asBool();
+            this->num_threads = net.get("NUM_THREADS", 0).asInt();
+            this->auto_placement = net["AUTO_PLACEMENT"].asBool();
+            this->tune_kernels = net["TUNE_KERNELS"].asBool();
+            this->specialize_kernels = net["SPECIALIZE_KERNELS"].asBool();
+            this->placement_path = net_dir_path + "/" + net.get("PLACEMENT_FILE", DEFAULT_PLACEMENT_FILE).asString();
 
             for (Json::Value::iterator it = net["LAYERS"].begin(); it != net["LAYERS"].end(); ++it) {
                 string name((*it)["name"].asString());
@@ -47,6 +66,8 @@ namespace deepmon {
                 layer_names.push_back(name);
 
                 DM_Layer_Param * layer_param = new DM_Layer_Param(name, type, net_dir_path, conf_path, w_path, inputs, use_dm_layout, persistent_blobs);
+                //"no_fusion": true keeps the layer out of DM_Net's fusion pass
+                layer_param->SetFusionAllowed(!(*it)["no_fusion"].asBool());
 
                 pair<string, DM_Layer_Param*> pair(name, layer_param);
                 layer_names_to_layer_params.insert(pair);
@@ -86,6 +107,30 @@ namespace deepmon {
         bool IsUsingPersitentBlobs() {
             return this->persistent_blobs;
         }
+        bool IsPlanningMemory() {
+            return this->plan_memory;
+        }
+        bool IsFusingLayers() {
+            return this->fuse_layers;
+        }
+        bool IsUsingMultipleQueues() {
+            return this->multi_queue;
+        }
+        int GetNumThreads() {
+            return this->num_threads;
+        }
+        bool IsAutoPlacing() {
+            return this->auto_placement;
+        }
+        bool IsTuningKernels() {
+            return this->tune_kernels;
+        }
+        bool IsSpecializingKernels() {
+            return this->specialize_kernels;
+        }
+        string GetPlacementPath() {
+            return this->placement_path;
+        }
         void PrintNet() {
             if(!IsCorrupted()) {
                 LOGD("Network");
@@ -0,0 +1,46 @@
+#ifndef DM_PROGRAM_CACHE_HPP
+#define DM_PROGRAM_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <CL/cl.h>
+#include "dm_common.hpp"
+
+#define PROGRAM_CACHE_MAGIC         0x42504d44 //"DMPB"
+#define PROGRAM_CACHE_VERSION       1
+#define PROGRAM_CACHE_FILE_PREFIX   "dm_program_"
+
+namespace deepmon {
+    /*
+     * On-disk cache of compiled OpenCL programs.
+     * One file per program, named after a hash of the device signature (name, OpenCL version, driver version),
+     * the build options and the full source. The key itself is stored in the file as well, so hash collisions
+     * and files of other devices or drivers are rejected and the caller compiles from source again.
+     * An empty directory disables the cache.
+     */
+    class DM_Program_Cache {
+    private:
+        std::string cache_dir;
+
+        static uint64_t hash(std::string data);
+        static std::string get_key(std::string device_signature, std::string source, std::string build_args);
+        std::string get_path(std::string key);
+    public:
+        DM_Program_Cache() {}
+        DM_Program_Cache(std::string cache_dir) {
+            this->cache_dir = cache_dir;
+        }
+        bool IsEnabled() {
+            return !this->cache_dir.empty();
+        }
+
+        //program built from the cached binary, NULL if there is no valid entry
+        cl_program Load(cl_context context, cl_device_id device, std::string device_signature,
+                        std::string source, std::string build_args);
+        //stores the binary of a program built for device
+        void Store(cl_program program, cl_device_id device, std::string device_signature,
+                   std::string source, std::string build_args);
+    };
+}
+
+#endif
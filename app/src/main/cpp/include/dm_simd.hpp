@@ -0,0 +1,122 @@
+#ifndef DM_SIMD_HPP
+#define DM_SIMD_HPP
+
+/*
+ * Minimal float vector abstraction for the CPU kernels
+ * NEON on ARM, AVX2 or SSE2 on x86, plain floats otherwise
+ * DM_SIMD_WIDTH floats are processed at once, loads and stores are unaligned
+ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DM_SIMD_NEON
+#define DM_SIMD_WIDTH   4
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define DM_SIMD_AVX
+#define DM_SIMD_WIDTH   8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DM_SIMD_SSE
+#define DM_SIMD_WIDTH   4
+#else
+#define DM_SIMD_WIDTH   1
+#include <string.h>
+#endif
+
+namespace deepmon {
+#if defined(DM_SIMD_NEON)
+    typedef float32x4_t dm_simd_f;
+
+    inline dm_simd_f dm_simd_load(const float *p) { return vld1q_f32(p); }
+    inline void dm_simd_store(float *p, dm_simd_f v) { vst1q_f32(p, v); }
+    inline dm_simd_f dm_simd_set1(float x) { return vdupq_n_f32(x); }
+    inline dm_simd_f dm_simd_add(dm_simd_f a, dm_simd_f b) { return vaddq_f32(a, b); }
+    inline dm_simd_f dm_simd_mul(dm_simd_f a, dm_simd_f b) { return vmulq_f32(a, b); }
+    inline dm_simd_f dm_simd_max(dm_simd_f a, dm_simd_f b) { return vmaxq_f32(a, b); }
+    inline dm_simd_f dm_simd_sub(dm_simd_f a, dm_simd_f b) { return vsubq_f32(a, b); }
+    inline dm_simd_f dm_simd_min(dm_simd_f a, dm_simd_f b) { return vminq_f32(a, b); }
+    inline dm_simd_f dm_simd_div(dm_simd_f a, dm_simd_f b) {
+#if defined(__aarch64__)
+        return vdivq_f32(a, b);
+#else
+        //reciprocal estimate refined by two newton steps
+        float32x4_t r = vrecpeq_f32(b);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+#endif
+    }
+    //floor(x) for x > -128
+    inline dm_simd_f dm_simd_floor(dm_simd_f x) {
+        int32x4_t i = vcvtq_s32_f32(vaddq_f32(x, vdupq_n_f32(128.0f)));
+        return vsubq_f32(vcvtq_f32_s32(i), vdupq_n_f32(128.0f));
+    }
+    //2^n for integral n in [-127, 128)
+    inline dm_simd_f dm_simd_pow2(dm_simd_f n) {
+        int32x4_t i = vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127));
+        return vreinterpretq_f32_s32(vshlq_n_s32(i, 23));
+    }
+#elif defined(DM_SIMD_AVX)
+    typedef __m256 dm_simd_f;
+
+    inline dm_simd_f dm_simd_load(const float *p) { return _mm256_loadu_ps(p); }
+    inline void dm_simd_store(float *p, dm_simd_f v) { _mm256_storeu_ps(p, v); }
+    inline dm_simd_f dm_simd_set1(float x) { return _mm256_set1_ps(x); }
+    inline dm_simd_f dm_simd_add(dm_simd_f a, dm_simd_f b) { return _mm256_add_ps(a, b); }
+    inline dm_simd_f dm_simd_mul(dm_simd_f a, dm_simd_f b) { return _mm256_mul_ps(a, b); }
+    inline dm_simd_f dm_simd_max(dm_simd_f a, dm_simd_f b) { return _mm256_max_ps(a, b); }
+    inline dm_simd_f dm_simd_sub(dm_simd_f a, dm_simd_f b) { return _mm256_sub_ps(a, b); }
+    inline dm_simd_f dm_simd_min(dm_simd_f a, dm_simd_f b) { return _mm256_min_ps(a, b); }
+    inline dm_simd_f dm_simd_div(dm_simd_f a, dm_simd_f b) { return _mm256_div_ps(a, b); }
+    inline dm_simd_f dm_simd_floor(dm_simd_f x) { return _mm256_floor_ps(x); }
+    inline dm_simd_f dm_simd_pow2(dm_simd_f n) {
+        __m256i i = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(i, 23));
+    }
+#elif defined(DM_SIMD_SSE)
+    typedef __m128 dm_simd_f;
+
+    inline dm_simd_f dm_simd_load(const float *p) { return _mm_loadu_ps(p); }
+    inline void dm_simd_store(float *p, dm_simd_f v) { _mm_storeu_ps(p, v); }
+    inline dm_simd_f dm_simd_set1(float x) { return _mm_set1_ps(x); }
+    inline dm_simd_f dm_simd_add(dm_simd_f a, dm_simd_f b) { return _mm_add_ps(a, b); }
+    inline dm_simd_f dm_simd_mul(dm_simd_f a, dm_simd_f b) { return _mm_mul_ps(a, b); }
+    inline dm_simd_f dm_simd_max(dm_simd_f a, dm_simd_f b) { return _mm_max_ps(a, b); }
+    inline dm_simd_f dm_simd_sub(dm_simd_f a, dm_simd_f b) { return _mm_sub_ps(a, b); }
+    inline dm_simd_f dm_simd_min(dm_simd_f a, dm_simd_f b) { return _mm_min_ps(a, b); }
+    inline dm_simd_f dm_simd_div(dm_simd_f a, dm_simd_f b) { return _mm_div_ps(a, b); }
+    //floor(x) for x > -128
+    inline dm_simd_f dm_simd_floor(dm_simd_f x) {
+        __m128i i = _mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(128.0f)));
+        return _mm_sub_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(128.0f));
+    }
+    //2^n for integral n in [-127, 128)
+    inline dm_simd_f dm_simd_pow2(dm_simd_f n) {
+        __m128i i = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(i, 23));
+    }
+#else
+    typedef float dm_simd_f;
+
+    inline dm_simd_f dm_simd_load(const float *p) { return *p; }
+    inline void dm_simd_store(float *p, dm_simd_f v) { *p = v; }
+    inline dm_simd_f dm_simd_set1(float x) { return x; }
+    inline dm_simd_f dm_simd_add(dm_simd_f a, dm_simd_f b) { return a + b; }
+    inline dm_simd_f dm_simd_mul(dm_simd_f a, dm_simd_f b) { return a * b; }
+    inline dm_simd_f dm_simd_max(dm_simd_f a, dm_simd_f b) { return a > b ? a : b; }
+    inline dm_simd_f dm_simd_sub(dm_simd_f a, dm_simd_f b) { return a - b; }
+    inline dm_simd_f dm_simd_min(dm_simd_f a, dm_simd_f b) { return a < b ? a : b; }
+    inline dm_simd_f dm_simd_div(dm_simd_f a, dm_simd_f b) { return a / b; }
+    inline dm_simd_f dm_simd_floor(dm_simd_f x) {
+        return (float)((int)(x + 128.0f)) - 128.0f;
+    }
+    inline dm_simd_f dm_simd_pow2(dm_simd_f n) {
+        int i = ((int)n + 127) << 23;
+        float result;
+        memcpy(&result, &i, sizeof(float));
+        return result;
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DM_SPLIT_RATIO_HPP
+#define DM_SPLIT_RATIO_HPP
+
+#include <cstdint>
+#include <string>
+#include <json/json.h>
+
+#define SPLIT_RATIO_AUTO_STR            "AUTO"
+//first share of the cpu when the ratio is calibrated at runtime
+#define SPLIT_RATIO_AUTO_INITIAL        0.25f
+//frames measured by the calibration, the ratio is frozen afterwards
+#define SPLIT_RATIO_CALIBRATION_FRAMES  8
+
+namespace deepmon {
+    /*
+     * Share of the output channels (conv filters or fc neurons) of a GPU layer computed by the CPU engine
+     * Set by "CPU_SPLIT" in the layer's config: a ratio in (0, 1), or "AUTO" to start from SPLIT_RATIO_AUTO_INITIAL
+     * and move towards the ratio of the measured throughputs, so that both halves finish at the same time
+     */
+    class DM_Split_Ratio {
+    private:
+        float ratio = 0;
+        bool is_auto = false;
+        uint32_t num_calibrations = 0;
+    public:
+        void Parse(const Json::Value &value) {
+            if(value.isString() && !value.asString().compare(SPLIT_RATIO_AUTO_STR)) {
+                this->ratio = SPLIT_RATIO_AUTO_INITIAL;
+                this->is_auto = true;
+            } else if(value.isNumeric()) {
+                this->ratio = value.asFloat();
+            }
+
+            if(this->ratio <= 0 || this->ratio >= 1)
+                Disable();
+        }
+        bool IsEnabled() {
+            return ratio > 0;
+        }
+        void Disable() {
+            this->ratio = 0;
+            this->is_auto = false;
+        }
+        float GetRatio() {
+            return ratio;
+        }
+        //number of items given to the cpu, both engines always get at least one item
+        uint32_t GetCpuItems(uint32_t num_items) {
+            if(!IsEnabled() || num_items < 2)
+                return 0;
+            uint32_t cpu_items = (uint32_t)(num_items * ratio + 0.5f);
+            if(cpu_items < 1)
+                cpu_items = 1;
+            if(cpu_items > num_items - 1)
+                cpu_items = num_items - 1;
+            return cpu_items;
+        }
+        //feeds the timings of one forward pass, each new estimate is averaged with the current ratio to damp the noise
+        void Calibrate(uint32_t cpu_items, double cpu_ms, uint32_t gpu_items, double gpu_ms) {
+            if(!is_auto || num_calibrations >= SPLIT_RATIO_CALIBRATION_FRAMES || cpu_ms <= 0 || gpu_ms <= 0)
+                return;
+
+            double cpu_throughput = cpu_items / cpu_ms;
+            double gpu_throughput = gpu_items / gpu_ms;
+            this->ratio = (float)(0.5 * ratio + 0.5 * cpu_throughput / (cpu_throughput + gpu_throughput));
+            this->num_calibrations++;
+        }
+    };
+}
+
+#endif
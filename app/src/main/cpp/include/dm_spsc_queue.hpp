@@ -0,0 +1,52 @@
+#ifndef DM_SPSC_QUEUE_HPP
+#define DM_SPSC_QUEUE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+
+namespace deepmon {
+    /*
+     * Bounded lock-free ring buffer with a single producer and a single consumer thread.
+     * One slot stays empty to tell a full queue from an empty one.
+     */
+    template <typename T>
+    class DM_SPSC_Queue {
+    private:
+        std::vector<T> slots;
+        std::atomic<size_t> head; //next slot to pop, written by the consumer
+        std::atomic<size_t> tail; //next slot to push, written by the producer
+    public:
+        DM_SPSC_Queue(size_t capacity) : slots(capacity + 1) {
+            this->head = 0;
+            this->tail = 0;
+        }
+
+        bool TryPush(const T &item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t next = (t + 1) % slots.size();
+            if(next == head.load(std::memory_order_acquire))
+                return false;
+
+            slots[t] = item;
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPop(T *item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire))
+                return false;
+
+            *item = slots[h];
+            head.store((h + 1) % slots.size(), std::memory_order_release);
+            return true;
+        }
+
+        size_t GetCapacity() {
+            return slots.size() - 1;
+        }
+    };
+}
+
+#endif
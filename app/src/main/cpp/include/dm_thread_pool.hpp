@@ -0,0 +1,65 @@
+#ifndef DM_THREAD_POOL_HPP
+#define DM_THREAD_POOL_HPP
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace deepmon {
+    /*
+     * Work-stealing pool for the loops of the CPU layers.
+     * ParallelFor splits a range into chunks which are spread over one deque per thread,
+     * every thread pops from the back of its own deque and steals from the front of the others.
+     * The calling thread works as thread 0 until its job is done.
+     * A ParallelFor issued from inside a chunk runs inline, so nested loops never deadlock.
+     */
+    class DM_Thread_Pool {
+    private:
+        typedef struct {
+            const std::function<void(uint32_t, uint32_t)> *fn;
+            std::atomic<uint32_t> remaining;
+            std::mutex done_mutex;
+            std::condition_variable done_cond;
+        } DM_Thread_Pool_Job;
+
+        typedef struct {
+            DM_Thread_Pool_Job *job;
+            uint32_t begin;
+            uint32_t end;
+        } DM_Thread_Pool_Task;
+
+        typedef struct {
+            std::deque<DM_Thread_Pool_Task> tasks;
+            std::mutex queue_mutex;
+        } DM_Thread_Pool_Queue;
+
+        int num_threads;
+        std::vector<std::thread> workers;
+        std::vector<DM_Thread_Pool_Queue *> queues;
+        std::atomic<uint32_t> num_pending_tasks;
+        std::mutex wake_mutex;
+        std::condition_variable wake_cond;
+        bool stopped = false;
+
+        bool pop_task(int thread_idx, DM_Thread_Pool_Task *task);
+        void run_task(DM_Thread_Pool_Task &task);
+        void worker_loop(int thread_idx);
+    public:
+        DM_Thread_Pool(int num_threads);
+        ~DM_Thread_Pool();
+        int GetNumThreads() {
+            return this->num_threads;
+        }
+        //true if the calling thread is running a chunk of a ParallelFor
+        static bool IsInsideTask();
+        //calls fn(begin, end) on chunks of [0, n) of at least grain items, returns when all chunks are done
+        void ParallelFor(uint32_t n, uint32_t grain, const std::function<void(uint32_t, uint32_t)> &fn);
+    };
+}
+
+#endif
@@ -6,12 +6,6 @@
 
 using namespace std;
 
-#define ACTIVATION_RELU_STR                 "RELU"
-#define ACTIVATION_LEAKY_STR                "LEAKY"
-
-#define ACTIVATION_RELU                     0
-#define ACTIVATION_LEAKY                    1
-
 namespace deepmon {
     class DM_Layer_Activation : public DM_Layer {
     private:
@@ -21,9 +15,22 @@ namespace deepmon {
         void Activation_ReLU_GPU(DM_Blob *input, DM_Blob *output);
         void Activation_Leaky_CPU(DM_Blob *input, DM_Blob *output);
         void Activation_Leaky_GPU(DM_Blob *input, DM_Blob *output);
+        void Activation_Sigmoid_CPU(DM_Blob *input, DM_Blob *output);
+        void Activation_TanH_CPU(DM_Blob *input, DM_Blob *output);
+        //sigmoid and tanh share the same kernel arguments
+        void Activation_Unary_GPU(const char *kernel_name, DM_Blob *input, DM_Blob *output);
     public:
         DM_Layer_Activation(DM_Layer_Param &param);
         void LoadWeights() {}
+        bool IsInPlaceCapable() {
+            return true;
+        }
+        int GetActivationType() {
+            return this->activation_type;
+        }
+        float GetActivationThreshold() {
+            return this->activation_threshold;
+        }
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
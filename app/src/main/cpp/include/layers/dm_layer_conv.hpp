@@ -4,8 +4,18 @@
 #include <dm_layer_param.hpp>
 #include <dm_layer.hpp>
 #include <dm_common.hpp>
+#include <dm_split_ratio.hpp>
 #include <string>
 
+//max number of items of one block of transformed tiles (inputs or products), winograd processes the tiles block by block
+#define WINOGRAD_BLOCK_ITEMS            (1 << 20)
+//local size of winograd_batched_gemm, has to match WINOGRAD_GEMM_TILE in conv.cl
+#define WINOGRAD_GEMM_TILE              8
+//filter items staged in local memory by dm_conv_local, has to match LOCAL_WEIGHTS in conv.cl
+#define DEFAULT_LOCAL_WEIGHTS           (64 * 3 * 3)
+//bound of specialized builds, a 16 KB fp32 buffer
+#define MAX_LOCAL_WEIGHTS               4096
+
 using namespace std;
 
 namespace deepmon {
@@ -19,12 +29,18 @@ namespace deepmon {
         uint32_t pad_left = 0, pad_right = 0, pad_top = 0, pad_bottom = 0;
         uint32_t stride_w = 0, stride_h = 0;
         uint32_t dilation_h = 0, dilation_w = 0;
+        uint32_t groups = 1; //channels and filters are split into groups which are convolved separately
 
         bool has_bias = false;
         vector<uint32_t> filters_shapes;
         string weights_path;
-        DM_Blob *filters;
-        DM_Blob *biases;
+        DM_Blob *filters = NULL;
+        DM_Blob *biases = NULL;
+
+        //fused epilogue, applied right after the gemm
+        int activation_type = ACTIVATION_NONE;
+        float activation_threshold = 0; //negative slope of leaky activation
+        bool fused_maxpool = false; //2x2 max-pooling with stride 2 on the output
 
         uint32_t input_h = 0;
         uint32_t input_w = 0;
@@ -32,17 +48,77 @@ namespace deepmon {
         uint32_t output_h = 0;
         uint32_t output_w = 0;
 
+        //winograd
+        int conv_algorithm = CONV_ALGORITHM_AUTO; //resolved to IM2COL or WINOGRAD_* in LoadWeights
+        DM_Blob *winograd_filters = NULL; //transformed filters [alpha * alpha, num_filters, num_channels], on the engine of the layer
+
+        //sizes after the fused max-pooling
+        uint32_t pooled_h = 0;
+        uint32_t pooled_w = 0;
+
+        //heterogeneous execution: the gpu computes filters [0, gpu_num_filters), the cpu engine the remaining ones
+        DM_Split_Ratio cpu_split;
+        uint32_t gpu_num_filters = 0; //num_filters when the layer is not split
+        DM_Blob *split_filters = NULL; //cpu copies of the weights, used by the cpu part
+        DM_Blob *split_biases = NULL;
+
+        vector<uint32_t> get_conv_output_shapes(uint32_t batches);
+        //1x1 filters with stride 1 and no padding: im2col would be an exact copy of the input
+        bool is_pointwise_conv() {
+            return groups == 1 && filter_h == 1 && filter_w == 1 && stride_h == 1 && stride_w == 1 &&
+                   pad_left == 0 && pad_right == 0 && pad_top == 0 && pad_bottom == 0;
+        }
+
+        //one group per input channel, each channel is convolved with its own filters
+        bool is_depthwise_conv() {
+            return groups > 1 && groups == num_channels;
+        }
+        void grouped_conv_cpu(float *data_in, float *data_out);
+        void grouped_conv_gpu(DM_Blob *input, DM_Blob *output);
+        bool is_winograd_supported() {
+            return groups == 1 && filter_h == 3 && filter_w == 3 && stride_h == 1 && stride_w == 1 &&
+                   dilation_h <= 1 && dilation_w <= 1;
+        }
+        uint32_t get_winograd_tile_size() {
+            return (conv_algorithm == CONV_ALGORITHM_WINOGRAD_4X4) ? 4 : 2;
+        }
+        void select_conv_algorithm();
+        void winograd_transform_filters(float *weights_data);
+        uint32_t get_winograd_block_size(uint32_t num_tiles);
+        void winograd_conv_cpu(float *data_in, float *data_out);
+        void winograd_conv_gpu(DM_Blob *input, DM_Blob *output);
+        void split_conv_gpu(DM_Blob *input, DM_Blob *output);
+        void split_conv_cpu(DM_Blob *input, float *output, uint32_t first_filter, uint32_t count);
+
         DM_Blob *do_conv_cpu(DM_Blob *input);
         DM_Blob *do_conv_gpu(DM_Blob *input);
         void CAFFE_LAYOUT_conv_gpu(DM_Blob *input, DM_Blob *output);
         void CAFFE_LAYOUT_im2col_cpu(DM_Blob *input, DM_Blob *output);
         void CAFFE_LAYOUT_im2col_gpu(DM_Blob *input, DM_Blob *output);
         void DM_LAYOUT_conv_gpu(DM_Blob *input, DM_Blob *output);
+        string get_specialization_options();
+        void DM_LAYOUT_conv_1x1_gpu(DM_Blob *input, DM_Blob *output);
         void DM_LAYOUT_im2col_cpu(DM_Blob *input, DM_Blob *output);
     protected:
     public:
         DM_Layer_Conv(DM_Layer_Param &param);
+        ~DM_Layer_Conv();
         void LoadWeights();
+        //a split layer already runs on both engines
+        bool SetPlacement(ENVIRONMENT_TYPE env, PRESICION_TYPE precision) {
+            if(cpu_split.IsEnabled())
+                return false;
+            return DM_Layer::SetPlacement(env, precision);
+        }
+        bool FuseActivation(int activation_type, float activation_threshold) {
+            //monotonic activations commute with a fused max-pooling
+            if(this->activation_type != ACTIVATION_NONE)
+                return false;
+            this->activation_type = activation_type;
+            this->activation_threshold = activation_threshold;
+            return true;
+        }
+        bool FuseMaxPool2x2();
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
@@ -53,6 +129,9 @@ namespace deepmon {
             LOGD("\tPads: [%d %d %d %d]", pad_left, pad_top, pad_right, pad_bottom);
             LOGD("\tStride: [%d %d]", stride_h, stride_w);
             LOGD("\tDilation: [%d %d]", dilation_h, dilation_w);
+            LOGD("\tGroups: %d", groups);
+            if(cpu_split.IsEnabled())
+                LOGD("\tCPU split: %.2f", cpu_split.GetRatio());
 
             string inputs_str;
             for(int i = 0 ; i < this->bottom_layers.size() ; i++)
@@ -14,6 +14,9 @@ namespace deepmon {
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void LoadWeights() {
 
+        }
+        bool IsOutputAliasingInput() {
+            return true;
         }
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
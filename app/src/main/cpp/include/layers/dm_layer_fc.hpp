@@ -3,6 +3,7 @@
 
 #include <dm_layer.hpp>
 #include <dm_layer_param.hpp>
+#include <dm_split_ratio.hpp>
 
 namespace deepmon {
     class DM_Layer_Fc : public DM_Layer {
@@ -13,13 +14,40 @@ namespace deepmon {
         uint32_t input_size;
 
         vector<uint32_t> filters_shapes;
-        DM_Blob *filters;
-        DM_Blob *biases;
+        DM_Blob *filters = NULL;
+        DM_Blob *biases = NULL;
+
+        //fused epilogue, applied right after the gemm
+        int activation_type = ACTIVATION_NONE;
+        float activation_threshold = 0; //negative slope of leaky activation
+
+        //heterogeneous execution: the gpu computes neurons [0, gpu_num_neurons), the cpu engine the remaining ones
+        DM_Split_Ratio cpu_split;
+        uint32_t gpu_num_neurons = 0; //num_neurons when the layer is not split
+        DM_Blob *split_filters = NULL; //cpu copies of the weights, used by the cpu part
+        DM_Blob *split_biases = NULL;
+
+        void fc_gpu(DM_Blob *input, DM_Blob *output);
+        void split_fc_gpu(DM_Blob *input, DM_Blob *output);
     protected:
     public:
         DM_Layer_Fc(DM_Layer_Param &param);
+        ~DM_Layer_Fc();
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void LoadWeights();
+        //a split layer already runs on both engines
+        bool SetPlacement(ENVIRONMENT_TYPE env, PRESICION_TYPE precision) {
+            if(cpu_split.IsEnabled())
+                return false;
+            return DM_Layer::SetPlacement(env, precision);
+        }
+        bool FuseActivation(int activation_type, float activation_threshold) {
+            if(this->activation_type != ACTIVATION_NONE)
+                return false;
+            this->activation_type = activation_type;
+            this->activation_threshold = activation_threshold;
+            return true;
+        }
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
             LOGD("\tType: %s", this->type.c_str());
@@ -27,6 +27,11 @@ namespace deepmon {
         uint32_t output_w = 0;
 
         string type;
+
+        //activation applied to the input, only fused into max-pooling
+        int activation_type = ACTIVATION_NONE;
+        float activation_threshold = 0;
+
         void (DM_Layer_Pooling::*Forward_Pooling)(DM_Blob *input, DM_Blob *output);
 
         void CAFFE_LAYOUT_ForwardCPU_MaxPool(DM_Blob *input, DM_Blob *output);
@@ -36,6 +41,8 @@ namespace deepmon {
         void DM_LAYOUT_ForwardCPU_MaxPool(DM_Blob *input, DM_Blob *output);
         void DM_LAYOUT_ForwardCPU_AvePool(DM_Blob *input, DM_Blob *output);
         void DM_LAYOUT_ForwardGPU(DM_Blob *input, DM_Blob *output);
+        string get_specialization_options();
+        cl_int set_activation_args(cl_kernel kernel, int &arg_idx);
 
         DM_Blob *do_pooling_cpu(DM_Blob *input);
         DM_Blob *do_pooling_gpu(DM_Blob *input);
@@ -44,6 +51,14 @@ namespace deepmon {
         DM_Layer_Pooling(DM_Layer_Param &param);
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void LoadWeights() {}
+        bool IsMaxPool2x2Stride2() {
+            return !type.compare("MAXPOOL") && filter_h == 2 && filter_w == 2 && stride_h == 2 && stride_w == 2 &&
+                   pad_left == 0 && pad_right == 0 && pad_top == 0 && pad_bottom == 0;
+        }
+        bool FuseActivation(int activation_type, float activation_threshold);
+        int GetActivationType() {
+            return this->activation_type;
+        }
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
             LOGD("\tType: %s", this->type.c_str());
@@ -12,6 +12,12 @@ namespace deepmon {
         DM_Layer_Softmax(DM_Layer_Param &param);
         void ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches);
         void LoadWeights() {}
+        bool IsInPlaceCapable() {
+            return true;
+        }
+        bool SetPlacement(ENVIRONMENT_TYPE env, PRESICION_TYPE precision) {
+            return env == ENVIRONMENT_CPU;
+        }
         void PrintInfo() {
             LOGD("Layer: %s", this->name.c_str());
             LOGD("\tType: %s", this->type.c_str());
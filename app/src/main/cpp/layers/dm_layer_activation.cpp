@@ -24,6 +24,7 @@
 #include <layers/dm_layer_activation.hpp>
 #include <json/json.h>
 #include <fstream>
+#include <dm_kernel_defs.hpp>
 
 namespace deepmon {
     DM_Layer_Activation::DM_Layer_Activation(DM_Layer_Param &param) : DM_Layer(param.GetName(), param.GetType(), param.GetInputLayersNames(), param.GetMemoryLayout()) {
@@ -43,6 +44,12 @@ namespace deepmon {
         } else if(!layer["type"].asString().compare(ACTIVATION_LEAKY_STR)) {
             this->activation_type = ACTIVATION_LEAKY;
             this->activation_threshold = layer["threshold"].asFloat();
+        } else if(!layer["type"].asString().compare(ACTIVATION_SIGMOID_STR)) {
+            this->activation_type = ACTIVATION_SIGMOID;
+            this->activation_threshold = 0;
+        } else if(!layer["type"].asString().compare(ACTIVATION_TANH_STR)) {
+            this->activation_type = ACTIVATION_TANH;
+            this->activation_threshold = 0;
         } else {
             //unsupported activation
             this->corrupted = true;
@@ -75,8 +82,9 @@ namespace deepmon {
             return NULL;
         }
 
+        //write into the input if no other layer reads it
         DM_Blob *input = blobs[0];
-        DM_Blob *output = new DM_Blob(input->get_shapes(), ENVIRONMENT_CPU, PRECISION_32, NULL);
+        DM_Blob *output = IsInputReusable(input) ? input : CreateOutputBlob(input->get_shapes());
 
         switch(activation_type) {
             case ACTIVATION_RELU:
@@ -85,6 +93,12 @@ namespace deepmon {
             case ACTIVATION_LEAKY:
                 Activation_Leaky_CPU(input, output);
                 break;
+            case ACTIVATION_SIGMOID:
+                Activation_Sigmoid_CPU(input, output);
+                break;
+            case ACTIVATION_TANH:
+                Activation_TanH_CPU(input, output);
+                break;
             default:
                 output->set_corrupted(true);
                 break;
@@ -99,8 +113,9 @@ namespace deepmon {
             return NULL;
         }
 
+        //write into the input if no other layer reads it
         DM_Blob *input = blobs[0];
-        DM_Blob *output = new DM_Blob(input->get_shapes(), ENVIRONMENT_GPU, this->precision, NULL);
+        DM_Blob *output = IsInputReusable(input) ? input : CreateOutputBlob(input->get_shapes());
 
         switch(activation_type) {
             case ACTIVATION_RELU:
@@ -109,6 +124,12 @@ namespace deepmon {
             case ACTIVATION_LEAKY:
                 Activation_Leaky_GPU(input, output);
                 break;
+            case ACTIVATION_SIGMOID:
+                Activation_Unary_GPU(KERNEL_ACTIVATE_SIGMOID, input, output);
+                break;
+            case ACTIVATION_TANH:
+                Activation_Unary_GPU(KERNEL_ACTIVATE_TANH, input, output);
+                break;
             default:
                 output->set_corrupted(true);
                 break;
@@ -22,19 +22,44 @@
  */
 
 #include <layers/dm_layer_activation.hpp>
+#include <dm_math.hpp>
+#include <dm.hpp>
 
 namespace deepmon {
     void DM_Layer_Activation::Activation_ReLU_CPU(DM_Blob *input, DM_Blob *output) {
         float *data_in = input->get_cpu_data();
         float *data_out = output->get_cpu_data();
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            data_out[i] = data_in[i] > 0 ? data_in[i] : 0;
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(output->get_total_size(), PARALLEL_GRAIN_ITEMS,
+                                                           [=](uint32_t begin, uint32_t end) {
+            dm_relu(data_in + begin, data_out + begin, end - begin);
+        });
     }
 
     void DM_Layer_Activation::Activation_Leaky_CPU(DM_Blob *input, DM_Blob *output) {
         float *data_in = input->get_cpu_data();
         float *data_out = output->get_cpu_data();
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            data_out[i] = data_in[i] > -this->activation_threshold ? data_in[i] : 0;
+        float negative_slope = this->activation_threshold;
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(output->get_total_size(), PARALLEL_GRAIN_ITEMS,
+                                                           [=](uint32_t begin, uint32_t end) {
+            dm_leaky_relu(data_in + begin, data_out + begin, end - begin, negative_slope);
+        });
     }
-}
+
+    void DM_Layer_Activation::Activation_Sigmoid_CPU(DM_Blob *input, DM_Blob *output) {
+        float *data_in = input->get_cpu_data();
+        float *data_out = output->get_cpu_data();
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(output->get_total_size(), PARALLEL_GRAIN_ITEMS,
+                                                           [=](uint32_t begin, uint32_t end) {
+            dm_sigmoid(data_in + begin, data_out + begin, end - begin);
+        });
+    }
+
+    void DM_Layer_Activation::Activation_TanH_CPU(DM_Blob *input, DM_Blob *output) {
+        float *data_in = input->get_cpu_data();
+        float *data_out = output->get_cpu_data();
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(output->get_total_size(), PARALLEL_GRAIN_ITEMS,
+                                                           [=](uint32_t begin, uint32_t end) {
+            dm_tanh(data_in + begin, data_out + begin, end - begin);
+        });
+    }
+}
\ No newline at end of file
@@ -28,7 +28,6 @@
 namespace deepmon {
 
     void DM_Layer_Activation::Activation_Leaky_GPU(DM_Blob *input, DM_Blob *output) {
-        cl_command_queue queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
         cl_kernel kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(precision, KERNEL_ACTIVATE_RELU);
 
         int i = 0;
@@ -43,11 +42,11 @@ namespace deepmon {
         err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_out);
 
         if(precision == PRECISION_32) {
-            float zero_data = activation_threshold;
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &zero_data);
+            cl_float threshold = activation_threshold;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &threshold);
         } else {
             half threshold = FloatToHalf(activation_threshold);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &threshold);
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &threshold);
         }
 
         SAMPLE_CHECK_ERRORS(err);
@@ -57,17 +56,8 @@ namespace deepmon {
         }
 
         size_t wgs[1] = {(size_t)(n)};
-        err = clEnqueueNDRangeKernel(
-                queue,
-                kernel,
-                1,
-                0,
-                wgs,
-                0,
-                0, 0, 0
-        );
-        err |= clFinish(queue);
-        SAMPLE_CHECK_ERRORS(err);
+        err = DeepMon::Get().GetGpuExecutionEngine().EnqueueKernel(kernel, 1, wgs, NULL,
+                                                                   vector<DM_Blob *> {input}, output);
         if(err != CL_SUCCESS) {
             output->set_corrupted(true);
             return;
@@ -77,4 +67,32 @@ namespace deepmon {
     void DM_Layer_Activation::Activation_ReLU_GPU(DM_Blob *input, DM_Blob *output) {
         return Activation_Leaky_GPU(input, output);
     }
+
+    void DM_Layer_Activation::Activation_Unary_GPU(const char *kernel_name, DM_Blob *input, DM_Blob *output) {
+        cl_kernel kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(precision, kernel_name);
+
+        int i = 0;
+        cl_int err = CL_SUCCESS;
+
+        int n = input->get_total_size();
+        cl_mem cl_in = input->get_gpu_data();
+        cl_mem cl_out = output->get_gpu_data();
+
+        err  = clSetKernelArg(kernel, i++, sizeof(cl_int), &n);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_in);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_out);
+        SAMPLE_CHECK_ERRORS(err);
+        if(err != CL_SUCCESS) {
+            output->set_corrupted(true);
+            return;
+        }
+
+        size_t wgs[1] = {(size_t)(n)};
+        err = DeepMon::Get().GetGpuExecutionEngine().EnqueueKernel(kernel, 1, wgs, NULL,
+                                                                   vector<DM_Blob *> {input}, output);
+        if(err != CL_SUCCESS) {
+            output->set_corrupted(true);
+            return;
+        }
+    }
 }
\ No newline at end of file
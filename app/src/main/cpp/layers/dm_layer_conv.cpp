@@ -61,21 +61,59 @@ namespace deepmon {
         this->dilation_h = layer["DILATION_H"].asUInt();
         this->dilation_w = layer["DILATION_W"].asUInt();
 
+        this->activation_type = GET_ACTIVATION_TYPE(layer["ACTIVATION"].asString().c_str());
+        this->activation_threshold = layer["ACTIVATION_THRESHOLD"].asFloat();
+        if(this->activation_type == ACTIVATION_UNKNOWN) {
+            LOGE("[%s]: Unsupported activation %s", this->name.c_str(), layer["ACTIVATION"].asString().c_str());
+            corrupted = true;
+            return;
+        }
+
+        //DEPTHWISE is a shortcut for one group per input channel
+        this->groups = layer["DEPTHWISE"].asBool() ? this->num_channels : layer.get("GROUPS", 1).asUInt();
+        if(this->groups == 0 || this->num_channels % this->groups != 0 || this->num_filters % this->groups != 0) {
+            LOGE("[%s]: %d channels and %d filters cannot be split into %d groups", this->name.c_str(), this->num_channels, this->num_filters, this->groups);
+            corrupted = true;
+            return;
+        }
+
+        this->conv_algorithm = GET_CONV_ALGORITHM(layer["CONV_ALGORITHM"].asString().c_str());
+        if(this->conv_algorithm == CONV_ALGORITHM_UNKNOWN) {
+            LOGE("[%s]: Unsupported convolution algorithm %s", this->name.c_str(), layer["CONV_ALGORITHM"].asString().c_str());
+            corrupted = true;
+            return;
+        }
+
         if(num_filters <= 0 || num_channels <= 0 || filter_h <= 0 || filter_w <= 0 ) {
             corrupted = true;
             return;
         }
 
+        //the cpu share is computed by im2col + gemm, so only FP32 GPU layers without groups can be split
+        this->gpu_num_filters = this->num_filters;
+        this->cpu_split.Parse(layer["CPU_SPLIT"]);
+        if(this->cpu_split.IsEnabled()) {
+            if(this->env != ENVIRONMENT_GPU || this->precision != PRECISION_32 || this->groups > 1 || this->num_filters < 2) {
+                LOGE("[%s]: CPU_SPLIT needs a FP32 GPU layer without groups, the layer is not split", this->name.c_str());
+                this->cpu_split.Disable();
+            } else {
+                if(this->conv_algorithm != CONV_ALGORITHM_AUTO && this->conv_algorithm != CONV_ALGORITHM_IM2COL)
+                    LOGE("[%s]: Winograd cannot be split, fall back to im2col", this->name.c_str());
+                this->conv_algorithm = CONV_ALGORITHM_IM2COL;
+            }
+        }
+
+        //each filter only sees the channels of its group
         switch (param.GetMemoryLayout()) {
             case MEMORY_LAYOUT_DM:
                 this->filters_shapes.push_back(num_filters);
                 this->filters_shapes.push_back(filter_h);
                 this->filters_shapes.push_back(filter_w);
-                this->filters_shapes.push_back(num_channels);
+                this->filters_shapes.push_back(num_channels / groups);
                 break;
             case MEMORY_LAYOUT_CAFFE:
                 this->filters_shapes.push_back(num_filters);
-                this->filters_shapes.push_back(num_channels);
+                this->filters_shapes.push_back(num_channels / groups);
                 this->filters_shapes.push_back(filter_h);
                 this->filters_shapes.push_back(filter_w);
                 break;
@@ -84,9 +122,40 @@ namespace deepmon {
         }
     }
 
+    DM_Layer_Conv::~DM_Layer_Conv() {
+        vector<DM_Blob *> weights {filters, biases, winograd_filters, split_filters, split_biases};
+        for(int i = 0 ; i < weights.size() ; i++) {
+            if(weights.at(i) != NULL)
+                delete weights.at(i);
+        }
+    }
+
+    /*
+     * Winograd needs 3x3 filters with stride 1
+     * AUTO picks it when the layer is wide enough to amortize the transforms,
+     * with the larger tile once the output holds several of them (FP32 only, F(4x4) loses too much precision in half)
+     */
+    void DM_Layer_Conv::select_conv_algorithm() {
+        bool is_winograd_possible = is_winograd_supported();
+
+        if(conv_algorithm == CONV_ALGORITHM_AUTO) {
+            if(is_winograd_possible && num_channels >= 16 && num_filters >= 16)
+                conv_algorithm = (output_h >= 16 && output_w >= 16 && precision == PRECISION_32) ?
+                                 CONV_ALGORITHM_WINOGRAD_4X4 : CONV_ALGORITHM_WINOGRAD_2X2;
+            else
+                conv_algorithm = CONV_ALGORITHM_IM2COL;
+        } else if(conv_algorithm != CONV_ALGORITHM_IM2COL && !is_winograd_possible) {
+            LOGE("[%s]: Winograd is not supported by this layer, fall back to im2col", this->name.c_str());
+            conv_algorithm = CONV_ALGORITHM_IM2COL;
+        }
+    }
+
     void DM_Layer_Conv::LoadWeights() {
         float *bias_data = NULL;
         float *weights_data = NULL;
+        uint32_t channels_per_group = this->num_channels / this->groups;
+
+        select_conv_algorithm();
 
         if(1) {
             /*
@@ -98,26 +167,44 @@ namespace deepmon {
                 bias_data = new float[this->num_filters];
                 fread((void*)bias_data, sizeof(float), this->num_filters, fp);
                 this->biases = new DM_Blob(vector<uint32_t>{this->num_filters}, this->env, this->precision, bias_data);
-                delete bias_data;
+                if(cpu_split.IsEnabled())
+                    this->split_biases = new DM_Blob(vector<uint32_t>{this->num_filters}, ENVIRONMENT_CPU, PRECISION_32, bias_data);
+                delete[] bias_data;
             }
-            weights_data = new float[this->num_filters * this->num_channels * this->filter_h * this->filter_w];
+            weights_data = new float[this->num_filters * channels_per_group * this->filter_h * this->filter_w];
             if(this->mem_layout == MEMORY_LAYOUT_CAFFE)
-                fread((void*)weights_data, sizeof(float), this->num_filters * this->num_channels * this->filter_h * this->filter_w, fp);
+                fread((void*)weights_data, sizeof(float), this->num_filters * channels_per_group * this->filter_h * this->filter_w, fp);
             else if(this->mem_layout == MEMORY_LAYOUT_DM) {
                 //convert Caffe-based weights into DM-based weights
                 for(int i = 0 ; i < this->num_filters ; i++) {
-                    for(int j = 0 ; j < this->num_channels ; j++) {
+                    for(int j = 0 ; j < channels_per_group ; j++) {
                         for(int m = 0 ; m < this->filter_h ; m++) {
                             for(int n = 0 ; n < this->filter_w ; n++) {
-                                int new_idx = ((i * filter_h + m) * filter_w + n) * num_channels + j;
+                                int new_idx = ((i * filter_h + m) * filter_w + n) * channels_per_group + j;
                                 fread((void *)(&weights_data[new_idx]), sizeof(float), 1, fp);
                             }
                         }
                     }
                 }
+
+                //the depthwise cpu kernel runs over filters in the inner loop, it needs [filter_h][filter_w][num_filters]
+                if(is_depthwise_conv() && this->env == ENVIRONMENT_CPU) {
+                    float *transposed = new float[this->num_filters * this->filter_h * this->filter_w];
+                    for(int i = 0 ; i < this->num_filters ; i++) {
+                        for(int m = 0 ; m < this->filter_h * this->filter_w ; m++)
+                            transposed[m * num_filters + i] = weights_data[i * filter_h * filter_w + m];
+                    }
+                    delete[] weights_data;
+                    weights_data = transposed;
+                    filters_shapes = vector<uint32_t> {filter_h, filter_w, num_filters};
+                }
             }
             this->filters = new DM_Blob(filters_shapes, this->env, this->precision, weights_data);
-            delete weights_data;
+            if(cpu_split.IsEnabled())
+                this->split_filters = new DM_Blob(filters_shapes, ENVIRONMENT_CPU, PRECISION_32, weights_data);
+            if(conv_algorithm != CONV_ALGORITHM_IM2COL)
+                winograd_transform_filters(weights_data);
+            delete[] weights_data;
             fclose(fp);
         } else {
             if(this->has_bias) {
@@ -125,14 +212,20 @@ namespace deepmon {
                 for(int i = 0 ; i < this->num_filters ; i++)
                     bias_data[i] = 1.0f;
                 this->biases = new DM_Blob(vector<uint32_t>{this->num_filters}, this->env, this->precision, bias_data);
-                delete bias_data;
+                if(cpu_split.IsEnabled())
+                    this->split_biases = new DM_Blob(vector<uint32_t>{this->num_filters}, ENVIRONMENT_CPU, PRECISION_32, bias_data);
+                delete[] bias_data;
             }
 
-            weights_data = new float[this->num_filters * this->num_channels * this->filter_h * this->filter_w];
-            for(int i = 0 ; i < num_filters * num_channels * filter_h * filter_w ; i++)
+            weights_data = new float[this->num_filters * channels_per_group * this->filter_h * this->filter_w];
+            for(int i = 0 ; i < num_filters * channels_per_group * filter_h * filter_w ; i++)
                 weights_data[i] = 1.0f;
             this->filters = new DM_Blob(filters_shapes, this->env, this->precision, weights_data);
-            delete weights_data;
+            if(cpu_split.IsEnabled())
+                this->split_filters = new DM_Blob(filters_shapes, ENVIRONMENT_CPU, PRECISION_32, weights_data);
+            if(conv_algorithm != CONV_ALGORITHM_IM2COL)
+                winograd_transform_filters(weights_data);
+            delete[] weights_data;
         }
     }
 
@@ -182,6 +275,35 @@ namespace deepmon {
         }
     }
 
+    vector<uint32_t> DM_Layer_Conv::get_conv_output_shapes(uint32_t batches) {
+        if(mem_layout == MEMORY_LAYOUT_CAFFE)
+            return vector<uint32_t> {batches, num_filters, output_h, output_w};
+        return vector<uint32_t> {batches, output_h, output_w, num_filters};
+    }
+
+    bool DM_Layer_Conv::FuseMaxPool2x2() {
+        //the halves of a split layer are stitched before any pooling could run
+        if(this->fused_maxpool || this->cpu_split.IsEnabled() || output_h < 2 || output_w < 2)
+            return false;
+
+        this->fused_maxpool = true;
+        this->pooled_h = (output_h - 2) / 2 + 1;
+        this->pooled_w = (output_w - 2) / 2 + 1;
+
+        this->output_shapes.clear();
+        if(mem_layout == MEMORY_LAYOUT_DM) {
+            this->output_shapes.push_back(pooled_h);
+            this->output_shapes.push_back(pooled_w);
+            this->output_shapes.push_back(num_filters);
+        } else if(mem_layout == MEMORY_LAYOUT_CAFFE){
+            this->output_shapes.push_back(num_filters);
+            this->output_shapes.push_back(pooled_h);
+            this->output_shapes.push_back(pooled_w);
+        }
+
+        return true;
+    }
+
     DM_Blob* DM_Layer_Conv::ForwardCpu(vector<DM_Blob *> blobs) {
         if(blobs.size() != 1) {
             LOGE("[%s] has more than 1 input", this->name.c_str());
@@ -23,49 +23,62 @@
 
 #include <layers/dm_layer_conv.hpp>
 #include <cblas.h>
+#include <dm.hpp>
 
 namespace deepmon {
     void DM_Layer_Conv::CAFFE_LAYOUT_im2col_cpu(DM_Blob *input, DM_Blob *output) {
-        float *data_im = input->get_cpu_data();
-        float *data_col = output->get_cpu_data();
-
         int batches = input->get_shape_at(0);
 
         const int channel_size = input_h * input_w;
-        for (int channel = num_channels * batches; channel--; data_im += channel_size) {
-            for (int kernel_row = 0; kernel_row < filter_h; kernel_row++) {
-                for (int kernel_col = 0; kernel_col < filter_w; kernel_col++) {
-                    int input_row = -pad_top + kernel_row * dilation_h;
-                    for (int output_rows = output_h; output_rows; output_rows--) {
-                        if (!(input_row >= 0 && input_row < input_h)) {
-                            for (int output_cols = output_w; output_cols; output_cols--) {
-                                *(data_col++) = 0;
-                            }
-                        } else {
-                            int input_col = -pad_left + kernel_col * dilation_w;
-                            for (int output_col = output_w; output_col; output_col--) {
-                                if ((input_col >= 0 && input_col< input_w)) {
-                                    *(data_col++) = data_im[input_row * input_w + input_col];
-                                } else {
+        const int col_channel_size = filter_h * filter_w * output_h * output_w;
+
+        //every channel of every image fills its own filter_h * filter_w rows of the column buffer
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(num_channels * batches, GET_PARALLEL_GRAIN(col_channel_size),
+                                                           [=](uint32_t channel_begin, uint32_t channel_end) {
+            for (int channel = channel_begin; channel < channel_end; channel++) {
+                const float *data_im = input->get_cpu_data() + channel * channel_size;
+                float *data_col = output->get_cpu_data() + channel * col_channel_size;
+                for (int kernel_row = 0; kernel_row < filter_h; kernel_row++) {
+                    for (int kernel_col = 0; kernel_col < filter_w; kernel_col++) {
+                        int input_row = -pad_top + kernel_row * dilation_h;
+                        for (int output_rows = output_h; output_rows; output_rows--) {
+                            if (!(input_row >= 0 && input_row < input_h)) {
+                                for (int output_cols = output_w; output_cols; output_cols--) {
                                     *(data_col++) = 0;
                                 }
-                                input_col += stride_w;
+                            } else {
+                                int input_col = -pad_left + kernel_col * dilation_w;
+                                for (int output_col = output_w; output_col; output_col--) {
+                                    if ((input_col >= 0 && input_col< input_w)) {
+                                        *(data_col++) = data_im[input_row * input_w + input_col];
+                                    } else {
+                                        *(data_col++) = 0;
+                                    }
+                                    input_col += stride_w;
+                                }
                             }
+                            input_row += stride_h;
                         }
-                        input_row += stride_h;
                     }
                 }
             }
-        }
+        });
     }
 
     void DM_Layer_Conv::DM_LAYOUT_im2col_cpu(DM_Blob *input, DM_Blob *output) {
-        float *data_im = input->get_cpu_data();
-        float *data_col = output->get_cpu_data();
-
         int batches = input->get_shape_at(0);
-        for(int b = 0 ; b < batches ; b++) {
-            for(int output_row = 0 ; output_row < output_h ; output_row++) {
+
+        const int image_size = input_h * input_w * num_channels;
+        const int col_row_size = output_w * filter_h * filter_w * num_channels;
+
+        //one chunk item is one output row of one image
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(batches * output_h, GET_PARALLEL_GRAIN(col_row_size),
+                                                           [=](uint32_t row_begin, uint32_t row_end) {
+            for(int row = row_begin ; row < row_end ; row++) {
+                int b = row / output_h;
+                int output_row = row % output_h;
+                const float *data_im = input->get_cpu_data() + b * image_size;
+                float *data_col = output->get_cpu_data() + row * col_row_size;
                 for(int output_col = 0 ; output_col < output_w ; output_col++) {
                     for(int kernel_row = 0; kernel_row < filter_h; kernel_row++) {
                         int input_row = output_row * stride_h - pad_top + kernel_row * dilation_h;
@@ -91,106 +104,99 @@ namespace deepmon {
                     }
                 }
             }
-        }
+        });
     }
 
     DM_Blob* DM_Layer_Conv::do_conv_cpu(DM_Blob *input) {
         //need to add batch_size
-        DM_Blob* output = new DM_Blob(vector<uint32_t> {
+        DM_Blob* output = CreateOutputBlob(vector<uint32_t> {
                 input->get_shape_at(0), output_shapes[0], output_shapes[1], output_shapes[2]
-        }, ENVIRONMENT_CPU, PRECISION_32, NULL);
-
-        std::vector<uint32_t> im2col_shapes;
-        if(mem_layout == MEMORY_LAYOUT_CAFFE) {
-            im2col_shapes.push_back(input->get_shape_at(CAFFE_BLOB_INOUT_BATCH_IDX));
-            im2col_shapes.push_back(num_channels * filter_h * filter_w);
-            im2col_shapes.push_back(output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX));
-            im2col_shapes.push_back(output->get_shape_at(CAFFE_BLOB_INOUT_WIDTH_IDX));
-        } else if(mem_layout == MEMORY_LAYOUT_DM) {
-            im2col_shapes.push_back(input->get_shape_at(DM_BLOB_INOUT_BATCH_IDX));
-            im2col_shapes.push_back(output->get_shape_at(DM_BLOB_INOUT_HEIGHT_IDX));
-            im2col_shapes.push_back(output->get_shape_at(DM_BLOB_INOUT_WIDTH_IDX));
-            im2col_shapes.push_back(num_channels * filter_h * filter_w);
-        }
-        DM_Blob *im2col_blob = new DM_Blob(im2col_shapes, ENVIRONMENT_CPU, PRECISION_32, NULL);
-        if(mem_layout == MEMORY_LAYOUT_CAFFE) {
-            CAFFE_LAYOUT_im2col_cpu(input, im2col_blob);
-        } else {
-            //DM LAYOUT
-            DM_LAYOUT_im2col_cpu(input, im2col_blob);
-        }
-
-        int input_offset = im2col_blob->get_shape_at(1) * im2col_blob->get_shape_at(2) * im2col_blob->get_shape_at(3);
-        int output_offset = output->get_shape_at(1) * output->get_shape_at(2) * output->get_shape_at(3);
-
-        int m,n,k;
-        if(mem_layout == MEMORY_LAYOUT_CAFFE) {
-            m = filters->get_shape_at(CAFFE_BLOB_FILTER_NUM_FILTERS);
-            k = im2col_blob->get_shape_at(1);
-            n = output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX) * output->get_shape_at(CAFFE_BLOB_FILTER_WIDTH);
-        } else if(mem_layout == MEMORY_LAYOUT_DM) {
-            m = filters->get_shape_at(DM_BLOB_FILTER_NUM_FILTERS);
-            k = im2col_blob->get_shape_at(3);
-            n = output->get_shape_at(DM_BLOB_INOUT_HEIGHT_IDX) * output->get_shape_at(DM_BLOB_INOUT_WIDTH_IDX);
-        }
-
-        float *biases_multiplier = NULL;
-        if(biases != NULL) {
-            biases_multiplier = new float[n];
-            for(int i = 0 ; i < n ; i++)
-                biases_multiplier[i] = 1;
-        }
-
-        for(int b = 0 ; b < input->get_shapes()[0] ; b++) {
-            float *data_im = im2col_blob->get_cpu_data() + b * input_offset;
-            float *output_im = output->get_cpu_data() + b * output_offset;
-            /*matrix_multiplication(filters->get_cpu_data(), n, m, \
-                                    data_im, k, n, output_im, tA, tB, 0);*/
-
+        });
+
+        //with a fused max-pooling, the result of the convolution only lives in a scratch blob
+        DM_Blob *conv_output = output;
+        if(fused_maxpool)
+            conv_output = new DM_Blob(get_conv_output_shapes(input->get_shape_at(0)), ENVIRONMENT_CPU, PRECISION_32, NULL);
+
+        //winograd, grouped and pointwise convolutions read the input directly
+        bool use_winograd = (this->winograd_filters != NULL);
+        bool use_grouped = (this->groups > 1);
+        DM_Blob *im2col_blob = NULL;
+        if(!use_winograd && !use_grouped && !is_pointwise_conv()) {
+            std::vector<uint32_t> im2col_shapes;
             if(mem_layout == MEMORY_LAYOUT_CAFFE) {
-                cblas_sgemm(CblasRowMajor,
-                            CblasNoTrans,
-                            CblasNoTrans,
-                            m, n, k,
-                            1.0f,
-                            filters->get_cpu_data(), k,
-                            data_im, n,
-                            0, output_im, n);
-                if(biases != NULL) {
-                    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-                                biases->get_shape_at(0), n, 1,
-                                1.0f,
-                                biases->get_cpu_data(), 1,
-                                biases_multiplier, n,
-                                1.0, output_im, n);
-                }
+                im2col_shapes.push_back(input->get_shape_at(CAFFE_BLOB_INOUT_BATCH_IDX));
+                im2col_shapes.push_back(num_channels * filter_h * filter_w);
+                im2col_shapes.push_back(conv_output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX));
+                im2col_shapes.push_back(conv_output->get_shape_at(CAFFE_BLOB_INOUT_WIDTH_IDX));
             } else if(mem_layout == MEMORY_LAYOUT_DM) {
-                cblas_sgemm(CblasRowMajor,
-                            CblasNoTrans,
-                            CblasTrans,
-                            n, m, k,
-                            1.0f,
-                            data_im, k,
-                            filters->get_cpu_data(), k,
-                            0, output_im, m);
-                if(biases != NULL) {
-                    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-                                n, biases->get_shape_at(0), 1,
-                                1.0f,
-                                biases_multiplier, 1,
-                                biases->get_cpu_data(), biases->get_shape_at(0),
-                                1.0, output_im, biases->get_shape_at(0));
-                }
+                im2col_shapes.push_back(input->get_shape_at(DM_BLOB_INOUT_BATCH_IDX));
+                im2col_shapes.push_back(conv_output->get_shape_at(DM_BLOB_INOUT_HEIGHT_IDX));
+                im2col_shapes.push_back(conv_output->get_shape_at(DM_BLOB_INOUT_WIDTH_IDX));
+                im2col_shapes.push_back(num_channels * filter_h * filter_w);
+            }
+            im2col_blob = new DM_Blob(im2col_shapes, ENVIRONMENT_CPU, PRECISION_32, NULL);
+            if(mem_layout == MEMORY_LAYOUT_CAFFE) {
+                CAFFE_LAYOUT_im2col_cpu(input, im2col_blob);
+            } else {
+                //DM LAYOUT
+                DM_LAYOUT_im2col_cpu(input, im2col_blob);
             }
-
         }
+        DM_Blob *gemm_input = (im2col_blob != NULL) ? im2col_blob : input;
+
+        int input_offset = gemm_input->get_shape_at(1) * gemm_input->get_shape_at(2) * gemm_input->get_shape_at(3);
+        int output_offset = conv_output->get_shape_at(1) * conv_output->get_shape_at(2) * conv_output->get_shape_at(3);
+
+        int m = num_filters;
+        int n = output_h * output_w;
+        int k = num_channels * filter_h * filter_w;
+
+        float *biases_data = (biases != NULL) ? biases->get_cpu_data() : NULL;
+
+        //images are independent, with a single image the gemm itself is split over the pool
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(input->get_shape_at(0), 1, [&](uint32_t b_begin, uint32_t b_end) {
+            for(int b = b_begin ; b < b_end ; b++) {
+                float *data_im = gemm_input->get_cpu_data() + b * input_offset;
+                float *output_im = conv_output->get_cpu_data() + b * output_offset;
+                float *pooled_im = output->get_cpu_data() + b * (output->get_total_size() / output->get_shape_at(0));
+                /*matrix_multiplication(filters->get_cpu_data(), n, m, \
+                                        data_im, k, n, output_im, tA, tB, 0);*/
+
+                if(use_winograd) {
+                    winograd_conv_cpu(data_im, output_im);
+                } else if(use_grouped) {
+                    grouped_conv_cpu(data_im, output_im);
+                } else if(mem_layout == MEMORY_LAYOUT_CAFFE) {
+                    DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(false, m, n, k,
+                                                                       filters->get_cpu_data(), k,
+                                                                       data_im, n,
+                                                                       output_im, n);
+                } else if(mem_layout == MEMORY_LAYOUT_DM) {
+                    DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(true, n, m, k,
+                                                                       data_im, k,
+                                                                       filters->get_cpu_data(), k,
+                                                                       output_im, m);
+                }
 
-        if(biases_multiplier != NULL)
-            delete biases_multiplier;
+                //caffe: output_im is [m x n], one bias per row. dm: output_im is [n x m], one bias per column
+                if(fused_maxpool)
+                    DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivationMaxPool2x2(mem_layout, output_im, m, output_h, output_w,
+                                                                                           pooled_im, pooled_h, pooled_w,
+                                                                                           biases_data, activation_type, activation_threshold);
+                else if(mem_layout == MEMORY_LAYOUT_CAFFE)
+                    DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(output_im, 1, m, n,
+                                                                                 biases_data, activation_type, activation_threshold);
+                else
+                    DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(output_im, n, m, 1,
+                                                                                 biases_data, activation_type, activation_threshold);
+            }
+        });
 
-        if(!this->persistant_blobs) {
-            delete input;
-        }
+        if(im2col_blob != NULL)
+            delete im2col_blob;
+        if(conv_output != output)
+            delete conv_output;
 
         return output;
     }
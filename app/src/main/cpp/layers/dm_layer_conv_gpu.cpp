@@ -25,6 +25,7 @@
 #include <dm.hpp>
 #include <clblast_c.h>
 #include <clblast.h>
+#include <clblast_half.h>
 
 using namespace deepmon;
 namespace deepmon {
@@ -45,201 +46,317 @@ namespace deepmon {
     }
 
     void DM_Layer_Conv::CAFFE_LAYOUT_conv_gpu(DM_Blob *input, DM_Blob *output) {
+        //with a fused max-pooling, the result of the convolution only lives in a scratch blob
+        DM_Blob *conv_output = output;
+        if(fused_maxpool)
+            conv_output = new DM_Blob(get_conv_output_shapes(input->get_shape_at(0)), ENVIRONMENT_GPU, this->precision, NULL);
 
-        std::vector<uint32_t> im2col_shapes{
-                input->get_shape_at(CAFFE_BLOB_INOUT_BATCH_IDX),
-                num_channels * filter_h * filter_w,
-                output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX),
-                output->get_shape_at(CAFFE_BLOB_INOUT_WIDTH_IDX)
-        };
+        //pointwise convolutions feed the input directly to the gemm
+        DM_Blob *im2col_blob = NULL;
+        if(!is_pointwise_conv()) {
+            std::vector<uint32_t> im2col_shapes{
+                    input->get_shape_at(CAFFE_BLOB_INOUT_BATCH_IDX),
+                    num_channels * filter_h * filter_w,
+                    conv_output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX),
+                    conv_output->get_shape_at(CAFFE_BLOB_INOUT_WIDTH_IDX)
+            };
 
-        DM_Blob *im2col_blob = new DM_Blob(im2col_shapes, ENVIRONMENT_GPU, this->precision,
-                                           NULL);
+            im2col_blob = new DM_Blob(im2col_shapes, ENVIRONMENT_GPU, this->precision,
+                                      NULL);
 
-        CAFFE_LAYOUT_im2col_gpu(input, im2col_blob);
+            CAFFE_LAYOUT_im2col_gpu(input, im2col_blob);
+        }
+        DM_Blob *gemm_input = (im2col_blob != NULL) ? im2col_blob : input;
 
-        int input_offset = im2col_blob->get_shape_at(1) * im2col_blob->get_shape_at(2) *
-                           im2col_blob->get_shape_at(3);
+        int input_offset = gemm_input->get_shape_at(1) * gemm_input->get_shape_at(2) *
+                           gemm_input->get_shape_at(3);
         int output_offset =
-                output->get_shape_at(1) * output->get_shape_at(2) * output->get_shape_at(3);
+                conv_output->get_shape_at(1) * conv_output->get_shape_at(2) * conv_output->get_shape_at(3);
 
         int m = filters->get_shape_at(CAFFE_BLOB_FILTER_NUM_FILTERS);
-        int k = im2col_blob->get_shape_at(1);
-        int n = output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX) *
-                output->get_shape_at(CAFFE_BLOB_FILTER_WIDTH);
-
-        float *biases_multiplier = NULL;
-        if (biases != NULL) {
-            biases_multiplier = new float[n];
-            for (int i = 0; i < n; i++)
-                biases_multiplier[i] = 1;
-        }
-
-        DM_Blob *biases_multiplier_blob = NULL;
-        if (biases != NULL) {
-            biases_multiplier_blob = new DM_Blob(vector<uint32_t>({(uint32_t)n}), ENVIRONMENT_GPU,
-                                                 this->precision, biases_multiplier);
-        }
+        int gpu_m = gpu_num_filters; //rows of the output computed here, a split layer leaves the others to the cpu
+        int k = num_channels * filter_h * filter_w;
+        int n = conv_output->get_shape_at(CAFFE_BLOB_INOUT_HEIGHT_IDX) *
+                conv_output->get_shape_at(CAFFE_BLOB_FILTER_WIDTH);
 
-        cl_command_queue queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
+        //images of the batch are independent, their gemms run on different queues
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        bool is_forked = input->get_shape_at(0) > 1 && gpu_engine.ForkQueues();
         for (int b = 0; b < input->get_shapes()[0]; b++) {
+            if(is_forked)
+                gpu_engine.SelectQueue(b);
+            cl_command_queue queue = gpu_engine.GetCurrentQueue();
             cl_event event;
             CLBlastStatusCode status;
             if (precision == PRECISION_32) {
                 status = CLBlastSgemm(CLBlastLayoutRowMajor,
                                                         CLBlastTransposeNo, CLBlastTransposeNo,
-                                                        m, n, k,
+                                                        gpu_m, n, k,
                                                         1.0f,
                                                         filters->get_gpu_data(), 0, k,
-                                                        im2col_blob->get_gpu_data(),
+                                                        gemm_input->get_gpu_data(),
                                                         b * input_offset, n,
                                                         0,
-                                                        output->get_gpu_data(),
+                                                        conv_output->get_gpu_data(),
                                                         b * output_offset, n,
                                                         &queue, &event);
             } else {
                 status = CLBlastHgemm(CLBlastLayoutRowMajor,
                                                         CLBlastTransposeNo, CLBlastTransposeNo,
-                                                        m, n, k,
+                                                        gpu_m, n, k,
                                                         1.0f,
                                                         filters->get_gpu_data(), 0, k,
-                                                        im2col_blob->get_gpu_data(),
+                                                        gemm_input->get_gpu_data(),
                                                         b * input_offset, n,
                                                         0,
-                                                        output->get_gpu_data(),
+                                                        conv_output->get_gpu_data(),
                                                         b * output_offset, n,
                                                         &queue, &event);
             }
 
+            //CLBlast takes no wait list, the in-order queue runs the gemm after the commands producing its inputs
+            //(a forked queue waits for everything enqueued before the fork)
             if (status == CLBlastSuccess) {
-                clWaitForEvents(1, &event);
-                clReleaseEvent(event);
+                if(is_forked)
+                    clReleaseEvent(event);
+                else
+                    conv_output->set_ready_event(event);
             } else {
                 LOGE("[%s]: Gemm_1 failed with status %d", this->name.c_str(), status);
                 output->set_corrupted(true);
                 break;
             }
+        }
 
-            if (biases != NULL) {
-                if(precision == PRECISION_32) {
-                    status = CLBlastSgemm(
-                            CLBlastLayoutRowMajor,
-                            CLBlastTransposeNo, CLBlastTransposeNo,
-                            biases->get_shape_at(0), n, 1,
-                            1.0f,
-                            biases->get_gpu_data(), 0, 1,
-                            biases_multiplier_blob->get_gpu_data(), 0, n,
-                            1.0f, output->get_gpu_data(),
-                            b * output->get_total_size() / output->get_shape_at(0), n,
-                            &queue, &event);
-                } else {
-                    status = CLBlastHgemm(
-                            CLBlastLayoutRowMajor,
-                            CLBlastTransposeNo, CLBlastTransposeNo,
-                            biases->get_shape_at(0), n, 1,
-                            1.0f,
-                            biases->get_gpu_data(), 0, 1,
-                            biases_multiplier_blob->get_gpu_data(), 0, n,
-                            1.0f, output->get_gpu_data(),
-                            b * output->get_total_size() / output->get_shape_at(0), n,
-                            &queue, &event);
-                }
+        if(is_forked) {
+            cl_event event = NULL;
+            gpu_engine.JoinQueues(&event);
+            conv_output->set_ready_event(event);
+        }
+
+        //output is [batches x m x n], one bias per filter
+        if(!output->is_corrupted()) {
+            if(fused_maxpool)
+                DeepMon::Get().GetGpuExecutionEngine().ExecuteBiasActivationMaxPool2x2(precision, mem_layout,
+                                                                                       conv_output, m, output_h, output_w,
+                                                                                       output, pooled_h, pooled_w,
+                                                                                       biases, activation_type, activation_threshold);
+            else
+                DeepMon::Get().GetGpuExecutionEngine().ExecuteBiasActivation(precision, output, m, n,
+                                                                             biases, activation_type, activation_threshold);
+        }
+
+        if(im2col_blob != NULL)
+            delete im2col_blob;
+        if(conv_output != output)
+            delete conv_output;
+    }
+
+    /*
+     * 1x1 convolution in DM layout is a plain gemm:
+     * input [h*w x channels] * filters^T [channels x num_filters] = output [h*w x num_filters]
+     */
+    void DM_Layer_Conv::DM_LAYOUT_conv_1x1_gpu(DM_Blob *input, DM_Blob *output) {
+        //with a fused max-pooling, the result of the convolution only lives in a scratch blob
+        DM_Blob *conv_output = output;
+        if(fused_maxpool)
+            conv_output = new DM_Blob(get_conv_output_shapes(input->get_shape_at(0)), ENVIRONMENT_GPU, this->precision, NULL);
+
+        int m = num_filters;
+        int gpu_m = gpu_num_filters; //columns of the output computed here, a split layer leaves the others to the cpu
+        int k = num_channels;
+        int n = output_h * output_w;
+        int input_offset = input_h * input_w * num_channels;
+        int output_offset = n * m;
+
+        //images of the batch are independent, their gemms run on different queues
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        bool is_forked = input->get_shape_at(0) > 1 && gpu_engine.ForkQueues();
+        for (int b = 0; b < input->get_shapes()[0]; b++) {
+            if(is_forked)
+                gpu_engine.SelectQueue(b);
+            cl_command_queue queue = gpu_engine.GetCurrentQueue();
+            cl_event event;
+            CLBlastStatusCode status;
+            if (precision == PRECISION_32) {
+                status = CLBlastSgemm(CLBlastLayoutRowMajor,
+                                      CLBlastTransposeNo, CLBlastTransposeYes,
+                                      n, gpu_m, k,
+                                      1.0f,
+                                      input->get_gpu_data(), b * input_offset, k,
+                                      filters->get_gpu_data(), 0, k,
+                                      0,
+                                      conv_output->get_gpu_data(), b * output_offset, m,
+                                      &queue, &event);
+            } else {
+                status = CLBlastHgemm(CLBlastLayoutRowMajor,
+                                      CLBlastTransposeNo, CLBlastTransposeYes,
+                                      n, gpu_m, k,
+                                      1.0f,
+                                      input->get_gpu_data(), b * input_offset, k,
+                                      filters->get_gpu_data(), 0, k,
+                                      0,
+                                      conv_output->get_gpu_data(), b * output_offset, m,
+                                      &queue, &event);
+            }
 
-                if (status == CLBlastSuccess) {
-                    clWaitForEvents(1, &event);
+            //CLBlast takes no wait list, the in-order queue runs the gemm after the commands producing its inputs
+            //(a forked queue waits for everything enqueued before the fork)
+            if (status == CLBlastSuccess) {
+                if(is_forked)
                     clReleaseEvent(event);
-                } else {
-                    LOGE("[%s]: Gemm_2 failed with status %d", this->name.c_str(), status);
-                    output->set_corrupted(true);
-                    break;
-                }
+                else
+                    conv_output->set_ready_event(event);
+            } else {
+                LOGE("[%s]: Gemm_1x1 failed with status %d", this->name.c_str(), status);
+                output->set_corrupted(true);
+                break;
             }
         }
-        
-        delete im2col_blob;
 
-        if(biases != NULL) {
-            delete biases_multiplier;
-            delete biases_multiplier_blob;
+        if(is_forked) {
+            cl_event event = NULL;
+            gpu_engine.JoinQueues(&event);
+            conv_output->set_ready_event(event);
         }
+
+        //output is [batches x n x m], one bias per column
+        if(!output->is_corrupted()) {
+            if(fused_maxpool)
+                DeepMon::Get().GetGpuExecutionEngine().ExecuteBiasActivationMaxPool2x2(precision, mem_layout,
+                                                                                       conv_output, m, output_h, output_w,
+                                                                                       output, pooled_h, pooled_w,
+                                                                                       biases, activation_type, activation_threshold);
+            else
+                DeepMon::Get().GetGpuExecutionEngine().ExecuteBiasActivation(precision, output, m, 1,
+                                                                             biases, activation_type, activation_threshold);
+        }
+
+        if(conv_output != output)
+            delete conv_output;
+    }
+
+    /*
+     * Build options of the dm_conv_local variant compiled for this layer, "" for the generic kernel
+     * Filters bigger than the generic local buffer are always specialized
+     */
+    string DM_Layer_Conv::get_specialization_options() {
+        uint32_t filter_size = filter_w * filter_h;
+        if(!this->specialize_kernels && filter_size <= DEFAULT_LOCAL_WEIGHTS)
+            return string("");
+
+        //up to 64 channels per chunk, fewer if the filter is big
+        uint32_t chunk_channels = std::min(num_channels, std::min((uint32_t)64, std::max((uint32_t)1, MAX_LOCAL_WEIGHTS / filter_size)));
+        uint32_t kernel_output_h = fused_maxpool ? pooled_h : output_h;
+        uint32_t kernel_output_w = fused_maxpool ? pooled_w : output_w;
+
+        return "-DSPECIALIZED"
+               " -DINPUT_W=" + std::to_string(input_w) + " -DINPUT_H=" + std::to_string(input_h) +
+               " -DINPUT_C=" + std::to_string(num_channels) +
+               " -DCONV_W=" + std::to_string(filter_w) + " -DCONV_H=" + std::to_string(filter_h) +
+               " -DCONV_N=" + std::to_string(num_filters) +
+               " -DSTRIDE_W=" + std::to_string(stride_w) + " -DSTRIDE_H=" + std::to_string(stride_h) +
+               " -DPAD_W=" + std::to_string(pad_left) + " -DPAD_H=" + std::to_string(pad_top) +
+               " -DOUTPUT_W=" + std::to_string(kernel_output_w) + " -DOUTPUT_H=" + std::to_string(kernel_output_h) +
+               " -DLOCAL_WEIGHTS=" + std::to_string(chunk_channels * filter_size);
     }
 
     void DM_Layer_Conv::DM_LAYOUT_conv_gpu(DM_Blob *input, DM_Blob *output) {
-        cl_int err = CL_SUCCESS;
-        cl_command_queue current_queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
 
-        cl_kernel kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(precision, KERNEL_DM_CONV_LOCAL);
+        //the fused max-pooling variant computes one pooled output per work-item
+        std::string kernel_name = fused_maxpool ? KERNEL_DM_CONV_LOCAL_MAXPOOL : KERNEL_DM_CONV_LOCAL;
+        uint32_t kernel_output_h = fused_maxpool ? pooled_h : output_h;
+        uint32_t kernel_output_w = fused_maxpool ? pooled_w : output_w;
 
         cl_mem cl_input = input->get_gpu_data();
         cl_mem cl_output = output->get_gpu_data();
 
+        //launch parameters are tuned per geometry, the first candidates are the former fixed ones
+        DM_Tuning_Space space;
+        space.vector_widths = vector<unsigned int> {4, 2, 8};
+        space.local_sizes = vector<vector<size_t>> {{128, 1}, {32, 1}, {64, 1}, {256, 1}};
+        std::string key = std::to_string(input_h) + "x" + std::to_string(input_w) + "x" + std::to_string(num_channels)
+                          + ":" + std::to_string(filter_h) + "x" + std::to_string(filter_w) + "x" + std::to_string(num_filters)
+                          + ":" + std::to_string(stride_h) + "x" + std::to_string(stride_w)
+                          + ":" + std::to_string(pad_top) + "x" + std::to_string(pad_left)
+                          + ":" + std::to_string(gpu_num_filters);
+
         for(int idx = 0 ; idx < input->get_shape_at(0) ; idx++) {
             int offset_idx = idx;
-            int i = 0;
-            err  = clSetKernelArg(kernel, i++, sizeof(cl_int), &offset_idx);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_input);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->input_w);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->input_h);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->num_channels);
-            cl_mem filters_data = this->filters->get_gpu_data();
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &filters_data);
-            cl_mem biases_data  = this->biases->get_gpu_data();
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &biases_data);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->filter_w);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->filter_h);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->num_filters);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->stride_w);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->stride_h);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->pad_left);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->pad_top);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_output);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_w);
-            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_h);
-            SAMPLE_CHECK_ERRORS(err);
-            if(err != CL_SUCCESS) {
-                output->set_corrupted(true);
-                return;
-            }
+            cl_int err = gpu_engine.EnqueueTunedKernel(precision, kernel_name, get_specialization_options(), key, space, output,
+                                                       [&](cl_kernel kernel, const size_t *lgs) -> int {
+                int i = 0;
+                cl_int err  = clSetKernelArg(kernel, i++, sizeof(cl_int), &offset_idx);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_input);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->input_w);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->input_h);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->num_channels);
+                cl_mem filters_data = this->filters->get_gpu_data();
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &filters_data);
+                //the kernel never reads biases if has_bias = 0
+                cl_mem biases_data  = (this->biases != NULL) ? this->biases->get_gpu_data() : filters_data;
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &biases_data);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->filter_w);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->filter_h);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->num_filters);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->stride_w);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->stride_h);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->pad_left);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->pad_top);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_output);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &kernel_output_w);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &kernel_output_h);
+                int has_bias = (this->biases != NULL) ? 1 : 0;
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &has_bias);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->activation_type);
+                if(precision == PRECISION_32) {
+                    cl_float negative_slope = this->activation_threshold;
+                    err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &negative_slope);
+                } else {
+                    half negative_slope = FloatToHalf(this->activation_threshold);
+                    err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &negative_slope);
+                }
+                SAMPLE_CHECK_ERRORS(err);
+                if(err != CL_SUCCESS)
+                    return err;
 
-            size_t lgs[2] = {(size_t)128, (size_t)1};
-
-            int wgs_1 = ((output_h * output_w / lgs[0]) + ((output_h * output_w % lgs[0] == 0) ? 0 : 1)) * lgs[0];
-            size_t wgs[2] = {(size_t)wgs_1, (size_t)num_filters};
-
-            err = clEnqueueNDRangeKernel(
-                    current_queue,
-                    kernel,
-                    2,
-                    0,
-                    wgs,
-                    lgs,
-                    0, 0, 0
-            );
-            SAMPLE_CHECK_ERRORS(err);
+                /*
+                 * A work-group copies the weights of one filter into local memory, so the local size is always {x, 1}
+                 * and never left to the driver. The global size has to be a multiple of it, extra work-items skip the loop
+                 */
+                size_t local[2] = {(lgs != NULL) ? lgs[0] : space.local_sizes.at(0).at(0), 1};
+                size_t wgs[2] = {(size_t)(kernel_output_h * kernel_output_w), (size_t)gpu_num_filters};
+                wgs[0] = ((wgs[0] + local[0] - 1) / local[0]) * local[0];
+
+                return gpu_engine.EnqueueKernel(kernel, 2, wgs, local, vector<DM_Blob *> {input}, output);
+            });
             if(err != CL_SUCCESS) {
                 output->set_corrupted(true);
                 return;
             }
         }
-
-        err = clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
-        if(err != CL_SUCCESS) {
-            output->set_corrupted(true);
-            return;
-        }
     }
 
     DM_Blob* DM_Layer_Conv::do_conv_gpu(DM_Blob *input) {
         //need to add batch_size
-        DM_Blob *output = new DM_Blob(vector<uint32_t> {
+        DM_Blob *output = CreateOutputBlob(vector<uint32_t> {
                 input->get_shape_at(0), output_shapes[0], output_shapes[1], output_shapes[2]
-        }, ENVIRONMENT_GPU, this->precision, NULL);
+        });
 
-        if (mem_layout == MEMORY_LAYOUT_CAFFE) {
+        if (cpu_split.IsEnabled()) {
+            split_conv_gpu(input, output);
+        } else if (groups > 1) {
+            grouped_conv_gpu(input, output);
+        } else if (winograd_filters != NULL) {
+            winograd_conv_gpu(input, output);
+        } else if (mem_layout == MEMORY_LAYOUT_CAFFE) {
             CAFFE_LAYOUT_conv_gpu(input, output);
         } else if(mem_layout == MEMORY_LAYOUT_DM) {
-            DM_LAYOUT_conv_gpu(input, output);
+            if(is_pointwise_conv())
+                DM_LAYOUT_conv_1x1_gpu(input, output);
+            else
+                DM_LAYOUT_conv_gpu(input, output);
         }
 
         return output;
@@ -0,0 +1,197 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <layers/dm_layer_conv.hpp>
+#include <dm.hpp>
+#include <clblast_half.h>
+#include <string.h>
+
+namespace deepmon {
+    /*
+     * Direct convolution of one image for groups > 1, data_out receives the raw result (no bias/activation)
+     * DM layout keeps the filters in the inner loop so that it vectorizes over contiguous channels
+     */
+    void DM_Layer_Conv::grouped_conv_cpu(float *data_in, float *data_out) {
+        const int channels_per_group = num_channels / groups;
+        const int filters_per_group = num_filters / groups;
+        const float *weights = filters->get_cpu_data();
+        const bool is_depthwise = is_depthwise_conv();
+
+        DM_Execution_Engine_CPU &cpu_engine = DeepMon::Get().GetCpuExecutionEngine();
+        if(mem_layout == MEMORY_LAYOUT_DM) {
+            //one chunk item is one output row
+            cpu_engine.ParallelFor(output_h, GET_PARALLEL_GRAIN(output_w * num_filters * filter_h * filter_w * channels_per_group),
+                                   [=](uint32_t row_begin, uint32_t row_end) {
+                for(int output_row = row_begin ; output_row < row_end ; output_row++) {
+                    for(int output_col = 0 ; output_col < output_w ; output_col++) {
+                        float *out = data_out + (output_row * output_w + output_col) * num_filters;
+                        memset(out, 0, num_filters * sizeof(float));
+
+                        for(int kernel_row = 0 ; kernel_row < filter_h ; kernel_row++) {
+                            int input_row = output_row * stride_h - (int)pad_top + kernel_row * dilation_h;
+                            if(input_row < 0 || input_row >= input_h)
+                                continue;
+
+                            for(int kernel_col = 0 ; kernel_col < filter_w ; kernel_col++) {
+                                int input_col = output_col * stride_w - (int)pad_left + kernel_col * dilation_w;
+                                if(input_col < 0 || input_col >= input_w)
+                                    continue;
+
+                                const float *in = data_in + (input_row * input_w + input_col) * num_channels;
+                                if(is_depthwise) {
+                                    //weights are [filter_h][filter_w][num_filters] for depthwise layers
+                                    const float *w = weights + (kernel_row * filter_w + kernel_col) * num_filters;
+                                    if(filters_per_group == 1) {
+                                        for(int f = 0 ; f < num_filters ; f++)
+                                            out[f] += in[f] * w[f];
+                                    } else {
+                                        for(int f = 0 ; f < num_filters ; f++)
+                                            out[f] += in[f / filters_per_group] * w[f];
+                                    }
+                                } else {
+                                    for(int f = 0 ; f < num_filters ; f++) {
+                                        const float *x = in + (f / filters_per_group) * channels_per_group;
+                                        const float *w = weights + ((f * filter_h + kernel_row) * filter_w + kernel_col) * channels_per_group;
+                                        float sum = 0;
+                                        for(int c = 0 ; c < channels_per_group ; c++)
+                                            sum += x[c] * w[c];
+                                        out[f] += sum;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+        } else if(mem_layout == MEMORY_LAYOUT_CAFFE) {
+            const int input_size = input_h * input_w;
+            const int output_size = output_h * output_w;
+            //one chunk item is one filter
+            cpu_engine.ParallelFor(num_filters, GET_PARALLEL_GRAIN(output_size * filter_h * filter_w * channels_per_group),
+                                   [=](uint32_t f_begin, uint32_t f_end) {
+                for(int f = f_begin ; f < f_end ; f++) {
+                    float *out = data_out + f * output_size;
+                    memset(out, 0, output_size * sizeof(float));
+
+                    for(int c = 0 ; c < channels_per_group ; c++) {
+                        const float *in = data_in + ((f / filters_per_group) * channels_per_group + c) * input_size;
+                        const float *w = weights + (f * channels_per_group + c) * filter_h * filter_w;
+
+                        for(int kernel_row = 0 ; kernel_row < filter_h ; kernel_row++) {
+                            for(int kernel_col = 0 ; kernel_col < filter_w ; kernel_col++) {
+                                float weight = w[kernel_row * filter_w + kernel_col];
+                                for(int output_row = 0 ; output_row < output_h ; output_row++) {
+                                    int input_row = output_row * stride_h - (int)pad_top + kernel_row * dilation_h;
+                                    if(input_row < 0 || input_row >= input_h)
+                                        continue;
+
+                                    for(int output_col = 0 ; output_col < output_w ; output_col++) {
+                                        int input_col = output_col * stride_w - (int)pad_left + kernel_col * dilation_w;
+                                        if(input_col >= 0 && input_col < input_w)
+                                            out[output_row * output_w + output_col] += weight * in[input_row * input_w + input_col];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    //one work-item per output value, bias and activation are applied by the kernel
+    void DM_Layer_Conv::grouped_conv_gpu(DM_Blob *input, DM_Blob *output) {
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        cl_kernel kernel = gpu_engine.GetKernel(precision, KERNEL_GROUPED_CONV);
+
+        //with a fused max-pooling, the result of the convolution only lives in a scratch blob
+        DM_Blob *conv_output = output;
+        if(fused_maxpool)
+            conv_output = new DM_Blob(get_conv_output_shapes(input->get_shape_at(0)), ENVIRONMENT_GPU, this->precision, NULL);
+
+        cl_mem cl_input = input->get_gpu_data();
+        cl_mem cl_output = conv_output->get_gpu_data();
+        cl_mem cl_filters = filters->get_gpu_data();
+        //the fused max-pooling applies bias and activation itself, the kernel never reads biases if has_bias = 0
+        int has_bias = (biases != NULL && !fused_maxpool) ? 1 : 0;
+        cl_mem cl_biases = (biases != NULL) ? biases->get_gpu_data() : cl_filters;
+        int activation = fused_maxpool ? ACTIVATION_NONE : activation_type;
+        int is_dm_layout = (mem_layout == MEMORY_LAYOUT_DM) ? 1 : 0;
+
+        cl_int err = CL_SUCCESS;
+        int i = 0;
+        err  = clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_input);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &input_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &input_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &num_channels);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_filters);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &filter_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &filter_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &num_filters);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &groups);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &stride_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &stride_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &pad_top);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &pad_left);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &dilation_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &dilation_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &is_dm_layout);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_output);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_h);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_w);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &has_bias);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_biases);
+        err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &activation);
+        if(precision == PRECISION_32) {
+            cl_float negative_slope = activation_threshold;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &negative_slope);
+        } else {
+            half negative_slope = FloatToHalf(activation_threshold);
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &negative_slope);
+        }
+        SAMPLE_CHECK_ERRORS(err);
+
+        if(err == CL_SUCCESS) {
+            //neighbouring work-items write neighbouring values: filters in DM layout, pixels in Caffe layout
+            size_t wgs[3] = {(size_t)num_filters, (size_t)(output_h * output_w), (size_t)input->get_shape_at(0)};
+            if(!is_dm_layout) {
+                wgs[0] = output_h * output_w;
+                wgs[1] = num_filters;
+            }
+            err = gpu_engine.EnqueueKernel(kernel, 3, wgs, NULL,
+                                           vector<DM_Blob *> {input, filters, biases}, conv_output);
+        }
+
+        if(err != CL_SUCCESS)
+            output->set_corrupted(true);
+
+        if(fused_maxpool && !output->is_corrupted())
+            gpu_engine.ExecuteBiasActivationMaxPool2x2(precision, mem_layout,
+                                                       conv_output, num_filters, output_h, output_w,
+                                                       output, pooled_h, pooled_w,
+                                                       biases, activation_type, activation_threshold);
+
+        if(conv_output != output)
+            delete conv_output;
+    }
+}
@@ -0,0 +1,137 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <layers/dm_layer_conv.hpp>
+#include <dm.hpp>
+#include <cblas.h>
+#include <chrono>
+#include <thread>
+
+namespace deepmon {
+    /*
+     * CPU part of a split convolution: filters [first_filter, first_filter + count) of every image
+     * input is a host copy of the layer's input, output receives [batches x count x n] (caffe) or [batches x n x count] (dm)
+     */
+    void DM_Layer_Conv::split_conv_cpu(DM_Blob *input, float *output, uint32_t first_filter, uint32_t count) {
+        uint32_t batches = input->get_shape_at(0);
+        int n = output_h * output_w;
+        int k = num_channels * filter_h * filter_w;
+
+        DM_Blob *im2col_blob = NULL;
+        if(!is_pointwise_conv()) {
+            if(mem_layout == MEMORY_LAYOUT_CAFFE) {
+                im2col_blob = new DM_Blob(vector<uint32_t> {batches, (uint32_t)k, output_h, output_w}, ENVIRONMENT_CPU, PRECISION_32, NULL);
+                CAFFE_LAYOUT_im2col_cpu(input, im2col_blob);
+            } else {
+                im2col_blob = new DM_Blob(vector<uint32_t> {batches, output_h, output_w, (uint32_t)k}, ENVIRONMENT_CPU, PRECISION_32, NULL);
+                DM_LAYOUT_im2col_cpu(input, im2col_blob);
+            }
+        }
+        DM_Blob *gemm_input = (im2col_blob != NULL) ? im2col_blob : input;
+
+        float *weights = split_filters->get_cpu_data() + first_filter * k;
+        float *biases_data = (split_biases != NULL) ? split_biases->get_cpu_data() + first_filter : NULL;
+
+        for(int b = 0 ; b < batches ; b++) {
+            float *data_im = gemm_input->get_cpu_data() + b * n * k;
+            float *output_im = output + b * n * count;
+
+            //caffe: output_im is [count x n], one bias per row. dm: output_im is [n x count], one bias per column
+            if(mem_layout == MEMORY_LAYOUT_CAFFE) {
+                DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(false, count, n, k,
+                                                                   weights, k,
+                                                                   data_im, n,
+                                                                   output_im, n);
+                DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(output_im, 1, count, n,
+                                                                             biases_data, activation_type, activation_threshold);
+            } else {
+                DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(true, n, count, k,
+                                                                   data_im, k,
+                                                                   weights, k,
+                                                                   output_im, count);
+                DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(output_im, n, count, 1,
+                                                                             biases_data, activation_type, activation_threshold);
+            }
+        }
+
+        if(im2col_blob != NULL)
+            delete im2col_blob;
+    }
+
+    /*
+     * Runs the last filters of a GPU layer on the CPU engine while the GPU computes the first ones
+     * The GPU writes its filters in place, the CPU part is copied into the remaining channels once both are done
+     * AUTO ratios are calibrated with the time each half took
+     */
+    void DM_Layer_Conv::split_conv_gpu(DM_Blob *input, DM_Blob *output) {
+        uint32_t batches = input->get_shape_at(0);
+        uint32_t n = output_h * output_w;
+        uint32_t cpu_num_filters = cpu_split.GetCpuItems(num_filters);
+        this->gpu_num_filters = num_filters - cpu_num_filters;
+
+        //the gpu queue is only used from this thread, the input is read back before the cpu part starts
+        DM_Blob *cpu_input = input->ConvertToCpuBlob();
+        if(cpu_input == NULL) {
+            this->gpu_num_filters = num_filters;
+            output->set_corrupted(true);
+            return;
+        }
+        float *cpu_output = new float[batches * n * cpu_num_filters];
+
+        double cpu_ms = 0;
+        std::thread cpu_worker([&] {
+            std::chrono::steady_clock::time_point cpu_start = std::chrono::steady_clock::now();
+            split_conv_cpu(cpu_input, cpu_output, gpu_num_filters, cpu_num_filters);
+            cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpu_start).count();
+        });
+
+        std::chrono::steady_clock::time_point gpu_start = std::chrono::steady_clock::now();
+        if(mem_layout == MEMORY_LAYOUT_CAFFE)
+            CAFFE_LAYOUT_conv_gpu(input, output);
+        else if(is_pointwise_conv())
+            DM_LAYOUT_conv_1x1_gpu(input, output);
+        else
+            DM_LAYOUT_conv_gpu(input, output);
+        //commands are asynchronous, the gpu part is done once its output is ready
+        DeepMon::Get().GetGpuExecutionEngine().WaitForBlob(output);
+        double gpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gpu_start).count();
+
+        cpu_worker.join();
+
+        //caffe: the cpu part is a [count x n] block of every image. dm: count columns of every pixel
+        if(!output->is_corrupted()) {
+            if(mem_layout == MEMORY_LAYOUT_CAFFE)
+                DeepMon::Get().GetGpuExecutionEngine().WriteColumns(output, batches, num_filters * n,
+                                                                    gpu_num_filters * n, cpu_num_filters * n, cpu_output);
+            else
+                DeepMon::Get().GetGpuExecutionEngine().WriteColumns(output, batches * n, num_filters,
+                                                                    gpu_num_filters, cpu_num_filters, cpu_output);
+        }
+
+        cpu_split.Calibrate(cpu_num_filters, cpu_ms, gpu_num_filters, gpu_ms);
+        this->gpu_num_filters = num_filters;
+
+        delete[] cpu_output;
+        delete cpu_input;
+    }
+}
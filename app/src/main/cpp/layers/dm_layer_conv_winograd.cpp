@@ -0,0 +1,384 @@
+/*The MIT License (MIT)
+ *
+ *Copyright (c) 2013 Thomas Park
+ *
+ *Permission is hereby granted, free of charge, to any person obtaining a copy
+ *       of this software and associated documentation files (the "Software"), to deal
+ *in the Software without restriction, including without limitation the rights
+ *       to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *       copies of the Software, and to permit persons to whom the Software is
+ *furnished to do so, subject to the following conditions:
+ *
+ *       The above copyright notice and this permission notice shall be included in
+ *all copies or substantial portions of the Software.
+ *
+ *THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *THE SOFTWARE.
+ */
+
+#include <layers/dm_layer_conv.hpp>
+#include <dm.hpp>
+#include <cblas.h>
+#include <clblast_half.h>
+#include <algorithm>
+
+namespace deepmon {
+    /*
+     * Transformation matrices of Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks"
+     * F(m x m, 3x3) works on input tiles of alpha = m + 2
+     */
+    static const float winograd_2x2_bt[4 * 4] = {
+            1,  0, -1,  0,
+            0,  1,  1,  0,
+            0, -1,  1,  0,
+            0,  1,  0, -1
+    };
+    static const float winograd_2x2_g[4 * 3] = {
+            1.0f,  0.0f, 0.0f,
+            0.5f,  0.5f, 0.5f,
+            0.5f, -0.5f, 0.5f,
+            0.0f,  0.0f, 1.0f
+    };
+    static const float winograd_2x2_at[2 * 4] = {
+            1, 1,  1,  0,
+            0, 1, -1, -1
+    };
+
+    static const float winograd_4x4_bt[6 * 6] = {
+            4,  0, -5,  0, 1, 0,
+            0, -4, -4,  1, 1, 0,
+            0,  4, -4, -1, 1, 0,
+            0, -2, -1,  2, 1, 0,
+            0,  2, -1, -2, 1, 0,
+            0,  4,  0, -5, 0, 1
+    };
+    static const float winograd_4x4_g[6 * 3] = {
+             1.0f / 4,  0.0f,       0.0f,
+            -1.0f / 6, -1.0f / 6,  -1.0f / 6,
+            -1.0f / 6,  1.0f / 6,  -1.0f / 6,
+             1.0f / 24, 1.0f / 12,  1.0f / 6,
+             1.0f / 24, -1.0f / 12, 1.0f / 6,
+             0.0f,      0.0f,       1.0f
+    };
+    static const float winograd_4x4_at[4 * 6] = {
+            1, 1,  1, 1,  1, 0,
+            0, 1, -1, 2, -2, 0,
+            0, 1,  1, 4,  4, 0,
+            0, 1, -1, 8, -8, 1
+    };
+
+    //out[r x r] = left[r x k] * in[k x k] * left^T
+    static void winograd_transform(const float *left, int r, int k, const float *in, float *out) {
+        float tmp[6 * 6];
+        for(int i = 0 ; i < r ; i++) {
+            for(int j = 0 ; j < k ; j++) {
+                float sum = 0;
+                for(int l = 0 ; l < k ; l++)
+                    sum += left[i * k + l] * in[l * k + j];
+                tmp[i * k + j] = sum;
+            }
+        }
+
+        for(int i = 0 ; i < r ; i++) {
+            for(int j = 0 ; j < r ; j++) {
+                float sum = 0;
+                for(int l = 0 ; l < k ; l++)
+                    sum += tmp[i * k + l] * left[j * k + l];
+                out[i * r + j] = sum;
+            }
+        }
+    }
+
+    /*
+     * U = G * g * G^T for every (filter, channel), stored as alpha * alpha matrices of [num_filters x num_channels]
+     * weights_data is in the layout of this layer
+     */
+    void DM_Layer_Conv::winograd_transform_filters(float *weights_data) {
+        uint32_t alpha = get_winograd_tile_size() + 2;
+        const float *g_matrix = (alpha == 6) ? winograd_4x4_g : winograd_2x2_g;
+
+        float *transformed = new float[alpha * alpha * num_filters * num_channels];
+        for(int f = 0 ; f < num_filters ; f++) {
+            for(int c = 0 ; c < num_channels ; c++) {
+                float g[3 * 3];
+                float u[6 * 6];
+                for(int i = 0 ; i < 3 ; i++) {
+                    for(int j = 0 ; j < 3 ; j++) {
+                        if(mem_layout == MEMORY_LAYOUT_CAFFE)
+                            g[i * 3 + j] = weights_data[((f * num_channels + c) * 3 + i) * 3 + j];
+                        else
+                            g[i * 3 + j] = weights_data[((f * 3 + i) * 3 + j) * num_channels + c];
+                    }
+                }
+
+                //G is [alpha x 3]
+                float tmp[6 * 3];
+                for(int i = 0 ; i < alpha ; i++) {
+                    for(int j = 0 ; j < 3 ; j++) {
+                        tmp[i * 3 + j] = g_matrix[i * 3] * g[j] + g_matrix[i * 3 + 1] * g[3 + j] + g_matrix[i * 3 + 2] * g[6 + j];
+                    }
+                }
+                for(int i = 0 ; i < alpha ; i++) {
+                    for(int j = 0 ; j < alpha ; j++) {
+                        u[i * alpha + j] = tmp[i * 3] * g_matrix[j * 3] + tmp[i * 3 + 1] * g_matrix[j * 3 + 1] + tmp[i * 3 + 2] * g_matrix[j * 3 + 2];
+                    }
+                }
+
+                for(int xi = 0 ; xi < alpha * alpha ; xi++)
+                    transformed[(xi * num_filters + f) * num_channels + c] = u[xi];
+            }
+        }
+
+        this->winograd_filters = new DM_Blob(vector<uint32_t> {alpha * alpha, num_filters, num_channels},
+                                             this->env, this->precision, transformed);
+        delete[] transformed;
+    }
+
+    //number of tiles transformed at once, bounds the size of the transformed inputs and products
+    uint32_t DM_Layer_Conv::get_winograd_block_size(uint32_t num_tiles) {
+        uint32_t alpha = get_winograd_tile_size() + 2;
+        uint32_t block_size = WINOGRAD_BLOCK_ITEMS / (alpha * alpha * std::max(num_channels, num_filters));
+        return std::max((uint32_t)1, std::min(block_size, num_tiles));
+    }
+
+    /*
+     * Convolution of one image, data_out receives the raw result (no bias/activation) in the layout of this layer
+     * For a block of tiles: V = B^T * d * B, M[xi] = U[xi] * V[xi] (one gemm per xi), Y = A^T * M * A
+     */
+    void DM_Layer_Conv::winograd_conv_cpu(float *data_in, float *data_out) {
+        const int m = get_winograd_tile_size();
+        const int alpha = m + 2;
+        const float *bt = (m == 4) ? winograd_4x4_bt : winograd_2x2_bt;
+        const float *at = (m == 4) ? winograd_4x4_at : winograd_2x2_at;
+
+        const int tiles_h = (output_h + m - 1) / m;
+        const int tiles_w = (output_w + m - 1) / m;
+        const int num_tiles = tiles_h * tiles_w;
+
+        const int block_size = get_winograd_block_size(num_tiles);
+
+        DM_Blob *v_blob = new DM_Blob(vector<uint32_t> {(uint32_t)(alpha * alpha), num_channels, (uint32_t)block_size},
+                                      ENVIRONMENT_CPU, PRECISION_32, NULL);
+        DM_Blob *m_blob = new DM_Blob(vector<uint32_t> {(uint32_t)(alpha * alpha), num_filters, (uint32_t)block_size},
+                                      ENVIRONMENT_CPU, PRECISION_32, NULL);
+        float *v_data = v_blob->get_cpu_data();
+        float *m_data = m_blob->get_cpu_data();
+        float *u_data = winograd_filters->get_cpu_data();
+        DM_Execution_Engine_CPU &cpu_engine = DeepMon::Get().GetCpuExecutionEngine();
+
+        for(int tile_start = 0 ; tile_start < num_tiles ; tile_start += block_size) {
+            int num_block_tiles = std::min(block_size, num_tiles - tile_start);
+
+            //input transform, one chunk item is one tile
+            cpu_engine.ParallelFor(num_block_tiles, GET_PARALLEL_GRAIN(alpha * alpha * num_channels * 4),
+                                   [=](uint32_t p_begin, uint32_t p_end) {
+                for(int p = p_begin ; p < p_end ; p++) {
+                    int y0 = ((tile_start + p) / tiles_w) * m - (int)pad_top;
+                    int x0 = ((tile_start + p) % tiles_w) * m - (int)pad_left;
+                    for(int c = 0 ; c < num_channels ; c++) {
+                        float d[6 * 6];
+                        float v[6 * 6];
+                        for(int i = 0 ; i < alpha ; i++) {
+                            int y = y0 + i;
+                            for(int j = 0 ; j < alpha ; j++) {
+                                int x = x0 + j;
+                                if(y < 0 || y >= input_h || x < 0 || x >= input_w)
+                                    d[i * alpha + j] = 0;
+                                else if(mem_layout == MEMORY_LAYOUT_CAFFE)
+                                    d[i * alpha + j] = data_in[(c * input_h + y) * input_w + x];
+                                else
+                                    d[i * alpha + j] = data_in[(y * input_w + x) * num_channels + c];
+                            }
+                        }
+
+                        winograd_transform(bt, alpha, alpha, d, v);
+
+                        for(int xi = 0 ; xi < alpha * alpha ; xi++)
+                            v_data[(xi * num_channels + c) * block_size + p] = v[xi];
+                    }
+                }
+            });
+
+            //element-wise products of all channels, as alpha * alpha gemms
+            for(int xi = 0 ; xi < alpha * alpha ; xi++) {
+                DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(false, num_filters, num_block_tiles, num_channels,
+                                                                   u_data + xi * num_filters * num_channels, num_channels,
+                                                                   v_data + xi * num_channels * block_size, block_size,
+                                                                   m_data + xi * num_filters * block_size, block_size);
+            }
+
+            //output transform, one chunk item is one tile
+            cpu_engine.ParallelFor(num_block_tiles, GET_PARALLEL_GRAIN(alpha * alpha * num_filters * 4),
+                                   [=](uint32_t p_begin, uint32_t p_end) {
+                for(int p = p_begin ; p < p_end ; p++) {
+                    int y0 = ((tile_start + p) / tiles_w) * m;
+                    int x0 = ((tile_start + p) % tiles_w) * m;
+                    for(int f = 0 ; f < num_filters ; f++) {
+                        float mm[6 * 6];
+                        float y[4 * 4];
+                        for(int xi = 0 ; xi < alpha * alpha ; xi++)
+                            mm[xi] = m_data[(xi * num_filters + f) * block_size + p];
+
+                        winograd_transform(at, m, alpha, mm, y);
+
+                        for(int i = 0 ; i < m && y0 + i < output_h ; i++) {
+                            for(int j = 0 ; j < m && x0 + j < output_w ; j++) {
+                                if(mem_layout == MEMORY_LAYOUT_CAFFE)
+                                    data_out[(f * output_h + y0 + i) * output_w + x0 + j] = y[i * m + j];
+                                else
+                                    data_out[((y0 + i) * output_w + x0 + j) * num_filters + f] = y[i * m + j];
+                            }
+                        }
+                    }
+                }
+            });
+        }
+
+        delete v_blob;
+        delete m_blob;
+    }
+
+    /*
+     * Same pipeline as winograd_conv_cpu with one kernel per step: input transform, batched gemm over the
+     * alpha * alpha coefficients and output transform, which also applies bias and activation
+     */
+    void DM_Layer_Conv::winograd_conv_gpu(DM_Blob *input, DM_Blob *output) {
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+        cl_kernel input_kernel = gpu_engine.GetKernel(precision, KERNEL_WINOGRAD_INPUT_TRANSFORM);
+        cl_kernel gemm_kernel = gpu_engine.GetKernel(precision, KERNEL_WINOGRAD_BATCHED_GEMM);
+        cl_kernel output_kernel = gpu_engine.GetKernel(precision, KERNEL_WINOGRAD_OUTPUT_TRANSFORM);
+
+        //with a fused max-pooling, the result of the convolution only lives in a scratch blob
+        DM_Blob *conv_output = output;
+        if(fused_maxpool)
+            conv_output = new DM_Blob(get_conv_output_shapes(input->get_shape_at(0)), ENVIRONMENT_GPU, this->precision, NULL);
+
+        int tile_size = get_winograd_tile_size();
+        int alpha = tile_size + 2;
+        int tiles_h = (output_h + tile_size - 1) / tile_size;
+        int tiles_w = (output_w + tile_size - 1) / tile_size;
+        int num_tiles = tiles_h * tiles_w;
+        int block_size = get_winograd_block_size(num_tiles);
+        int is_dm_layout = (mem_layout == MEMORY_LAYOUT_DM) ? 1 : 0;
+        int pad_top = this->pad_top;
+        int pad_left = this->pad_left;
+
+        DM_Blob *v_blob = new DM_Blob(vector<uint32_t> {(uint32_t)(alpha * alpha), num_channels, (uint32_t)block_size},
+                                      ENVIRONMENT_GPU, this->precision, NULL);
+        DM_Blob *m_blob = new DM_Blob(vector<uint32_t> {(uint32_t)(alpha * alpha), num_filters, (uint32_t)block_size},
+                                      ENVIRONMENT_GPU, this->precision, NULL);
+
+        cl_mem cl_input = input->get_gpu_data();
+        cl_mem cl_output = conv_output->get_gpu_data();
+        cl_mem cl_v = v_blob->get_gpu_data();
+        cl_mem cl_m = m_blob->get_gpu_data();
+        cl_mem cl_filters = winograd_filters->get_gpu_data();
+        //the fused max-pooling applies bias and activation itself, the kernel never reads biases if has_bias = 0
+        int has_bias = (biases != NULL && !fused_maxpool) ? 1 : 0;
+        cl_mem cl_biases = (biases != NULL) ? biases->get_gpu_data() : cl_filters;
+        int activation = fused_maxpool ? ACTIVATION_NONE : activation_type;
+
+        int input_size = input_h * input_w * num_channels;
+        int output_size = output_h * output_w * num_filters;
+
+        cl_int err = CL_SUCCESS;
+        for(int b = 0 ; b < input->get_shape_at(0) && err == CL_SUCCESS ; b++) {
+            int input_offset = b * input_size;
+            int output_offset = b * output_size;
+            for(int tile_start = 0 ; tile_start < num_tiles ; tile_start += block_size) {
+                int num_block_tiles = std::min(block_size, num_tiles - tile_start);
+
+                int i = 0;
+                err  = clSetKernelArg(input_kernel, i++, sizeof(cl_int), &tile_size);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_mem), &cl_input);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &input_offset);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &is_dm_layout);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &num_channels);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &input_h);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &input_w);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &pad_top);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &pad_left);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &tiles_w);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &tile_start);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_int), &num_block_tiles);
+                err |= clSetKernelArg(input_kernel, i++, sizeof(cl_mem), &cl_v);
+
+                i = 0;
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_int), &num_filters);
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_int), &num_channels);
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_int), &num_block_tiles);
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_mem), &cl_filters);
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_mem), &cl_v);
+                err |= clSetKernelArg(gemm_kernel, i++, sizeof(cl_mem), &cl_m);
+
+                i = 0;
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &tile_size);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_mem), &cl_m);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &num_filters);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &tiles_w);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &tile_start);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &num_block_tiles);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &is_dm_layout);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_mem), &cl_output);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &output_offset);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &output_h);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &output_w);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &has_bias);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_mem), &cl_biases);
+                err |= clSetKernelArg(output_kernel, i++, sizeof(cl_int), &activation);
+                if(precision == PRECISION_32) {
+                    cl_float negative_slope = activation_threshold;
+                    err |= clSetKernelArg(output_kernel, i++, sizeof(cl_float), &negative_slope);
+                } else {
+                    half negative_slope = FloatToHalf(activation_threshold);
+                    err |= clSetKernelArg(output_kernel, i++, sizeof(cl_half), &negative_slope);
+                }
+                SAMPLE_CHECK_ERRORS(err);
+                if(err != CL_SUCCESS)
+                    break;
+
+                size_t tile_wgs[2] = {(size_t)num_block_tiles, (size_t)num_channels};
+                err = gpu_engine.EnqueueKernel(input_kernel, 2, tile_wgs, NULL,
+                                               vector<DM_Blob *> {input}, v_blob);
+                if(err != CL_SUCCESS)
+                    break;
+
+                size_t gemm_lgs[3] = {WINOGRAD_GEMM_TILE, WINOGRAD_GEMM_TILE, 1};
+                size_t gemm_wgs[3] = {
+                        (size_t)((num_block_tiles + WINOGRAD_GEMM_TILE - 1) / WINOGRAD_GEMM_TILE * WINOGRAD_GEMM_TILE),
+                        (size_t)((num_filters + WINOGRAD_GEMM_TILE - 1) / WINOGRAD_GEMM_TILE * WINOGRAD_GEMM_TILE),
+                        (size_t)(alpha * alpha)
+                };
+                err = gpu_engine.EnqueueKernel(gemm_kernel, 3, gemm_wgs, gemm_lgs,
+                                               vector<DM_Blob *> {winograd_filters, v_blob}, m_blob);
+                if(err != CL_SUCCESS)
+                    break;
+
+                tile_wgs[1] = num_filters;
+                err = gpu_engine.EnqueueKernel(output_kernel, 2, tile_wgs, NULL,
+                                               vector<DM_Blob *> {m_blob, biases}, conv_output);
+                if(err != CL_SUCCESS)
+                    break;
+            }
+        }
+
+        if(err != CL_SUCCESS)
+            output->set_corrupted(true);
+
+        if(fused_maxpool && !output->is_corrupted())
+            gpu_engine.ExecuteBiasActivationMaxPool2x2(precision, mem_layout,
+                                                       conv_output, num_filters, output_h, output_w,
+                                                       output, pooled_h, pooled_w,
+                                                       biases, activation_type, activation_threshold);
+
+        delete v_blob;
+        delete m_blob;
+        if(conv_output != output)
+            delete conv_output;
+    }
+}
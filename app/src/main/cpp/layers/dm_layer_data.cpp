@@ -75,10 +75,8 @@ namespace deepmon {
 
         /*
          * For better performance, we forward this blob to next layer
-         * To prevent this blob being deleted, we need to set it to persistent blob even though this layer does not require
+         * DM_Layer::Forward counts the top layers as consumers before releasing the input, so it is not deleted
          */
-        input->set_persistent(true);
-
         return input;
     }
 
@@ -100,8 +98,6 @@ namespace deepmon {
             return NULL;
         }
 
-        input->set_persistent(true);
-
         return input;
     }
 }
\ No newline at end of file
@@ -44,10 +44,33 @@ namespace deepmon {
 
         this->num_neurons = layer["NUM_NEURONS"].asUInt();
 
+        this->activation_type = GET_ACTIVATION_TYPE(layer["ACTIVATION"].asString().c_str());
+        this->activation_threshold = layer["ACTIVATION_THRESHOLD"].asFloat();
+        if(this->activation_type == ACTIVATION_UNKNOWN) {
+            LOGE("[%s]: Unsupported activation %s", this->name.c_str(), layer["ACTIVATION"].asString().c_str());
+            this->corrupted = true;
+            return;
+        }
+
         if(!weights_path.compare("") || this->num_neurons < 1) {
             this->corrupted = true;
             return;
         }
+
+        this->gpu_num_neurons = this->num_neurons;
+        this->cpu_split.Parse(layer["CPU_SPLIT"]);
+        if(this->cpu_split.IsEnabled() && (this->env != ENVIRONMENT_GPU || this->precision != PRECISION_32 || this->num_neurons < 2)) {
+            LOGE("[%s]: CPU_SPLIT needs a FP32 GPU layer, the layer is not split", this->name.c_str());
+            this->cpu_split.Disable();
+        }
+    }
+
+    DM_Layer_Fc::~DM_Layer_Fc() {
+        vector<DM_Blob *> weights {filters, biases, split_filters, split_biases};
+        for(int i = 0 ; i < weights.size() ; i++) {
+            if(weights.at(i) != NULL)
+                delete weights.at(i);
+        }
     }
 
     void DM_Layer_Fc::ComputeOutputShapes(vector<vector<uint32_t >> inputs_shapes_no_batches) {
@@ -83,6 +106,8 @@ namespace deepmon {
                 bias_data = new float[this->num_neurons];
                 fread((void*)bias_data, sizeof(float), this->num_neurons, fp);
                 this->biases = new DM_Blob(vector<uint32_t>{this->num_neurons}, this->env, this->precision, bias_data);
+                if(cpu_split.IsEnabled())
+                    this->split_biases = new DM_Blob(vector<uint32_t>{this->num_neurons}, ENVIRONMENT_CPU, PRECISION_32, bias_data);
                 delete bias_data;
             }
 
@@ -138,6 +163,8 @@ namespace deepmon {
             fclose(fp);
 
             this->filters = new DM_Blob(this->filters_shapes, this->env, this->precision, weights_data);
+            if(cpu_split.IsEnabled())
+                this->split_filters = new DM_Blob(this->filters_shapes, ENVIRONMENT_CPU, PRECISION_32, weights_data);
             delete weights_data;
         } else {
             if(this->has_bias) {
@@ -145,6 +172,8 @@ namespace deepmon {
                 for(int i = 0 ; i < this->num_neurons ; i++)
                     bias_data[i] = 1.0f;
                 this->biases = new DM_Blob(vector<uint32_t>{this->num_neurons}, this->env, this->precision, bias_data);
+                if(cpu_split.IsEnabled())
+                    this->split_biases = new DM_Blob(vector<uint32_t>{this->num_neurons}, ENVIRONMENT_CPU, PRECISION_32, bias_data);
                 delete bias_data;
             }
 
@@ -154,6 +183,8 @@ namespace deepmon {
                 weights_data[i] = 1;
 
             this->filters = new DM_Blob(filters_shapes, this->env, this->precision, weights_data);
+            if(cpu_split.IsEnabled())
+                this->split_filters = new DM_Blob(filters_shapes, ENVIRONMENT_CPU, PRECISION_32, weights_data);
             delete weights_data;
         }
     }
@@ -26,6 +26,7 @@
 #include <dm_common.hpp>
 #include <layers/dm_layer_fc.hpp>
 #include <cblas.h>
+#include <dm.hpp>
 
 using namespace std;
 using namespace deepmon;
@@ -47,9 +48,9 @@ namespace deepmon {
 
         int batches = input->get_shape_at(0);
 
-        DM_Blob *result = new DM_Blob(vector<uint32_t> {
+        DM_Blob *result = CreateOutputBlob(vector<uint32_t> {
                 input->get_shape_at(0), output_shapes[0]
-        }, ENVIRONMENT_CPU, PRECISION_32, NULL);
+        });
 
         float *data_in = input->get_cpu_data();
         float *data_out = result->get_cpu_data();
@@ -58,33 +59,15 @@ namespace deepmon {
         int n = num_neurons;
         int k = input_size;
 
-        cblas_sgemm(CblasRowMajor,
-                    CblasNoTrans,
-                    CblasTrans,
-                    m, n, k,
-                    1.0f,
-                    data_in, k,
-                    filters->get_cpu_data(), k,
-                    0, data_out, n);
+        DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(true, m, n, k,
+                                                           data_in, k,
+                                                           filters->get_cpu_data(), k,
+                                                           data_out, n);
 
-        float *biases_multiplier = NULL;
-        if(biases != NULL) {
-            biases_multiplier = new float[n];
-            for(int i = 0 ; i < n ; i++)
-                biases_multiplier[i] = 1;
-        }
-
-        if(biases != NULL) {
-            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-                        batches, n, 1,
-                        1.0f,
-                        biases_multiplier, 1,
-                        biases->get_cpu_data(), n,
-                        1.0, data_out, n);
-        }
-
-        if(biases != NULL)
-            delete biases_multiplier;
+        //data_out is [batches x n], one bias per column
+        DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(data_out, batches, n, 1,
+                                                                     (biases != NULL) ? biases->get_cpu_data() : NULL,
+                                                                     activation_type, activation_threshold);
 
         return result;
     }
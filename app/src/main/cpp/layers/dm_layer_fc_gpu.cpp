@@ -27,7 +27,11 @@
 #include <layers/dm_layer_fc.hpp>
 #include <clblast_c.h>
 #include <clblast.h>
+#include <clblast_half.h>
 #include <dm.hpp>
+#include <cblas.h>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 using namespace deepmon;
@@ -141,77 +145,131 @@ namespace deepmon {
         return output;
     }*/
 
-    DM_Blob* DM_Layer_Fc::ForwardGpu(vector<DM_Blob *> blobs) {
-        if(blobs.size() != 1) {
-            LOGE("[%s] has more than 1 input", this->name.c_str());
-            return NULL;
-        }
-
-        DM_Blob *input = blobs[0];
-
+    //neurons [0, gpu_num_neurons) of every input, rows of the output stay num_neurons apart
+    void DM_Layer_Fc::fc_gpu(DM_Blob *input, DM_Blob *output) {
+        DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
         int batches = input->get_shape_at(0);
 
-        DM_Blob *output = new DM_Blob(vector<uint32_t> {
-                input->get_shape_at(0), output_shapes[0]
-        }, ENVIRONMENT_GPU, this->precision, NULL);
-
-        int m = batches;
-        int n = num_neurons;
-        int k = input_size;
-
         cl_mem data_in = input->get_gpu_data();
         cl_mem data_out = output->get_gpu_data();
 
-        cl_int err = CL_SUCCESS;
-        cl_command_queue current_queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
-        cl_kernel kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(precision, KERNEL_DM_FC_BASE);
-
-        for(int batch_idx = 0 ; batch_idx < batches ; batch_idx++) {
-            int offset_idx = batch_idx;
+        //the kernel loops over the neurons, so any work-group size fits, empty = chosen by the driver
+        DM_Tuning_Space space;
+        space.vector_widths = vector<unsigned int> {4, 2, 8};
+        space.local_sizes = vector<vector<size_t>> {{}, {32, 1}, {64, 1}, {128, 1}};
+        int input_size = input->get_size() / batches;
+        int output_size = this->gpu_num_neurons;
+        std::string key = std::to_string(input_size) + ":" + std::to_string(output_size);
+
+        //all frames of the batch in one launch, the frames share the rows of weights
+        cl_int err = gpu_engine.EnqueueTunedKernel(precision, KERNEL_DM_FC_BASE, "", key, space, output,
+                                                   [&](cl_kernel kernel, const size_t *lgs) -> int {
+            int offset_idx = 0;
             int i = 0;
-
-            err = clSetKernelArg(kernel, i++, sizeof(cl_int), &offset_idx);
+            cl_int err = clSetKernelArg(kernel, i++, sizeof(cl_int), &offset_idx);
             err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &data_in);
-            int input_size = input->get_size() / batches;
             err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &input_size);
             cl_mem weights_data = this->filters->get_gpu_data();
             err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &weights_data);
-            cl_mem biases_data = this->biases->get_gpu_data();
+            //the kernel never reads biases if has_bias = 0
+            cl_mem biases_data = (this->biases != NULL) ? this->biases->get_gpu_data() : weights_data;
             err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &biases_data);
             err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &data_out);
-            int output_size = output->get_size() / batches;
             err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_size);
-
-            SAMPLE_CHECK_ERRORS(err);
-            if(err != CL_SUCCESS) {
-                output->set_corrupted(true);
-                return output;
+            int output_stride = output->get_size() / batches;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_stride);
+            int has_bias = (this->biases != NULL) ? 1 : 0;
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &has_bias);
+            err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &this->activation_type);
+            if(precision == PRECISION_32) {
+                cl_float negative_slope = this->activation_threshold;
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_float), &negative_slope);
+            } else {
+                half negative_slope = FloatToHalf(this->activation_threshold);
+                err |= clSetKernelArg(kernel, i++, sizeof(cl_half), &negative_slope);
             }
 
-            size_t wgs[1] = {(size_t)output_size};
-
-            err = clEnqueueNDRangeKernel(
-                    current_queue,
-                    kernel,
-                    1,
-                    0,
-                    wgs,
-                    0,
-                    0, 0, 0
-            );
             SAMPLE_CHECK_ERRORS(err);
-            if(err != CL_SUCCESS) {
-                output->set_corrupted(true);
-                return output;
-            }
-        }
+            if(err != CL_SUCCESS)
+                return err;
+
+            //the global size has to be a multiple of the local size, extra work-items skip the loop
+            size_t wgs[2] = {(size_t)output_size, (size_t)batches};
+            if(lgs != NULL)
+                wgs[0] = ((wgs[0] + lgs[0] - 1) / lgs[0]) * lgs[0];
 
-        err = clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
-        if(err != CL_SUCCESS) {
+            return gpu_engine.EnqueueKernel(kernel, 2, wgs, lgs, vector<DM_Blob *> {input}, output);
+        });
+        if(err != CL_SUCCESS)
             output->set_corrupted(true);
-            return output;
+    }
+
+    /*
+     * Runs the last neurons on the CPU engine while the GPU computes the first ones,
+     * the CPU part is copied into the output once both are done
+     */
+    void DM_Layer_Fc::split_fc_gpu(DM_Blob *input, DM_Blob *output) {
+        uint32_t batches = input->get_shape_at(0);
+        uint32_t cpu_num_neurons = cpu_split.GetCpuItems(num_neurons);
+        this->gpu_num_neurons = num_neurons - cpu_num_neurons;
+
+        //the gpu queue is only used from this thread, the input is read back before the cpu part starts
+        DM_Blob *cpu_input = input->ConvertToCpuBlob();
+        if(cpu_input == NULL) {
+            this->gpu_num_neurons = num_neurons;
+            output->set_corrupted(true);
+            return;
         }
+        float *cpu_output = new float[batches * cpu_num_neurons];
+
+        double cpu_ms = 0;
+        std::thread cpu_worker([&] {
+            std::chrono::steady_clock::time_point cpu_start = std::chrono::steady_clock::now();
+            DeepMon::Get().GetCpuExecutionEngine().ExecuteGemm(true, batches, cpu_num_neurons, input_size,
+                                                               cpu_input->get_cpu_data(), input_size,
+                                                               split_filters->get_cpu_data() + gpu_num_neurons * input_size, input_size,
+                                                               cpu_output, cpu_num_neurons);
+            DeepMon::Get().GetCpuExecutionEngine().ExecuteBiasActivation(cpu_output, batches, cpu_num_neurons, 1,
+                                                                         (split_biases != NULL) ? split_biases->get_cpu_data() + gpu_num_neurons : NULL,
+                                                                         activation_type, activation_threshold);
+            cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpu_start).count();
+        });
+
+        std::chrono::steady_clock::time_point gpu_start = std::chrono::steady_clock::now();
+        fc_gpu(input, output);
+        //commands are asynchronous, the gpu part is done once its output is ready
+        DeepMon::Get().GetGpuExecutionEngine().WaitForBlob(output);
+        double gpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gpu_start).count();
+
+        cpu_worker.join();
+
+        if(!output->is_corrupted())
+            DeepMon::Get().GetGpuExecutionEngine().WriteColumns(output, batches, num_neurons,
+                                                                gpu_num_neurons, cpu_num_neurons, cpu_output);
+
+        cpu_split.Calibrate(cpu_num_neurons, cpu_ms, gpu_num_neurons, gpu_ms);
+        this->gpu_num_neurons = num_neurons;
+
+        delete[] cpu_output;
+        delete cpu_input;
+    }
+
+    DM_Blob* DM_Layer_Fc::ForwardGpu(vector<DM_Blob *> blobs) {
+        if(blobs.size() != 1) {
+            LOGE("[%s] has more than 1 input", this->name.c_str());
+            return NULL;
+        }
+
+        DM_Blob *input = blobs[0];
+
+        DM_Blob *output = CreateOutputBlob(vector<uint32_t> {
+                input->get_shape_at(0), output_shapes[0]
+        });
+
+        if(cpu_split.IsEnabled())
+            split_fc_gpu(input, output);
+        else
+            fc_gpu(input, output);
 
         return output;
     }
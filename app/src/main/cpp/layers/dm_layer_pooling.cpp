@@ -120,6 +120,24 @@ namespace deepmon {
         }
     }
 
+    /*
+     * All supported activations are monotonic, so max(act(x)) = act(max(x)) and the activation
+     * is only applied to the pooled values. DM max-pooling treats padding as 0 which stays 0 after
+     * every activation except sigmoid.
+     */
+    bool DM_Layer_Pooling::FuseActivation(int activation_type, float activation_threshold) {
+        if(this->type.compare("MAXPOOL") || this->activation_type != ACTIVATION_NONE)
+            return false;
+
+        bool has_padding = pad_left != 0 || pad_right != 0 || pad_top != 0 || pad_bottom != 0;
+        if(activation_type == ACTIVATION_SIGMOID && mem_layout == MEMORY_LAYOUT_DM && has_padding)
+            return false;
+
+        this->activation_type = activation_type;
+        this->activation_threshold = activation_threshold;
+        return true;
+    }
+
     DM_Blob* DM_Layer_Pooling::ForwardCpu(vector<DM_Blob *> blobs) {
 
         if(blobs.size() != 1) {
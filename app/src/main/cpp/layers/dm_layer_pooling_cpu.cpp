@@ -23,19 +23,20 @@
 
 #include <layers/dm_layer_pooling.hpp>
 #include <dm_layer_param.hpp>
+#include <dm_simd.hpp>
+#include <dm.hpp>
 
 namespace deepmon {
     void DM_Layer_Pooling::CAFFE_LAYOUT_ForwardCPU_MaxPool(DM_Blob *input, DM_Blob *output) {
         uint32_t batches = input->get_shape_at(0);
 
-        float *bottom_data = input->get_cpu_data();
-        float *top_data = output->get_cpu_data();
+        //one chunk item is one channel of one image
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(batches * num_channels, GET_PARALLEL_GRAIN(filter_h * filter_w * output_h * output_w),
+                                                           [=](uint32_t plane_begin, uint32_t plane_end) {
+            for(int plane = plane_begin ; plane < plane_end ; plane++) {
+                const float *bottom_data = input->get_cpu_data() + plane * input_w * input_h;
+                float *top_data = output->get_cpu_data() + plane * output_w * output_h;
 
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            top_data[i] = -999999.999f;
-
-        for(int b = 0 ; b < batches ; b++) {
-            for(int c = 0 ; c < num_channels ; c++) {
                 for(int ph = 0 ; ph < output_h ; ph++) {
                     for(int pw = 0 ; pw < output_w ; pw++) {
                         int hstart = ph * stride_h - pad_top;
@@ -46,6 +47,7 @@ namespace deepmon {
                         wstart = max(wstart, (int)0);
 
                         const int pool_index = ph * output_w + pw;
+                        top_data[pool_index] = -999999.999f;
                         for (int h = hstart; h < hend; ++h) {
                             for (int w = wstart; w < wend; ++w) {
                                 const int index = h * input_w + w;
@@ -54,26 +56,23 @@ namespace deepmon {
                                 }
                             }
                         }
+                        top_data[pool_index] = ACTIVATE(top_data[pool_index], activation_type, activation_threshold);
                     }
                 }
-
-                bottom_data += input_w * input_h;
-                top_data += output_w * output_h;
             }
-        }
+        });
     }
 
     void DM_Layer_Pooling::CAFFE_LAYOUT_ForwardCPU_AvePool(DM_Blob *input, DM_Blob *output) {
         uint32_t batches = input->get_shape_at(0);
 
-        float *bottom_data = input->get_cpu_data();
-        float *top_data = output->get_cpu_data();
+        //one chunk item is one channel of one image
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(batches * num_channels, GET_PARALLEL_GRAIN(filter_h * filter_w * output_h * output_w),
+                                                           [=](uint32_t plane_begin, uint32_t plane_end) {
+            for (int plane = plane_begin; plane < plane_end; plane++) {
+                const float *bottom_data = input->get_cpu_data() + plane * input_w * input_h;
+                float *top_data = output->get_cpu_data() + plane * output_w * output_h;
 
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            top_data[i] = 0;
-
-        for (int b = 0; b < batches; b++) {
-            for (int c = 0; c < num_channels; ++c) {
                 for (int ph = 0; ph < output_h; ++ph) {
                     for (int pw = 0; pw < output_w; ++pw) {
                         int hstart = ph * stride_h - pad_top;
@@ -85,6 +84,7 @@ namespace deepmon {
                         wstart = max(wstart, (int)0);
                         hend = min(hend, (int)input_h);
                         wend = min(wend, (int)input_w);
+                        top_data[ph * output_w + pw] = 0;
                         for (int h = hstart; h < hend; ++h) {
                             for (int w = wstart; w < wend; ++w) {
                                 top_data[ph * output_w + pw] += bottom_data[h * input_w + w];
@@ -93,104 +93,159 @@ namespace deepmon {
                         top_data[ph * output_w + pw] /= pool_size;
                     }
                 }
-                bottom_data += input_w * input_h;
-                top_data += output_w * output_h;
             }
+        });
+    }
+
+    /*
+     * Max over a K x K window which lies completely inside the input, in points to its top-left pixel
+     * The window is unrolled, this covers the common 2x2/s2 and 3x3/s2 pooling layers
+     */
+    template <int K>
+    static inline void dm_maxpool_window(const float *in, int row_stride, int num_channels, float *out) {
+        int c = 0;
+        for(; c + DM_SIMD_WIDTH <= num_channels ; c += DM_SIMD_WIDTH) {
+            dm_simd_f acc = dm_simd_load(in + c);
+            for(int y = 0 ; y < K ; y++) {
+                for(int x = 0 ; x < K ; x++)
+                    acc = dm_simd_max(acc, dm_simd_load(in + y * row_stride + x * num_channels + c));
+            }
+            dm_simd_store(out + c, acc);
+        }
+        for(; c < num_channels ; c++) {
+            float acc = in[c];
+            for(int y = 0 ; y < K ; y++) {
+                for(int x = 0 ; x < K ; x++)
+                    acc = max(acc, in[y * row_stride + x * num_channels + c]);
+            }
+            out[c] = acc;
         }
     }
 
+    //any window, in points to its first valid pixel. Padded pixels count as 0
+    static inline void dm_maxpool_window(const float *in, int row_stride, int num_channels,
+                                         int window_h, int window_w, bool is_clipped, float *out) {
+        int c = 0;
+        for(; c + DM_SIMD_WIDTH <= num_channels ; c += DM_SIMD_WIDTH) {
+            dm_simd_f acc = (is_clipped || window_h <= 0 || window_w <= 0) ? dm_simd_set1(0) : dm_simd_load(in + c);
+            for(int y = 0 ; y < window_h ; y++) {
+                for(int x = 0 ; x < window_w ; x++)
+                    acc = dm_simd_max(acc, dm_simd_load(in + y * row_stride + x * num_channels + c));
+            }
+            dm_simd_store(out + c, acc);
+        }
+        for(; c < num_channels ; c++) {
+            float acc = (is_clipped || window_h <= 0 || window_w <= 0) ? 0 : in[c];
+            for(int y = 0 ; y < window_h ; y++) {
+                for(int x = 0 ; x < window_w ; x++)
+                    acc = max(acc, in[y * row_stride + x * num_channels + c]);
+            }
+            out[c] = acc;
+        }
+    }
+
+    /*
+     * Channels are contiguous in DM layout: the window bounds are computed once per output pixel
+     * and the channels are processed DM_SIMD_WIDTH at a time
+     */
     void DM_Layer_Pooling::DM_LAYOUT_ForwardCPU_MaxPool(DM_Blob *input, DM_Blob *output) {
         uint32_t batches = input->get_shape_at(0);
 
-        float *bottom_data = input->get_cpu_data();
-        float *top_data = output->get_cpu_data();
-
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            top_data[i] = -999999.999f;
-
-        for(int b = 0 ; b < batches ; b++) {
-            for(int ph = 0 ; ph < output_h ; ph++) {
-                for(int pw = 0 ; pw < output_w ; pw++) {
-                    int hstart = ph * stride_h - pad_top;
-                    int wstart = pw * stride_w - pad_left;
-
-                    int base_idx = (ph * output_w + pw) * num_channels;
+        const int row_stride = input_w * num_channels;
 
-                    for(int y = 0 ; y < filter_h ; y++) {
-                        int y_ = hstart + y;
-                        for(int x = 0 ; x < filter_w ; x++) {
-                            int x_ = wstart + x;
-                            for(int c = 0 ; c < num_channels ; c++) {
-                                float d = 0;
+        //one chunk item is one output row of one image
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(batches * output_h, GET_PARALLEL_GRAIN(filter_h * filter_w * output_w * num_channels),
+                                                           [=](uint32_t row_begin, uint32_t row_end) {
+            for(int row = row_begin ; row < row_end ; row++) {
+                int ph = row % output_h;
+                const float *bottom_data = input->get_cpu_data() + (row / output_h) * num_channels * input_w * input_h;
+                float *top_data = output->get_cpu_data() + (row / output_h) * num_channels * output_w * output_h;
 
-                                if(x_ < 0 || y_ < 0 || x_ >= input_w || y_ >= input_h)
-                                    d = 0;
-                                else
-                                    d = bottom_data[(y_ * input_w + x_) * num_channels + c];
+                int hstart = ph * (int)stride_h - (int)pad_top;
+                int hend = min(hstart + (int)filter_h, (int)input_h);
+                int h0 = max(hstart, 0);
 
-                                top_data[base_idx + c] = max(top_data[base_idx + c], d);
-                            }
-                        }
+                for(int pw = 0 ; pw < output_w ; pw++) {
+                    int wstart = pw * (int)stride_w - (int)pad_left;
+                    int wend = min(wstart + (int)filter_w, (int)input_w);
+                    int w0 = max(wstart, 0);
+
+                    bool is_clipped = (h0 != hstart || w0 != wstart || hend - hstart != filter_h || wend - wstart != filter_w);
+                    const float *in = bottom_data + (h0 * input_w + w0) * num_channels;
+                    float *out = top_data + (ph * output_w + pw) * num_channels;
+
+                    if(!is_clipped && filter_h == 2 && filter_w == 2)
+                        dm_maxpool_window<2>(in, row_stride, num_channels, out);
+                    else if(!is_clipped && filter_h == 3 && filter_w == 3)
+                        dm_maxpool_window<3>(in, row_stride, num_channels, out);
+                    else
+                        dm_maxpool_window(in, row_stride, num_channels, hend - h0, wend - w0, is_clipped, out);
+
+                    if(activation_type != ACTIVATION_NONE) {
+                        for(int c = 0 ; c < num_channels ; c++)
+                            out[c] = ACTIVATE(out[c], activation_type, activation_threshold);
                     }
                 }
             }
-            bottom_data += num_channels * input_w * input_h;
-            top_data += num_channels * output_w * output_h;
-        }
+        });
     }
 
     void DM_Layer_Pooling::DM_LAYOUT_ForwardCPU_AvePool(DM_Blob *input, DM_Blob *output) {
         uint32_t batches = input->get_shape_at(0);
 
-        float *bottom_data = input->get_cpu_data();
-        float *top_data = output->get_cpu_data();
-
-        for(int i = 0 ; i < output->get_total_size() ; i++)
-            top_data[i] = 0;
-
-        for(int b = 0 ; b < batches ; b++) {
-            for(int ph = 0 ; ph < output_h ; ph++) {
-                for(int pw = 0 ; pw < output_w ; pw++) {
-                    int hstart = ph * stride_h - pad_top;
-                    int wstart = pw * stride_w - pad_left;
+        const int row_stride = input_w * num_channels;
 
-                    int hend = min(hstart + filter_h, input_h + pad_bottom);
-                    int wend = min(wstart + filter_w, input_w + pad_right);
+        //one chunk item is one output row of one image
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(batches * output_h, GET_PARALLEL_GRAIN(filter_h * filter_w * output_w * num_channels),
+                                                           [=](uint32_t row_begin, uint32_t row_end) {
+            for(int row = row_begin ; row < row_end ; row++) {
+                int ph = row % output_h;
+                const float *bottom_data = input->get_cpu_data() + (row / output_h) * num_channels * input_w * input_h;
+                float *top_data = output->get_cpu_data() + (row / output_h) * num_channels * output_w * output_h;
 
-                    int pool_size = (hend - hstart) * (wend - wstart);
+                int hstart = ph * (int)stride_h - (int)pad_top;
+                int hend = min(hstart + (int)filter_h, (int)(input_h + pad_bottom));
+                int h0 = max(hstart, 0);
+                int h1 = min(hend, (int)input_h);
 
-                    int base_idx = (ph * output_w + pw) * num_channels;
-                    for(int y = 0 ; y < filter_h ; y++) {
-                        int y_ = hstart + y;
-                        for(int x = 0 ; x < filter_w ; x++) {
-                            int x_ = wstart + x;
-                            for(int c = 0 ; c < num_channels ; c++) {
-                                float d = 0;
-
-                                if(x_ < 0 || y_ < 0 || x_ >= input_w || y_ >= input_h)
-                                    d = 0;
-                                else
-                                    d = bottom_data[(y_ * input_w + x_) * num_channels + c];
-
-                                top_data[base_idx + c] += d;
-                            }
+                for(int pw = 0 ; pw < output_w ; pw++) {
+                    int wstart = pw * (int)stride_w - (int)pad_left;
+                    int wend = min(wstart + (int)filter_w, (int)(input_w + pad_right));
+                    int w0 = max(wstart, 0);
+                    int w1 = min(wend, (int)input_w);
+
+                    //padded pixels are part of the average
+                    float scale = 1.0f / ((hend - hstart) * (wend - wstart));
+                    const float *in = bottom_data + (h0 * input_w + w0) * num_channels;
+                    float *out = top_data + (ph * output_w + pw) * num_channels;
+
+                    int c = 0;
+                    for(; c + DM_SIMD_WIDTH <= num_channels ; c += DM_SIMD_WIDTH) {
+                        dm_simd_f acc = dm_simd_set1(0);
+                        for(int y = 0 ; y < h1 - h0 ; y++) {
+                            for(int x = 0 ; x < w1 - w0 ; x++)
+                                acc = dm_simd_add(acc, dm_simd_load(in + y * row_stride + x * num_channels + c));
                         }
+                        dm_simd_store(out + c, dm_simd_mul(acc, dm_simd_set1(scale)));
+                    }
+                    for(; c < num_channels ; c++) {
+                        float acc = 0;
+                        for(int y = 0 ; y < h1 - h0 ; y++) {
+                            for(int x = 0 ; x < w1 - w0 ; x++)
+                                acc += in[y * row_stride + x * num_channels + c];
+                        }
+                        out[c] = acc * scale;
                     }
-
-                    for(int c = 0 ; c < num_channels ; c++)
-                        top_data[base_idx + c] /= pool_size;
                 }
             }
-            bottom_data += num_channels * input_w * input_h;
-            top_data += num_channels * output_w * output_h;
-        }
+        });
     }
 
     DM_Blob* DM_Layer_Pooling::do_pooling_cpu(DM_Blob *input) {
 
-        DM_Blob *output = new DM_Blob(vector<uint32_t> {
+        DM_Blob *output = CreateOutputBlob(vector<uint32_t> {
                 input->get_shape_at(0), output_shapes[0], output_shapes[1], output_shapes[2]
-        }, ENVIRONMENT_CPU, PRECISION_32, NULL);
+        });
 
         if(mem_layout == MEMORY_LAYOUT_CAFFE) {
             if(!type.compare("MAXPOOL")) {
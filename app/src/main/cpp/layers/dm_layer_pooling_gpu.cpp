@@ -24,16 +24,28 @@
 #include <layers/dm_layer_pooling.hpp>
 #include <dm_layer_param.hpp>
 #include <dm.hpp>
+#include <clblast_half.h>
 
 using namespace deepmon;
 
 namespace deepmon {
+    cl_int DM_Layer_Pooling::set_activation_args(cl_kernel kernel, int &arg_idx) {
+        cl_int err = clSetKernelArg(kernel, arg_idx++, sizeof(cl_int), &this->activation_type);
+        if(precision == PRECISION_32) {
+            cl_float negative_slope = this->activation_threshold;
+            err |= clSetKernelArg(kernel, arg_idx++, sizeof(cl_float), &negative_slope);
+        } else {
+            half negative_slope = FloatToHalf(this->activation_threshold);
+            err |= clSetKernelArg(kernel, arg_idx++, sizeof(cl_half), &negative_slope);
+        }
+        return err;
+    }
+
     void DM_Layer_Pooling::CAFFE_LAYOUT_ForwardGPU(DM_Blob *input, DM_Blob *output) {
         int batches = input->get_shape_at(0);
         int count = output->get_total_size();
 
         cl_int err = CL_SUCCESS;
-        cl_command_queue current_queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
 
         cl_mem cl_input = input->get_gpu_data();
         cl_mem cl_output = output->get_gpu_data();
@@ -61,6 +73,8 @@ namespace deepmon {
         err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &pad_top);
         err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &pad_left);
         err |= clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_output);
+        if(!type.compare("MAXPOOL"))
+            err |= set_activation_args(kernel, i);
 
         SAMPLE_CHECK_ERRORS(err);
         if(err != CL_SUCCESS) {
@@ -69,17 +83,8 @@ namespace deepmon {
         }
 
         size_t wgs[1] = {(size_t)(output_h * output_w)};
-        err = clEnqueueNDRangeKernel(
-                current_queue,
-                kernel,
-                1,
-                0,
-                wgs,
-                0,
-                0, 0, 0
-        );
-        err |= clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
+        err = DeepMon::Get().GetGpuExecutionEngine().EnqueueKernel(kernel, 1, wgs, NULL,
+                                                                   vector<DM_Blob *> {input}, output);
 
         if(err != CL_SUCCESS) {
             output->set_corrupted(true);
@@ -87,21 +92,40 @@ namespace deepmon {
         }
     }
 
+    //build options of the dm_maxpool/dm_avepool variant compiled for this layer, "" for the generic kernels
+    string DM_Layer_Pooling::get_specialization_options() {
+        if(!this->specialize_kernels)
+            return string("");
+
+        return "-DSPECIALIZED"
+               " -DINPUT_W=" + std::to_string(input_w) + " -DINPUT_H=" + std::to_string(input_h) +
+               " -DNUM_CHANNELS=" + std::to_string(num_channels) +
+               " -DFILTER_W=" + std::to_string(filter_w) + " -DFILTER_H=" + std::to_string(filter_h) +
+               " -DSTRIDE_W=" + std::to_string(stride_w) + " -DSTRIDE_H=" + std::to_string(stride_h) +
+               " -DPAD_W=" + std::to_string(pad_left) + " -DPAD_H=" + std::to_string(pad_top) +
+               " -DOUTPUT_W=" + std::to_string(output_w) + " -DOUTPUT_H=" + std::to_string(output_h);
+    }
+
     void DM_Layer_Pooling::DM_LAYOUT_ForwardGPU(DM_Blob *input, DM_Blob *output) {
         int batches = input->get_shape_at(0);
 
         cl_int err = CL_SUCCESS;
-        cl_command_queue current_queue = DeepMon::Get().GetGpuExecutionEngine().GetCurrentQueue();
 
         cl_mem cl_input = input->get_gpu_data();
         cl_mem cl_output = output->get_gpu_data();
 
-        cl_kernel kernel;
+        cl_kernel kernel = NULL;
 
+        //variants are compiled once per geometry and shared by the layers having it
+        string build_options = get_specialization_options();
         if(!type.compare("MAXPOOL"))
-            kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(this->precision, KERNEL_DM_MAXPOOL);
+            kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(this->precision, KERNEL_DM_MAXPOOL, build_options);
         else if(!type.compare("AVEPOOL"))
-            kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(this->precision, KERNEL_DM_AVEPOOL);
+            kernel = DeepMon::Get().GetGpuExecutionEngine().GetKernel(this->precision, KERNEL_DM_AVEPOOL, build_options);
+        if(kernel == NULL) {
+            output->set_corrupted(true);
+            return;
+        }
 
         int i = 0;
         err  = clSetKernelArg(kernel, i++, sizeof(cl_mem), &cl_input);
@@ -118,6 +142,8 @@ namespace deepmon {
         err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_w);
         err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &output_h);
         err |= clSetKernelArg(kernel, i++, sizeof(cl_int), &batches);
+        if(!type.compare("MAXPOOL"))
+            err |= set_activation_args(kernel, i);
         SAMPLE_CHECK_ERRORS(err);
         if(err != CL_SUCCESS) {
             output->set_corrupted(true);
@@ -126,17 +152,8 @@ namespace deepmon {
 
         size_t wgs[3] = {(size_t)output_w, (size_t)output_h, (size_t)num_channels};
 
-        err = clEnqueueNDRangeKernel(
-                current_queue,
-                kernel,
-                3,
-                0,
-                wgs,
-                0,
-                0, 0, 0
-        );
-        err |= clFinish(current_queue);
-        SAMPLE_CHECK_ERRORS(err);
+        err = DeepMon::Get().GetGpuExecutionEngine().EnqueueKernel(kernel, 3, wgs, NULL,
+                                                                   vector<DM_Blob *> {input}, output);
         if(err != CL_SUCCESS) {
             output->set_corrupted(true);
             return;
@@ -144,9 +161,9 @@ namespace deepmon {
     }
 
     DM_Blob* DM_Layer_Pooling::do_pooling_gpu(DM_Blob *input) {
-        DM_Blob *output = new DM_Blob(vector<uint32_t> {
+        DM_Blob *output = CreateOutputBlob(vector<uint32_t> {
                 input->get_shape_at(0), output_shapes[0], output_shapes[1], output_shapes[2]
-        }, ENVIRONMENT_GPU, this->precision, NULL);
+        });
 
         if(this->mem_layout == MEMORY_LAYOUT_CAFFE)
             CAFFE_LAYOUT_ForwardGPU(input, output);
@@ -22,7 +22,8 @@
  */
 
 #include <layers/dm_layer_softmax.hpp>
-#include <math.h>
+#include <dm_math.hpp>
+#include <dm.hpp>
 
 namespace deepmon {
     DM_Layer_Softmax::DM_Layer_Softmax(DM_Layer_Param &param) : DM_Layer(param.GetName(), param.GetType(), param.GetInputLayersNames(), param.GetMemoryLayout()) {
@@ -41,7 +42,7 @@ namespace deepmon {
         vector<uint32_t> input_shapes = inputs_shapes_no_batches.at(0);
 
         uint32_t output_size = 1;
-        for(int i = 0 ; i < inputs_shapes_no_batches.size() ; i++)
+        for(int i = 0 ; i < input_shapes.size() ; i++)
             output_size *= input_shapes.at(i);
 
         this->output_shapes.push_back(output_size);
@@ -54,22 +55,18 @@ namespace deepmon {
             return NULL;
         }
 
-        DM_Blob *result = blobs[0];
+        //compute in-place unless another layer still reads the input
+        DM_Blob *input = blobs[0];
+        DM_Blob *result = IsInputReusable(input) ? input : CreateOutputBlob(input->get_shapes());
 
-        for(int b = 0 ; b < result->get_shape_at(0) ; b++) {
-            float *output = result->get_cpu_data() + b * this->output_shapes.at(0);
-
-            float dsum = 0;
-            for(int i = 0 ; i < this->output_shapes.at(0) ; i++) {
-                dsum += exp((double)output[i]);
-            }
-
-            for(int i = 0 ; i < this->output_shapes.at(0) ; i++) {
-                output[i] = (float)(exp((double)output[i]) / dsum);
-            }
-        }
-
-        result->set_persistent(true);
+        uint32_t size = this->output_shapes.at(0);
+        float *data_in = input->get_cpu_data();
+        float *data_out = result->get_cpu_data();
+        DeepMon::Get().GetCpuExecutionEngine().ParallelFor(result->get_shape_at(0), GET_PARALLEL_GRAIN(size),
+                                                           [=](uint32_t b_begin, uint32_t b_end) {
+            for(int b = b_begin ; b < b_end ; b++)
+                dm_softmax(data_in + b * size, data_out + b * size, size);
+        });
 
         return result;
     }
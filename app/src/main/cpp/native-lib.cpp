@@ -22,15 +22,30 @@
  */
 
 #include <jni.h>
+#include <android/bitmap.h>
 #include <string>
 #include <dm.hpp>
 #include <dm_net.hpp>
+#include <dm_inference_server.hpp>
 #include <clblast_c.h>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
 
 using namespace deepmon;
 
 DM_Net *net = NULL;
+/*
+ * Batches the frames given to Infer, the other entry points keep working while it runs (DM_Net::Forward is serialized)
+ * Requests hold their own reference, so a server stopped during a request is destroyed when the request returns
+ */
+std::shared_ptr<DM_Inference_Server> server;
+std::mutex server_mutex;
+
+static std::shared_ptr<DM_Inference_Server> get_server() {
+    std::lock_guard<std::mutex> lock(server_mutex);
+    return server;
+}
 
 extern "C"
 JNIEXPORT void JNICALL
@@ -75,15 +90,297 @@ JNIEXPORT jfloatArray JNICALL
 
     /*
      * Default only support 1 inference
+     * The network reads the array in place where it can, it is released (never written back) after the forward
      */
 
-    DM_Blob *input = new DM_Blob(net->GetInputShapes(), ENVIRONMENT_GPU, PRECISION_32, data);
-    env->ReleaseFloatArrayElements(input_arr, data, 0);
+    DM_Blob *input = net->CreateInputView(data, 1);
+    DM_Blob *result = net->Forward(input); //this is cpu blob
+    env->ReleaseFloatArrayElements(input_arr, data, JNI_ABORT);
+    if(result == NULL)
+        return NULL;
+
+    jfloatArray resultArr = env->NewFloatArray(net->GetOutputSize());
+    env->SetFloatArrayRegion(resultArr, 0, net->GetOutputSize(), result->get_cpu_data());
+    delete result;
+
+    return resultArr;
+}
 
+/*
+ * One forward over all frames, every frame is a float array of the input size
+ * Returns one result per frame, or NULL if the inference failed
+ */
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_com_lanytek_deepmon_DeepMon_GetInferenceBatch(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jobjectArray input_arrs) {
+    uint32_t batch_size = env->GetArrayLength(input_arrs);
+    if(batch_size == 0)
+        return NULL;
+
+    uint32_t input_size = 1;
+    vector<uint32_t> input_shapes = net->GetInputShapes(batch_size);
+    for(int i = 1 ; i < input_shapes.size() ; i++)
+        input_size *= input_shapes.at(i);
+
+    float *data = new float[batch_size * input_size];
+    for(uint32_t i = 0 ; i < batch_size ; i++) {
+        jfloatArray input_arr = (jfloatArray)env->GetObjectArrayElement(input_arrs, i);
+        if(input_arr == NULL || env->GetArrayLength(input_arr) != input_size) {
+            LOGE("Frame %d does not match the input size of the network", i);
+            delete[] data;
+            return NULL;
+        }
+        env->GetFloatArrayRegion(input_arr, 0, input_size, data + i * input_size);
+        env->DeleteLocalRef(input_arr);
+    }
+
+    //the stacked frames are read in place by the data layer's engine, they are freed once the forward is done
+    DM_Blob *input = net->CreateInputView(data, batch_size);
     DM_Blob *result = net->Forward(input); //this is cpu blob
+    delete[] data;
+    if(result == NULL)
+        return NULL;
+
+    uint32_t output_size = net->GetOutputSize();
+    jobjectArray resultArrs = env->NewObjectArray(batch_size, env->FindClass("[F"), NULL);
+    for(uint32_t i = 0 ; i < batch_size ; i++) {
+        jfloatArray resultArr = env->NewFloatArray(output_size);
+        env->SetFloatArrayRegion(resultArr, 0, output_size, result->get_cpu_data() + i * output_size);
+        env->SetObjectArrayElement(resultArrs, i, resultArr);
+        env->DeleteLocalRef(resultArr);
+    }
+    delete result;
+
+    return resultArrs;
+}
+
+/*
+ * Zero-copy inference: input holds the frames (native order floats) the network reads in place,
+ * the results are written into output. Both have to be direct buffers, returns false if the inference failed
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_lanytek_deepmon_DeepMon_GetInferenceDirect(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jobject input_buffer,
+        jobject output_buffer) {
+    float *input_data = (float *)env->GetDirectBufferAddress(input_buffer);
+    float *output_data = (float *)env->GetDirectBufferAddress(output_buffer);
+    if(input_data == NULL || output_data == NULL) {
+        LOGE("GetInferenceDirect needs direct buffers");
+        return JNI_FALSE;
+    }
+
+    //the batch size follows from the size of the input
+    jlong frame_bytes = sizeof(float);
+    vector<uint32_t> input_shapes = net->GetInputShapes();
+    for(int i = 1 ; i < input_shapes.size() ; i++)
+        frame_bytes *= input_shapes.at(i);
+    jlong input_bytes = env->GetDirectBufferCapacity(input_buffer);
+    uint32_t batch_size = input_bytes / frame_bytes;
+    if(batch_size == 0 || input_bytes % frame_bytes != 0 ||
+       env->GetDirectBufferCapacity(output_buffer) < (jlong)net->GetOutputSize(batch_size) * sizeof(float)) {
+        LOGE("GetInferenceDirect: buffer sizes do not match the network");
+        return JNI_FALSE;
+    }
+
+    DM_Blob *input = net->CreateInputView(input_data, batch_size);
+    return net->Forward(input, output_data) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * RGBA_8888 bitmap of the input size, every channel becomes (value - mean) * scale
+ * Pixels are converted straight into the input blob of the network (mapped if it lives on the gpu)
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_lanytek_deepmon_DeepMon_GetInferenceBitmap(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jobject bitmap,
+        jfloat mean,
+        jfloat scale,
+        jobject output_buffer) {
+    float *output_data = (float *)env->GetDirectBufferAddress(output_buffer);
+    if(output_data == NULL || env->GetDirectBufferCapacity(output_buffer) < (jlong)net->GetOutputSize() * sizeof(float)) {
+        LOGE("GetInferenceBitmap needs a direct output buffer of the output size");
+        return JNI_FALSE;
+    }
+
+    vector<uint32_t> input_shapes = net->GetInputShapes();
+    bool is_dm_layout = net->GetInputLayout() == MEMORY_LAYOUT_DM;
+    uint32_t input_h = is_dm_layout ? input_shapes.at(1) : input_shapes.at(2);
+    uint32_t input_w = is_dm_layout ? input_shapes.at(2) : input_shapes.at(3);
+    uint32_t input_c = is_dm_layout ? input_shapes.at(3) : input_shapes.at(1);
+
+    AndroidBitmapInfo info;
+    if(AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS ||
+       info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 || info.width != input_w || info.height != input_h || input_c > 4) {
+        LOGE("GetInferenceBitmap needs a RGBA_8888 bitmap of %dx%d", input_w, input_h);
+        return JNI_FALSE;
+    }
+
+    uint8_t *pixels = NULL;
+    if(AndroidBitmap_lockPixels(env, bitmap, (void **)&pixels) != ANDROID_BITMAP_RESULT_SUCCESS)
+        return JNI_FALSE;
+
+    DM_Execution_Engine_GPU &gpu_engine = DeepMon::Get().GetGpuExecutionEngine();
+    bool is_gpu_input = net->GetInputEnvironment() == ENVIRONMENT_GPU;
+    DM_Blob *input = new DM_Blob(input_shapes, net->GetInputEnvironment(), PRECISION_32, NULL);
+    float *data = is_gpu_input ? gpu_engine.MapForWriting(input) : input->get_cpu_data();
+    if(input->is_corrupted() || data == NULL) {
+        AndroidBitmap_unlockPixels(env, bitmap);
+        delete input;
+        return JNI_FALSE;
+    }
+
+    for(uint32_t y = 0 ; y < input_h ; y++) {
+        uint8_t *row = pixels + y * info.stride;
+        for(uint32_t x = 0 ; x < input_w ; x++) {
+            for(uint32_t c = 0 ; c < input_c ; c++) {
+                uint32_t idx = is_dm_layout ? (y * input_w + x) * input_c + c : (c * input_h + y) * input_w + x;
+                data[idx] = ((float)row[x * 4 + c] - mean) * scale;
+            }
+        }
+    }
+    AndroidBitmap_unlockPixels(env, bitmap);
+    if(is_gpu_input)
+        gpu_engine.Unmap(input, data);
+
+    return net->Forward(input, output_data) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_lanytek_deepmon_DeepMon_SetNumThreads(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jint num_threads) {
+    DeepMon::Get().GetCpuExecutionEngine().SetNumThreads(num_threads);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_lanytek_deepmon_DeepMon_GetNumThreads(
+        JNIEnv* env,
+        jobject thisobj/* this */) {
+    return DeepMon::Get().GetCpuExecutionEngine().GetNumThreads();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_lanytek_deepmon_DeepMon_StartStreaming(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jint queue_capacity) {
+    return net->StartStreaming(queue_capacity) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_lanytek_deepmon_DeepMon_StopStreaming(
+        JNIEnv* env,
+        jobject thisobj/* this */) {
+    net->StopStreaming();
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_lanytek_deepmon_DeepMon_SubmitFrame(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jfloatArray input_arr) {
+    jfloat* data = env->GetFloatArrayElements(input_arr, 0);
+    DM_Blob *input = new DM_Blob(net->GetInputShapes(), ENVIRONMENT_CPU, PRECISION_32, data);
+    env->ReleaseFloatArrayElements(input_arr, data, 0);
+
+    if(!net->Submit(input)) {
+        delete input;
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
+
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_com_lanytek_deepmon_DeepMon_PollResult(
+        JNIEnv* env,
+        jobject thisobj/* this */) {
+    DM_Blob *result = NULL;
+    if(!net->Poll(&result))
+        return NULL;
+
+    if(result == NULL)
+        return env->NewFloatArray(0);
+
+    jfloatArray resultArr = env->NewFloatArray(net->GetOutputSize());
+    env->SetFloatArrayRegion(resultArr, 0, net->GetOutputSize(), result->get_cpu_data());
+    delete result;
+
+    return resultArr;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_lanytek_deepmon_DeepMon_StartServer(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jint max_batch_size,
+        jint max_wait_us) {
+    std::shared_ptr<DM_Inference_Server> new_server = std::make_shared<DM_Inference_Server>(net, max_batch_size, max_wait_us);
+    std::lock_guard<std::mutex> lock(server_mutex);
+    server.swap(new_server);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_lanytek_deepmon_DeepMon_StopServer(
+        JNIEnv* env,
+        jobject thisobj/* this */) {
+    //destroyed once the lock is released, or by the last request still using it
+    std::shared_ptr<DM_Inference_Server> stopped_server;
+    std::lock_guard<std::mutex> lock(server_mutex);
+    server.swap(stopped_server);
+}
+
+//blocks until the batch holding the frame is done, may be called from many threads at the same time
+extern "C"
+JNIEXPORT jfloatArray JNICALL
+Java_com_lanytek_deepmon_DeepMon_Infer(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jfloatArray input_arr) {
+    std::shared_ptr<DM_Inference_Server> running_server = get_server();
+    if(running_server == NULL)
+        return NULL;
+
+    jfloat* data = env->GetFloatArrayElements(input_arr, 0);
+    DM_Blob *input = new DM_Blob(net->GetInputShapes(), ENVIRONMENT_CPU, PRECISION_32, data);
+    env->ReleaseFloatArrayElements(input_arr, data, 0);
+
+    DM_Blob *result = running_server->Submit(input).get();
+    if(result == NULL)
+        return NULL;
 
     jfloatArray resultArr = env->NewFloatArray(net->GetOutputSize());
     env->SetFloatArrayRegion(resultArr, 0, net->GetOutputSize(), result->get_cpu_data());
+    delete result;
 
     return resultArr;
 }
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_lanytek_deepmon_DeepMon_GetLatencyPercentile(
+        JNIEnv* env,
+        jobject thisobj/* this */,
+        jdouble percentile) {
+    std::shared_ptr<DM_Inference_Server> running_server = get_server();
+    if(running_server == NULL)
+        return 0;
+    return running_server->GetLatencyHistogram().GetPercentile(percentile);
+}
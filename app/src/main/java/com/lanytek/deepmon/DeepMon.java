@@ -1,5 +1,9 @@
 package com.lanytek.deepmon;
 
+import android.graphics.Bitmap;
+
+import java.nio.ByteBuffer;
+
 /**
  * Created by JC1DA on 6/19/17.
  */
@@ -13,4 +17,41 @@ public class DeepMon {
     public static native void InitDeepMonWithPackageName(String package_name);
     public static native void LoadNet(String model_dir_path);
     public static native float [] GetInference(float [] input);
+    /**
+     * Runs all frames in one batch, the batch size may change from one call to the next
+     * Returns one result per frame, or null if the inference failed
+     */
+    public static native float [][] GetInferenceBatch(float [][] inputs);
+    /**
+     * Zero-copy inference on direct buffers (ByteBuffer.allocateDirect, native byte order)
+     * input holds one or more frames of floats and is read in place, the results of all frames are written into output
+     * GetInferenceBitmap feeds a RGBA_8888 bitmap of the input size, every channel becomes (value - mean) * scale
+     * Both return false if the inference failed
+     */
+    public static native boolean GetInferenceDirect(ByteBuffer input, ByteBuffer output);
+    public static native boolean GetInferenceBitmap(Bitmap bitmap, float mean, float scale, ByteBuffer output);
+    /**
+     * Number of threads used by layers placed on the CPU, 0 uses all cores
+     */
+    public static native void SetNumThreads(int num_threads);
+    public static native int GetNumThreads();
+    /**
+     * Streaming mode: CPU and GPU parts of the network work on consecutive frames at the same time
+     * SubmitFrame returns false if the pipeline is full, PollResult returns null if no frame is finished yet
+     * and an empty array for a frame which failed. Results come back in submission order
+     */
+    public static native boolean StartStreaming(int queue_capacity);
+    public static native void StopStreaming();
+    public static native boolean SubmitFrame(float [] input);
+    public static native float [] PollResult();
+    /**
+     * Inference server: Infer may be called from several threads at the same time, frames waiting together
+     * are run as one batch of at most max_batch_size frames, a frame waits at most max_wait_us for others
+     * Infer blocks until the result of its frame is ready and returns null if the inference failed
+     * GetLatencyPercentile gives the latency (in us, from Infer to its result) under which percentile % of the frames were
+     */
+    public static native void StartServer(int max_batch_size, int max_wait_us);
+    public static native void StopServer();
+    public static native float [] Infer(float [] input);
+    public static native long GetLatencyPercentile(double percentile);
 }